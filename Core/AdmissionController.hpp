@@ -0,0 +1,242 @@
+#ifndef __CORE_ADMISSIONCONTROLLER_HPP__
+#define __CORE_ADMISSIONCONTROLLER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <Core/Config.h>
+
+namespace FreshCask
+{
+	// debt a bucket has piled up that merge and checkpoint have to pay off
+	struct WritePressure
+	{
+		uint64_t DeadBytes;
+		uint32_t FileCount;     // older and active files, merged files are as few as they get
+		uint64_t CheckpointLag; // bytes appended since hint file, replayed on open
+
+		WritePressure() : DeadBytes(0), FileCount(0), CheckpointLag(0) {}
+	};
+
+	// Holds writers back when debt grows faster than it is paid off. Past a slowdown
+	// threshold every write is delayed, longer the closer the debt gets to its stop
+	// threshold; past a stop threshold writes wait for maintenance (or are rejected).
+	class AdmissionController
+	{
+	public:
+		struct Limits
+		{
+			uint64_t SlowdownDeadBytes, StopDeadBytes;
+			uint32_t SlowdownFileCount, StopFileCount;
+			uint64_t SlowdownCheckpointLag, StopCheckpointLag;
+			uint32_t MaxWriteDelayUs; // delay of a write right below a stop threshold
+			uint32_t MaxStallMs;      // longest wait of a write at a stop threshold
+			bool RejectOnStop;        // fail writes at a stop threshold instead of waiting
+
+			Limits()
+				: SlowdownDeadBytes(DefaultSlowdownDeadBytes), StopDeadBytes(DefaultStopDeadBytes),
+				SlowdownFileCount(DefaultSlowdownFileCount), StopFileCount(DefaultStopFileCount),
+				SlowdownCheckpointLag(DefaultSlowdownCheckpointLag), StopCheckpointLag(DefaultStopCheckpointLag),
+				MaxWriteDelayUs(DefaultMaxWriteDelayUs), MaxStallMs(DefaultMaxStallMs), RejectOnStop(false) {}
+		};
+
+		struct Stats
+		{
+			uint64_t DelayedWrites;
+			uint64_t StoppedWrites;
+			uint64_t RejectedWrites;
+			uint64_t StallMicros; // total time writers were held back
+
+			Stats() : DelayedWrites(0), StoppedWrites(0), RejectedWrites(0), StallMicros(0) {}
+		};
+
+	public:
+		AdmissionController() : relief(0), delayedWrites(0), stoppedWrites(0), rejectedWrites(0), stallMicros(0) { SetLimits(Limits()); }
+
+		AdmissionController(const AdmissionController&) = delete;
+		AdmissionController& operator=(const AdmissionController&) = delete;
+
+		//************************************
+		// Method:    Admit
+		// FullName:  FreshCask::AdmissionController::Admit
+		// Access:    public 
+		// Returns:   Status, NoFreeSpace if the write is rejected
+		// Desc:      Let a write through, after holding it back as far as debt requires.
+		//            relieve is called whenever debt is past a slowdown threshold, it should
+		//            get maintenance going and return at once.
+		// Parameter: const MeasureType & measure, returns current WritePressure
+		// Parameter: const RelieveType & relieve
+		//************************************
+		template <typename MeasureType, typename RelieveType>
+		Status Admit(const MeasureType &measure, const RelieveType &relieve)
+		{
+			WritePressure pressure = measure();
+			if (!MayHold(pressure))
+				RET_BY_SENDER(Status::OK(), "AdmissionController::Admit()"); // the usual case, no lock taken
+
+			Limits cur = GetLimits();
+			double level = getLevel(pressure, cur);
+			if (level <= 0)
+				RET_BY_SENDER(Status::OK(), "AdmissionController::Admit()");
+
+			relieve();
+			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+			if (level < 1)
+			{
+				delayedWrites.fetch_add(1, std::memory_order_relaxed);
+				std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)(level * cur.MaxWriteDelayUs)));
+			}
+			else if (cur.RejectOnStop)
+			{
+				rejectedWrites.fetch_add(1, std::memory_order_relaxed);
+				RET_BY_SENDER(Status::NoFreeSpace("Write rejected, merge or checkpoint is behind."), "AdmissionController::Admit()");
+			}
+			else
+			{
+				// wait for maintenance passes until debt drops below stop, but never forever
+				stoppedWrites.fetch_add(1, std::memory_order_relaxed);
+				std::chrono::steady_clock::time_point deadline = begin + std::chrono::milliseconds(cur.MaxStallMs);
+
+				std::unique_lock<std::mutex> lock(mutex);
+				while (getLevel(measure(), cur) >= 1 && std::chrono::steady_clock::now() < deadline)
+				{
+					uint64_t seen = relief;
+					lock.unlock();
+					relieve();
+					lock.lock();
+					cond.wait_until(lock, deadline, [&] { return relief != seen; });
+				}
+			}
+
+			stallMicros.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count(), std::memory_order_relaxed);
+			RET_BY_SENDER(Status::OK(), "AdmissionController::Admit()");
+		}
+
+		//************************************
+		// Method:    TryAdmit
+		// FullName:  FreshCask::AdmissionController::TryAdmit
+		// Access:    public 
+		// Returns:   Status, NoFreeSpace if the write is rejected
+		// Desc:      Admit() for writes nobody waits on, e.g. async ones, decided at once. A
+		//            write Admit() would only delay goes through, one it would stop is held:
+		//            the caller keeps it and asks again after a maintenance pass, until the
+		//            debt is below stop or MaxStallMs have gone by.
+		// Parameter: const WritePressure & pressure
+		// Parameter: const RelieveType & relieve
+		// Parameter: bool & held
+		//************************************
+		template <typename RelieveType>
+		Status TryAdmit(const WritePressure &pressure, const RelieveType &relieve, bool &held)
+		{
+			held = false;
+			if (!MayHold(pressure))
+				RET_BY_SENDER(Status::OK(), "AdmissionController::TryAdmit()");
+
+			Limits cur = GetLimits();
+			double level = getLevel(pressure, cur);
+			if (level <= 0)
+				RET_BY_SENDER(Status::OK(), "AdmissionController::TryAdmit()");
+
+			relieve();
+			if (level < 1)
+				RET_BY_SENDER(Status::OK(), "AdmissionController::TryAdmit()");
+
+			if (cur.RejectOnStop)
+			{
+				rejectedWrites.fetch_add(1, std::memory_order_relaxed);
+				RET_BY_SENDER(Status::NoFreeSpace("Write rejected, merge or checkpoint is behind."), "AdmissionController::TryAdmit()");
+			}
+
+			stoppedWrites.fetch_add(1, std::memory_order_relaxed);
+			held = true;
+			RET_BY_SENDER(Status::OK(), "AdmissionController::TryAdmit()");
+		}
+
+		// a write TryAdmit() held goes through after all
+		void Released(std::chrono::steady_clock::time_point heldSince)
+		{
+			stallMicros.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - heldSince).count(), std::memory_order_relaxed);
+		}
+
+		// false if Admit() would let a write through at once, without taking a lock
+		bool MayHold(const WritePressure &pressure) const
+		{
+			return pressure.DeadBytes >= slowdownDeadBytes.load(std::memory_order_relaxed) ||
+				pressure.FileCount >= slowdownFileCount.load(std::memory_order_relaxed) ||
+				pressure.CheckpointLag >= slowdownCheckpointLag.load(std::memory_order_relaxed);
+		}
+
+		// true if maintenance still has to pay off debt, i.e. past a slowdown threshold
+		bool InDebt(const WritePressure &pressure) { return getLevel(pressure, GetLimits()) > 0; }
+
+		// true if debt is past a stop threshold
+		bool Stopped(const WritePressure &pressure) { return getLevel(pressure, GetLimits()) >= 1; }
+
+		// a maintenance pass is done, stopped writers check again
+		void Relieved()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			relief++;
+			cond.notify_all();
+		}
+
+		void SetLimits(const Limits &_limits)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			limits = _limits;
+			slowdownDeadBytes = std::min(limits.SlowdownDeadBytes, limits.StopDeadBytes);
+			slowdownFileCount = std::min(limits.SlowdownFileCount, limits.StopFileCount);
+			slowdownCheckpointLag = std::min(limits.SlowdownCheckpointLag, limits.StopCheckpointLag);
+		}
+
+		Limits GetLimits()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return limits;
+		}
+
+		Stats GetStats() const
+		{
+			Stats stats;
+			stats.DelayedWrites = delayedWrites.load(std::memory_order_relaxed);
+			stats.StoppedWrites = stoppedWrites.load(std::memory_order_relaxed);
+			stats.RejectedWrites = rejectedWrites.load(std::memory_order_relaxed);
+			stats.StallMicros = stallMicros.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+	private:
+		// 0 below every slowdown threshold, 1 or more at a stop threshold, in between otherwise
+		static double getLevel(const WritePressure &pressure, const Limits &cur)
+		{
+			double level = 0;
+			level = std::max(level, getLevel(pressure.DeadBytes, cur.SlowdownDeadBytes, cur.StopDeadBytes));
+			level = std::max(level, getLevel(pressure.FileCount, cur.SlowdownFileCount, cur.StopFileCount));
+			level = std::max(level, getLevel(pressure.CheckpointLag, cur.SlowdownCheckpointLag, cur.StopCheckpointLag));
+			return level;
+		}
+
+		static double getLevel(uint64_t value, uint64_t slowdown, uint64_t stop)
+		{
+			if (value >= stop) return 1;
+			if (value < slowdown) return 0;
+			return (double)(value - slowdown) / (stop - slowdown);
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable cond;
+		Limits limits;
+		uint64_t relief; // maintenance passes done
+		std::atomic<uint64_t> slowdownDeadBytes, slowdownCheckpointLag; // lowest thresholds, for the fast path
+		std::atomic<uint32_t> slowdownFileCount;
+
+		std::atomic<uint64_t> delayedWrites, stoppedWrites, rejectedWrites, stallMicros;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_ADMISSIONCONTROLLER_HPP__
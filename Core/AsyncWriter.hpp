@@ -0,0 +1,488 @@
+#ifndef __CORE_ASYNCWRITER_HPP__
+#define __CORE_ASYNCWRITER_HPP__
+
+#include <atomic>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+
+#include <Util/MPSCQueue.hpp>
+#include <Util/ScratchArena.hpp>
+#include <Util/TaskScheduler.hpp>
+
+#include <Core/StorageEngine.hpp>
+
+namespace FreshCask
+{
+	// Writer of one lane, it owns the lane's active data file. Callers encode and checksum
+	// their records on their own thread and push them onto a lock-free queue; whoever holds
+	// the lane stamps each with a sequence number, appends them in queue order, publishes the
+	// resulting hash records in sequence order across lanes and then completes the caller.
+	// The lane has no thread of its own: Write() appends on the caller's thread if nobody else
+	// holds the lane, otherwise a drain task on the shared scheduler holds it while there are
+	// requests, and gives the worker back after WriterDrainRequests of them. Callbacks of
+	// Submit() and Execute() run on the scheduler once the lane is let go of, never on the
+	// thread of an unrelated Write().
+	class AsyncWriter
+	{
+	public:
+		typedef std::function<void(const Status&)> CallbackType;
+		typedef std::function<Status()> TaskType;
+		typedef std::function<void(const WriteBatch::Entry*, const HashFile::Record*, size_t)> PublishType;
+
+	private:
+		// parks a thread blocked in Write(), one per thread and reused
+		struct Waiter
+		{
+			std::mutex Mutex;
+			std::condition_variable Cond;
+			bool Done;
+
+			Waiter() : Done(false) {}
+		};
+
+		struct Request : public MPSCQueue::Node
+		{
+			// what to append: an encoded frame, or prefix + key + value straight from the caller
+			WriteSegment Segments[3];
+			uint32_t SegmentCount;
+
+			// CRC32 + RecordHeader, filled in by whoever holds the lane once the sequence is known
+			BytePtr Prefix;
+			DataFile::RecordHeader Header;
+			DataFile::CRC32::CRCType BodyCRC;
+
+			// what to publish once appended
+			const WriteBatch::Entry *Entries;
+			const uint32_t *OffsetsOfValue; // relative to the frame
+			size_t Count;
+
+			TaskType Task; // if set, run while holding the lane instead of appending
+
+			// Submit() owns its request and completes it by callback, Write() waits on its stack
+			WriteBatch Batch;
+			SmartByteArray Frame;
+			std::vector<uint32_t> Offsets;
+			CallbackType Callback;
+			Request *NextDone; // callbacks to run once the lane is let go of
+
+			Waiter *Caller;
+			Status Result;
+
+			Request() : SegmentCount(0), Prefix(nullptr), BodyCRC(0), Entries(nullptr), OffsetsOfValue(nullptr), Count(0), NextDone(nullptr), Caller(nullptr) {}
+		};
+
+	public:
+		AsyncWriter(StorageEngine &engine, uint32_t lane, const PublishType &publish, TaskScheduler &tasks)
+			: engine(engine), sequencer(engine.GetSequencer()), lane(lane), publish(publish), tasks(tasks), pending(0), parks(0), scheduled(false), running(false), stopping(false) {}
+		~AsyncWriter() { Stop(); }
+
+		AsyncWriter(const AsyncWriter&) = delete;
+		AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+		Status Start()
+		{
+			if (running)
+				RET_BY_SENDER(Status::InvalidArgument("Writer already started"), "AsyncWriter::Start()");
+
+			stopping = false;
+			parks = 0;
+			drains.Reset();
+			running = true;
+			RET_BY_SENDER(Status::OK(), "AsyncWriter::Start()");
+		}
+
+		//************************************
+		// Method:    Stop
+		// FullName:  FreshCask::AsyncWriter::Stop
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Append what is queued on the calling thread, drop the drain task if it
+		//            hasn't started and wait for it if it has, then for every callback
+		//************************************
+		Status Stop()
+		{
+			if (!running)
+				RET_BY_SENDER(Status::OK(), "AsyncWriter::Stop()");
+
+			stopping = true;
+			parks++; // for good, the drain task leaves the lane to us
+			Request *done;
+			{
+				std::lock_guard<std::mutex> lock(drainMutex);
+				done = appendQueued(nullptr, 0);
+			}
+			dispatch(done);
+
+			drains.Cancel();
+			drains.Wait();
+			completions.Wait(); // dispatched by the drain task too, so after it
+			running = false;
+			RET_BY_SENDER(Status::OK(), "AsyncWriter::Stop()");
+		}
+
+		//************************************
+		// Method:    Park
+		// FullName:  FreshCask::AsyncWriter::Park
+		// Access:    public
+		// Returns:   void
+		// Desc:      Take the lane, once the request being appended is done nothing else is
+		//            until Unpark(). Requests queued meanwhile wait, no worker is held.
+		//************************************
+		void Park()
+		{
+			parks++;
+			drainMutex.lock();
+		}
+
+		void Unpark() { leave(); }
+
+		//************************************
+		// Method:    Write
+		// FullName:  FreshCask::AsyncWriter::Write
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Append entries and wait until they are published. Nothing is allocated
+		//            in steady state: the request lives on this stack, headers are built in
+		//            the thread's scratch arena and a single record is written straight from
+		//            the caller's key and value buffers.
+		// Parameter: const WriteBatch::Entry * entries
+		// Parameter: size_t count
+		//************************************
+		Status Write(const WriteBatch::Entry *entries, size_t count)
+		{
+			if (!running || stopping)
+				RET_BY_SENDER(Status::IOError("Writer not running"), "AsyncWriter::Write()");
+
+			uint64_t frameSize = DataFileEngine::GetEncodedSize(entries, count);
+			if (sizeof(DataFile::Header) + frameSize > DataFile::MaxFileSize)
+				RET_BY_SENDER(Status::InvalidArgument("Batch exceeds MaxFileSize."), "AsyncWriter::Write()");
+
+			ScratchArena &arena = ScratchArena::ThreadLocal();
+			uint32_t *offsets = reinterpret_cast<uint32_t*>(arena.Allocate((uint32_t)(count * sizeof(uint32_t))));
+
+			Request req;
+			req.Entries = entries;
+			req.Count = count;
+			req.OffsetsOfValue = offsets;
+			req.Header = DataFileEngine::MakeRecordHeader(entries, count, GetTimeStamp());
+			req.Caller = &threadWaiter();
+
+			if (count == 1)
+			{
+				req.Prefix = arena.Allocate(DataFileEngine::RecordPrefixSize);
+				req.BodyCRC = DataFileEngine::GetBodyCRC(entries[0]);
+				offsets[0] = DataFileEngine::RecordPrefixSize + entries[0].Key.Size();
+
+				req.Segments[0] = WriteSegment(req.Prefix, DataFileEngine::RecordPrefixSize);
+				req.Segments[1] = WriteSegment(entries[0].Key);
+				req.Segments[2] = WriteSegment(entries[0].Value);
+				req.SegmentCount = 3;
+			}
+			else
+			{
+				req.Prefix = arena.Allocate((uint32_t)frameSize);
+				req.BodyCRC = DataFileEngine::EncodeEntries(entries, count, req.Prefix, offsets);
+
+				req.Segments[0] = WriteSegment(req.Prefix, (uint32_t)frameSize);
+				req.SegmentCount = 1;
+			}
+
+			if (!enqueue(&req, false))
+			{
+				arena.Reset();
+				RET_BY_SENDER(Status::IOError("Writer not running"), "AsyncWriter::Write()");
+			}
+
+			// a free lane is taken at once, a lone writer appends on its own thread and nothing
+			// is scheduled. A worker of the scheduler waits for the lane rather than for the
+			// drain task, which may be queued behind it; anybody else leaves it to the holder.
+			bool holding = tasks.IsWorkerThread();
+			if (holding) Park();
+			else if (drainMutex.try_lock()) parks++, holding = true;
+
+			if (holding)
+			{
+				Request *done = appendQueued(&req, 0);
+				leave();
+				dispatch(done);
+			}
+			else if (!schedule()) drain(); // in case the holder let go meanwhile
+
+			{
+				std::unique_lock<std::mutex> lock(req.Caller->Mutex);
+				req.Caller->Cond.wait(lock, [&] { return req.Caller->Done; });
+				req.Caller->Done = false;
+			}
+
+			arena.Reset();
+			RET_BY_SENDER(req.Result, "AsyncWriter::Write()");
+		}
+
+		//************************************
+		// Method:    Submit
+		// FullName:  FreshCask::AsyncWriter::Submit
+		// Access:    public
+		// Returns:   void
+		// Desc:      Encode batch on the calling thread and queue it, callback is invoked
+		//            on the scheduler once the batch is written and published. It may write
+		//            to this lane itself, a batch that can't be queued fails on the spot.
+		// Parameter: const WriteBatch & batch
+		// Parameter: const CallbackType & callback
+		//************************************
+		void Submit(const WriteBatch &batch, const CallbackType &callback)
+		{
+			if (!running || stopping)
+			{
+				callback(Status::IOError("Writer not running"));
+				return;
+			}
+
+			Request *req = new Request;
+			req->Batch = batch;
+			req->Callback = callback;
+
+			Status s = DataFileEngine::EncodeBatch(req->Batch, req->Frame, req->Offsets, req->BodyCRC);
+			if (!s.IsOK())
+			{
+				delete req;
+				callback(s);
+				return;
+			}
+
+			req->Segments[0] = WriteSegment(req->Frame);
+			req->SegmentCount = 1;
+			req->Prefix = req->Frame.Data();
+			req->Header = DataFileEngine::MakeRecordHeader(req->Batch.Entries().data(), req->Batch.Count(), GetTimeStamp());
+			req->Entries = req->Batch.Entries().data();
+			req->OffsetsOfValue = req->Offsets.data();
+			req->Count = req->Batch.Count();
+			if (!enqueue(req))
+			{
+				delete req;
+				callback(Status::IOError("Writer not running"));
+			}
+		}
+
+		std::future<Status> Submit(const WriteBatch &batch)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			Submit(batch, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+		//************************************
+		// Method:    Execute
+		// FullName:  FreshCask::AsyncWriter::Execute
+		// Access:    public
+		// Returns:   std::future<Status>
+		// Desc:      Run task while holding the lane, ordered after every write queued before
+		//            it. Not to be waited for on a worker of the scheduler.
+		// Parameter: const TaskType & task
+		//************************************
+		std::future<Status> Execute(const TaskType &task)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+
+			if (!running || stopping)
+				promise->set_value(Status::IOError("Writer not running"));
+			else
+			{
+				Request *req = new Request;
+				req->Task = task;
+				req->Callback = [promise](const Status &s) { promise->set_value(s); };
+				if (!enqueue(req))
+				{
+					delete req;
+					promise->set_value(Status::IOError("Writer not running"));
+				}
+			}
+
+			return promise->get_future();
+		}
+
+	private:
+		static Waiter& threadWaiter()
+		{
+			static thread_local Waiter waiter;
+			return waiter;
+		}
+
+		// false if the writer is stopping, req is not queued then. req is counted in pending
+		// before stopping is looked at, and Stop() appends until pending is 0, so a request
+		// that gets in is always written. Without wake, the caller sees to it being appended.
+		bool enqueue(Request *req, bool wake = true)
+		{
+			pending.fetch_add(1);
+			if (stopping)
+			{
+				pending.fetch_sub(1);
+				return false;
+			}
+
+			// before req is pushed: once it is, Stop() may append it and return
+			bool queued = !wake || schedule();
+			queue.Push(req);
+			if (!queued) drain(); // the scheduler is stopping, this thread appends instead
+			return true;
+		}
+
+		// queue the drain task unless it is queued or running already, false if the
+		// scheduler refused it: the caller has to drain() then
+		bool schedule()
+		{
+			bool expected = false;
+			if (!scheduled.compare_exchange_strong(expected, true)) return true;
+			return tasks.Submit([this]() { drain(); }, TaskPriority::Foreground, &drains).IsValid();
+		}
+
+		// let go of the lane taken by Park() or Write(), the drain task may have left it meanwhile
+		void leave()
+		{
+			drainMutex.unlock();
+			parks--;
+			if (pending.load() > 0 && !schedule()) drain();
+		}
+
+		void drain()
+		{
+			while (true)
+			{
+				Request *done = nullptr;
+				{
+					std::unique_lock<std::mutex> lock(drainMutex, std::try_to_lock);
+					if (lock.owns_lock()) done = appendQueued(nullptr, WriterDrainRequests);
+				}
+				dispatch(done);
+
+				// cleared before looking again: a request queued, or the lane let go of,
+				// meanwhile either finds it cleared and schedules, or is seen here
+				scheduled = false;
+				if (pending.load() == 0 || parks.load() > 0) return;
+
+				bool expected = false;
+				if (!scheduled.compare_exchange_strong(expected, true)) return;
+				if (tasks.Submit([this]() { drain(); }, TaskPriority::Foreground, &drains).IsValid()) return;
+			}
+		}
+
+		// with drainMutex held: append requests in queue order until the queue is empty,
+		// or until is done. The drain task passes a limit, and leaves the lane early to
+		// whoever waits in Park(); those holding the lane themselves pass 0. Waiting callers
+		// are let go at once, requests with a callback are given back in order for dispatch().
+		Request* appendQueued(Request *until, uint32_t limit)
+		{
+			Request *done = nullptr, **last = &done;
+			for (uint32_t count = 0; limit == 0 || count < limit; )
+			{
+				if (limit > 0 && parks.load() > 0) break;
+				if (until != nullptr && isDone(until)) break; // by the drain task before we got the lane
+
+				Request *req = static_cast<Request*>(queue.Pop());
+				if (req == nullptr)
+				{
+					if (pending.load(std::memory_order_acquire) == 0) break;
+
+					std::this_thread::yield(); // a producer is halfway through Push()
+					continue;
+				}
+
+				Status s;
+				if (req->Task) s = req->Task();
+				else
+				{
+					uint64_t sequence = sequencer.Reserve((uint32_t)req->Count);
+					req->Header.Sequence = sequence;
+					DataFileEngine::EncodePrefix(req->Header, req->BodyCRC, req->Prefix);
+
+					uint32_t fileId, frameOffset;
+					s = engine.AppendGather(lane, req->Segments, req->SegmentCount, fileId, frameOffset);
+
+					if (s.IsOK())
+					{
+						hashRecs.clear();
+						for (size_t i = 0; i < req->Count; i++)
+							hashRecs.push_back(HashFile::Record(fileId, req->Entries[i].Value.Size(), frameOffset + req->OffsetsOfValue[i], req->Header.TimeStamp, sequence + i));
+					}
+
+					// commit even if the append failed, later sequences are waiting for it
+					sequencer.Commit(sequence, (uint32_t)req->Count, [&]() {
+						if (s.IsOK()) publish(req->Entries, hashRecs.data(), req->Count);
+					});
+				}
+
+				pending.fetch_sub(1, std::memory_order_acq_rel);
+				count++;
+
+				bool mine = req == until; // complete() lets its caller go
+				if (req->Caller == nullptr)
+				{
+					req->Result = s;
+					*last = req, last = &req->NextDone;
+				}
+				else complete(req, s);
+				if (mine) break;
+			}
+
+			return done;
+		}
+
+		static bool isDone(Request *req)
+		{
+			std::lock_guard<std::mutex> lock(req->Caller->Mutex);
+			return req->Caller->Done;
+		}
+
+		void complete(Request *req, const Status &s)
+		{
+			// req lives on the waiting thread's stack, and the waiter in its TLS: notify
+			// under the lock so the caller can't return (or exit) before we are done
+			Waiter *waiter = req->Caller;
+			std::lock_guard<std::mutex> lock(waiter->Mutex);
+			req->Result = s;
+			waiter->Done = true;
+			waiter->Cond.notify_one();
+		}
+
+		// run callbacks of requests appendQueued() gave back, with the lane let go of: a
+		// callback may write to this lane, and a slow one mustn't hold anybody's write back.
+		// They run right here if the scheduler is stopping.
+		void dispatch(Request *done)
+		{
+			if (done == nullptr) return;
+
+			auto run = [done]() {
+				for (Request *req = done, *next; req != nullptr; req = next)
+				{
+					next = req->NextDone;
+					req->Callback(req->Result);
+					delete req;
+				}
+			};
+			if (!tasks.Submit(run, TaskPriority::Foreground, &completions).IsValid()) run();
+		}
+
+	private:
+		StorageEngine &engine;
+		WriteSequencer &sequencer;
+		uint32_t lane;
+		PublishType publish;
+
+		TaskScheduler &tasks;
+
+		MPSCQueue queue;
+		std::atomic<uint32_t> pending;
+
+		std::mutex drainMutex; // held while appending: by the drain task, Write(), Park() or Stop()
+		std::atomic<uint32_t> parks; // threads but the drain task waiting for or holding the lane
+		std::vector<HashFile::Record> hashRecs; // of the request being appended, under drainMutex
+
+		TaskGroup drains;
+		TaskGroup completions; // callbacks given to the scheduler by dispatch()
+		std::atomic<bool> scheduled; // the drain task is queued or running
+		std::atomic<bool> running, stopping;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_ASYNCWRITER_HPP__
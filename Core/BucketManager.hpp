@@ -2,18 +2,35 @@
 #define __CORE_BUCKETMANAGER_HPP__
 
 #include <Util/LRUCache.hpp>
+#include <Util/StatCounter.hpp>
 
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+#include <deque>
+
+#include <Core/EngineContext.hpp>
 #include <Core/StorageEngine.hpp>
+#include <Core/AsyncWriter.hpp>
+#include <Core/AdmissionController.hpp>
+#include <Core/WarmFileEngine.hpp>
 
 namespace FreshCask
 {
+	class Cursor;
+
 	class BucketManager
 	{
-	private:
-		typedef std::function<Status(const SmartByteArray&)> InternalEnumeratorType;
+		friend class Cursor;
+
+	public:
+		// called by ScanLive() for every live pair, the bytes are valid during the call only
+		typedef std::function<Status(const SmartByteArray&, const SmartByteArray&)> ScanLiveCallbackType;
 
 	public:
-		BucketManager() : engine(nullptr) {}
+		BucketManager(EngineContext &context = EngineContext::Default()) : keydirMutex("BucketManager.Keydir", DefaultLockSpins), cache(new LRUCache), cacheSpace(0), engine(nullptr), laneCount(DefaultWriteLanes), maxKeydirProbes(0), totalLiveBytes(0),
+			maintenanceRequested(false), maintenanceScheduled(false), context(context), warming(false), warmStopping(false) {}
 		~BucketManager() { Close(); }
 
 		//************************************
@@ -23,12 +40,41 @@ namespace FreshCask
 		// Returns:   Status
 		// Desc:      Open a bucket
 		// Parameter: const std::string & _bucketDir
+		// Parameter: uint32_t _laneCount, active data files written in parallel
 		//************************************
-		Status Open(const std::string &_bucketDir)
+		Status Open(const std::string &_bucketDir, uint32_t _laneCount = DefaultWriteLanes)
 		{
 			bucketDir = _bucketDir;
-			engine = std::shared_ptr<StorageEngine>(new StorageEngine(bucketDir, hashTree));
-			RET_BY_SENDER(engine->Open(), "BucketManager::Open()");
+			laneCount = _laneCount;
+			engine = std::shared_ptr<StorageEngine>(new StorageEngine(bucketDir, hashTree, laneCount, context));
+			RET_IFNOT_OK(engine->Open(), "BucketManager::Open()");
+
+			// deletions aren't in the hash tree, they count as dead, see publish()
+			for (auto& item : hashTree)
+				addLiveBytes(item.second.DataFileId, DataFileEngine::GetRecordSize(item.first.Size(), item.second.SizeOfValue));
+
+			for (uint32_t lane = 0; lane < engine->GetLaneCount(); lane++)
+			{
+				writers.push_back(std::shared_ptr<AsyncWriter>(new AsyncWriter(*engine, lane, std::bind(&BucketManager::publish, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), context.GetTaskScheduler())));
+				RET_IFNOT_OK(writers.back()->Start(), "BucketManager::Open()");
+			}
+
+			asyncTasks.Reset();
+			backgroundTasks.Reset();
+			maintenanceRequested = maintenanceScheduled = false;
+
+			// fill the cache with what was hot when the bucket was last closed, in the background
+			std::vector<SmartByteArray> warmKeys;
+			if (WarmFileEngine::Read(bucketDir, warmKeys).IsOK() && !warmKeys.empty())
+			{
+				warming = true;
+				warmStopping = false;
+				std::shared_ptr<std::vector<SmartByteArray>> keys(new std::vector<SmartByteArray>(std::move(warmKeys)));
+				if (!context.GetTaskScheduler().Submit([this, keys]() { warmUp(std::move(*keys)); }, TaskPriority::Idle, &backgroundTasks).IsValid())
+					warming = false;
+			}
+
+			RET_BY_SENDER(Status::OK(), "BucketManager::Open()");
 		}
 
 		//************************************
@@ -56,10 +102,24 @@ namespace FreshCask
 		{
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Close()");
+
+			warmStopping = true;
+			asyncTasks.Wait(); // what callers wait for runs to the end, writes go on to the lanes still open
+
+			// maintenance and warm-up not started yet are dropped
+			backgroundTasks.Cancel();
+			backgroundTasks.Wait();
+			warming = false;
+			releaseHeld(true); // no more passes to wait for
+
+			writeWarmFile(); // only a hint, failing to write it mustn't keep the bucket open
 			
+			for (auto& writer : writers)
+				RET_IFNOT_OK(writer->Stop(), "BucketManager::Close()");
 			RET_IFNOT_OK(engine->Close(makeHintFile), "BucketManager::Close()");
 			
-			engine.reset(); hashTree.clear();
+			writers.clear(); engine.reset(); hashTree.clear(); liveBytes.clear(); totalLiveBytes = 0;
+			if (cacheSpace == 0) cache->Clear(); // a shared cache's space is left to eviction, see ShareCache()
 			RET_BY_SENDER(Status::OK(), "BucketManager::Close()");
 		}
 
@@ -75,7 +135,14 @@ namespace FreshCask
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Flush()");
 
-			RET_BY_SENDER(StorageEngine::CreateHintFile(bucketDir, hashTree), "StorageEngine::Close()");
+			// dump hash tree while no record is appended and no merge moves an entry
+			RET_IFNOT_OK(parkLanes([this]() -> Status {
+				std::lock_guard<std::mutex> lock(relocateMutex);
+				return engine->CreateHintFile();
+			}), "BucketManager::Flush()");
+
+			writeWarmFile(); // only a hint, as in Close()
+			RET_BY_SENDER(Status::OK(), "BucketManager::Flush()");
 		}
 
 		//************************************
@@ -95,18 +162,79 @@ namespace FreshCask
 			//HashFile::HashType hash;
 			//RET_IFNOT_OK(HashFile::HashFunction(key, hash), "BucketManager::Get()");
 
-			HashFile::HashTree::iterator it = hashTree.find(key);
-			if (it == hashTree.end())
+			HashFile::Record hashRec;
+			if (!lookup(key, hashRec))
 				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "BucketManager::Get()");
 
-			Status s = cache.Get(key, out);
+			Status s = cache->Get(key, out, cacheSpace);
+			if (s.IsNotFound())
+				RET_BY_SENDER(readValue(key, hashRec, out), "BucketManager::Get()");
+			else
+				RET_BY_SENDER(s, "BucketManager::Get()");
+		}
+
+		//************************************
+		// Method:    GetPinned
+		// FullName:  FreshCask::BucketManager::GetPinned
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Get value by a specific key without copying a cached one. The slice points
+		//            into the cache entry and keeps it alive until released, a value read from
+		//            disk is handed over in the buffer it was read into.
+		// Parameter: const SmartByteArray & key
+		// Parameter: PinnableSlice & out, to be released before the bucket is closed
+		//************************************
+		Status GetPinned(const SmartByteArray& key, PinnableSlice &out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::GetPinned()");
+
+			HashFile::Record hashRec;
+			if (!lookup(key, hashRec))
+				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "BucketManager::GetPinned()");
+
+			Status s = cache->GetPinned(key, out, cacheSpace);
 			if (s.IsNotFound())
 			{
-				RET_IFNOT_OK(engine->ReadValue(it->second, out), "BucketManager::Get()");
-				RET_BY_SENDER(cache.Put(key, out), "BucketManager::Get()");
+				SmartByteArray value;
+				RET_IFNOT_OK(readValue(key, hashRec, value), "BucketManager::GetPinned()");
+				out.PinSelf(std::move(value));
+				RET_BY_SENDER(Status::OK(), "BucketManager::GetPinned()");
 			}
 			else
-				RET_BY_SENDER(s, "BucketManager::Get()");
+				RET_BY_SENDER(s, "BucketManager::GetPinned()");
+		}
+
+		//************************************
+		// Method:    MultiGet
+		// FullName:  FreshCask::BucketManager::MultiGet
+		// Access:    public 
+		// Returns:   Status, of the call as a whole, that of each key goes to statuses
+		// Desc:      Get the values of many keys at once. Values missing the cache are read in
+		//            data file order, values lying close together with a single read, and
+		//            the reads are run in parallel.
+		// Parameter: const std::vector<SmartByteArray> & keys
+		// Parameter: std::vector<SmartByteArray> & values, those of one read share its buffer
+		// Parameter: std::vector<Status> & statuses
+		//************************************
+		Status MultiGet(const std::vector<SmartByteArray>& keys, std::vector<SmartByteArray> &values, std::vector<Status> &statuses)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::MultiGet()");
+
+			values.assign(keys.size(), SmartByteArray::Null());
+			statuses.assign(keys.size(), Status::OK());
+
+			std::vector<HashFile::Record> hashRecs;
+			std::vector<bool> found;
+			lookupBatch(keys, hashRecs, found);
+
+			for (size_t i = 0; i < keys.size(); i++)
+				if (!found[i]) statuses[i] = Status::NotFound("Key doesn't exist");
+
+			readValues(keys, hashRecs, values, statuses);
+
+			RET_BY_SENDER(Status::OK(), "BucketManager::MultiGet()");
 		}
 
 		//************************************
@@ -126,17 +254,10 @@ namespace FreshCask
 			//HashFile::HashType hash;
 			//RET_IFNOT_OK(HashFile::HashFunction(key, hash), "BucketManager::Put()");
 
-			HashFile::Record hashRec;
-			RET_IFNOT_OK(engine->WriteRecord(DataFile::Record(key, value), hashRec), "BucketManager::Put()");
-
-			//if (value.Size() > 0) hashTree[hash] = std::pair<SmartByteArray, HashFile::Record>(key, hashRec);
-			if (value.Size() > 0) // value.Size() = 0 means delete.
-			{
-				hashTree[key] = hashRec;
-				RET_IFNOT_OK(cache.Put(key, value), "BucketManager::Put()");
-			}
+			RET_IFNOT_OK(admit(), "BucketManager::Put()");
 
-			RET_BY_SENDER(Status::OK(), "BucketManager::Put()");
+			WriteBatch::Entry entry(key, value); // value.Size() = 0 means delete.
+			RET_BY_SENDER(laneWriter().Write(&entry, 1), "BucketManager::Put()");
 		}
 
 		//************************************
@@ -155,21 +276,176 @@ namespace FreshCask
 			//HashFile::HashType hash;
 			//RET_IFNOT_OK(HashFile::HashFunction(key, hash), "BucketManager::Delete()");
 
-			HashFile::HashTree::iterator it = hashTree.find(key);
-			if (it == hashTree.end())
+			if (!CotainsKey(key))
 				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "BucketManager::Delete()");
-			hashTree.erase(it);
 
-			RET_IFNOT_OK(cache.Delete(key), "BucketManager::Delete()");
 			RET_BY_SENDER(Put(key, SmartByteArray::Null()), "BucketManager::Delete()");
 		}
 
+		//************************************
+		// Method:    Write
+		// FullName:  FreshCask::BucketManager::Write
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Apply a batch of puts and deletes atomically
+		// Parameter: const WriteBatch & batch
+		//************************************
+		Status Write(const WriteBatch& batch)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Write()");
+
+			if (batch.Count() == 0)
+				RET_BY_SENDER(Status::OK(), "BucketManager::Write()");
+
+			RET_IFNOT_OK(admit(), "BucketManager::Write()");
+			RET_BY_SENDER(laneWriter().Write(batch.Entries().data(), batch.Count()), "BucketManager::Write()");
+		}
+
+		typedef std::function<void(const Status&)> CompletionType;
+
+		//************************************
+		// Method:    GetAsync
+		// FullName:  FreshCask::BucketManager::GetAsync
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Get value by a specific key without blocking. A cached value or an error
+		//            completes on the calling thread, a value to be read from disk on the task
+		//            scheduler.
+		// Parameter: const SmartByteArray & key
+		// Parameter: SmartByteArray & out, must stay alive until done is called
+		// Parameter: const CompletionType & done
+		//************************************
+		void GetAsync(const SmartByteArray& key, SmartByteArray &out, const CompletionType &done)
+		{
+			if (!IsOpen())
+				return done(Status::IOError("Bucket not open"));
+
+			HashFile::Record hashRec;
+			if (!lookup(key, hashRec))
+				return done(Status::NotFound("Key doesn't exist"));
+
+			if (cache->Get(key, out, cacheSpace).IsOK())
+				return done(Status::OK());
+
+			SmartByteArray keyCopy = ownCopy(key); // the caller's key may be borrowed
+			if (!context.GetTaskScheduler().Submit([this, keyCopy, hashRec, &out, done]() { done(readValue(keyCopy, hashRec, out)); }, TaskPriority::Foreground, &asyncTasks).IsValid())
+				done(Status::IOError("Bucket not open"));
+		}
+
+		std::future<Status> GetAsync(const SmartByteArray& key, SmartByteArray &out)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			GetAsync(key, out, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+		//************************************
+		// Method:    PutAsync
+		// FullName:  FreshCask::BucketManager::PutAsync
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Put a <key, value> pair without blocking, done is called on the task
+		//            scheduler once the pair is written and visible to Get, and may use the
+		//            bucket itself. An error found right away completes on the calling thread.
+		// Parameter: const SmartByteArray & key
+		// Parameter: const SmartByteArray & value
+		// Parameter: const CompletionType & done
+		//************************************
+		void PutAsync(const SmartByteArray& key, const SmartByteArray &value, const CompletionType &done)
+		{
+			if (!IsOpen())
+				return done(Status::IOError("Bucket not open"));
+
+			WriteBatch batch;
+			batch.Put(ownCopy(key), ownCopy(value));
+			submit(batch, done);
+		}
+
+		std::future<Status> PutAsync(const SmartByteArray& key, const SmartByteArray &value)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			PutAsync(key, value, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+		void DeleteAsync(const SmartByteArray& key, const CompletionType &done)
+		{
+			if (!IsOpen())
+				return done(Status::IOError("Bucket not open"));
+
+			if (!CotainsKey(key))
+				return done(Status::NotFound("Key doesn't exist"));
+
+			WriteBatch batch;
+			batch.Delete(ownCopy(key));
+			submit(batch, done);
+		}
+
+		std::future<Status> DeleteAsync(const SmartByteArray& key)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			DeleteAsync(key, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+#ifdef __cpp_impl_coroutine
+		// co_await-able form of the calls above, the coroutine is resumed on whichever thread
+		// completes the call, or not suspended at all if it completes on the spot
+		class Awaitable
+		{
+		public:
+			typedef std::function<void(const CompletionType&)> StartType;
+
+			Awaitable(StartType start) : start(std::move(start)), completed(false) {}
+
+			bool await_ready() const { return false; }
+
+			bool await_suspend(std::coroutine_handle<> _handle)
+			{
+				handle = _handle;
+				start([this](const Status &s) {
+					result = s;
+					if (completed.exchange(true, std::memory_order_acq_rel)) handle.resume(); // suspended by now
+				});
+				return !completed.exchange(true, std::memory_order_acq_rel);
+			}
+
+			Status await_resume() const { return result; }
+
+		private:
+			StartType start;
+			std::coroutine_handle<> handle;
+			Status result;
+			std::atomic<bool> completed; // set by whichever of completion and suspension comes second
+		};
+
+		Awaitable GetAwaitable(const SmartByteArray& key, SmartByteArray &out)
+		{
+			SmartByteArray keyCopy = ownCopy(key);
+			return Awaitable([this, keyCopy, &out](const CompletionType &done) { GetAsync(keyCopy, out, done); });
+		}
+
+		Awaitable PutAwaitable(const SmartByteArray& key, const SmartByteArray &value)
+		{
+			SmartByteArray keyCopy = ownCopy(key), valueCopy = ownCopy(value);
+			return Awaitable([this, keyCopy, valueCopy](const CompletionType &done) { PutAsync(keyCopy, valueCopy, done); });
+		}
+
+		Awaitable DeleteAwaitable(const SmartByteArray& key)
+		{
+			SmartByteArray keyCopy = ownCopy(key);
+			return Awaitable([this, keyCopy](const CompletionType &done) { DeleteAsync(keyCopy, done); });
+		}
+#endif
+
 		//************************************
 		// Method:    Enumerate
 		// FullName:  FreshCask::BucketManager::Enumerate
 		// Access:    public 
 		// Returns:   Status
-		// Desc:      Enumerate all keys
+		// Desc:      Enumerate all keys, at once. Cursor walks the pairs of a large bucket
+		//            with bounded memory instead.
 		// Parameter: std::vector<std::string>&
 		//************************************
 		Status Enumerate(std::vector<std::string>& out)
@@ -177,45 +453,214 @@ namespace FreshCask
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Enumerate()");
 
+			LockGuard lock(keydirMutex);
 			for (auto& item : hashTree)
 				out.push_back(item.first.ToString());
 
 			RET_BY_SENDER(Status::OK(), "BucketManager::Enumerate()");
 		}
 
+		//************************************
+		// Method:    ScanLive
+		// FullName:  FreshCask::BucketManager::ScanLive
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Hand out every live <key, value> pair in the order the data files hold
+		//            them, reading the files sequentially rather than a value per key, as
+		//            background I/O that gives way to user reads. A record is live while hash
+		//            tree still points at it, or at the copy a merge made of it meanwhile. A
+		//            pair written during the scan may be missed or seen with its older value.
+		// Parameter: const ScanLiveCallbackType & func, a status other than OK stops the scan
+		//            and is returned
+		//************************************
+		Status ScanLive(const ScanLiveCallbackType &func)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::ScanLive()");
+
+			// taken between merges, so every live record is in exactly one of the files;
+			// merges may go on during the scan, their files aren't walked
+			std::vector<std::shared_ptr<DataFileEngine>> files;
+			{
+				std::lock_guard<std::mutex> lock(mergeMutex);
+				engine->GetFiles(files);
+			}
+
+			std::vector<uint32_t> fileIds;
+			for (auto& file : files) fileIds.push_back(file->GetFileId());
+
+			RET_BY_SENDER(engine->ScanFiles(files, [&](const SmartByteArray &key, const HashFile::Record &hashRec, const Byte *value, const Byte*, uint32_t) -> Status {
+				if (hashRec.SizeOfValue == 0 || !isCurrentOrMoved(key, hashRec, fileIds))
+					RET_BY_SENDER(Status::OK(), "BucketManager::ScanLive()");
+				RET_BY_SENDER(func(key, SmartByteArray::Borrow(value, hashRec.SizeOfValue)), "BucketManager::ScanLive()");
+			}, IOClass::BackgroundRead), "BucketManager::ScanLive()");
+		}
+
+		//************************************
+		// Method:    Merge
+		// FullName:  FreshCask::BucketManager::Merge
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Merge the older data files that merge policy picks, while the bucket
+		//            stays open. Live records are copied to new merged files, hash tree is
+		//            moved over to them, hint file is rewritten and only then the older
+		//            files are removed.
+		//************************************
+		Status Merge()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Merge()");
+
+			std::lock_guard<std::mutex> lock(mergeMutex);
+
+			std::vector<DataFileUsage> usage;
+			RET_IFNOT_OK(GetFileUsage(usage), "BucketManager::Merge()");
+
+			std::vector<uint32_t> fileIds;
+			mergePolicy.Select(usage, fileIds);
+			RET_BY_SENDER(mergeFiles(fileIds), "BucketManager::Merge()");
+		}
+
 		//************************************
 		// Method:    Compact
 		// FullName:  FreshCask::BucketManager::Compact
 		// Access:    public 
 		// Returns:   Status
-		// Desc:      Compact bucket
+		// Desc:      Compact bucket: seal every lane's active file and merge all data files,
+		//            regardless of merge policy
 		//************************************
 		Status Compact()
 		{
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::Compact()");
 
-			std::stringstream tmpBucketDir;
-			tmpBucketDir << bucketDir << "_tmp_" << GetTimeStamp();
+			std::lock_guard<std::mutex> lock(mergeMutex);
 
-			BucketManager tmpBucket;
-			RET_IFNOT_OK(MakeDir(tmpBucketDir.str()), "BucketManager::Compact()");
-			RET_IFNOT_OK(tmpBucket.Open(tmpBucketDir.str()), "BucketManager::Compact()");
-			RET_IFNOT_OK(this->listKey([&](const SmartByteArray& key) -> Status {
-				SmartByteArray value;
-				RET_IFNOT_OK(this->Get(key, value), "BucketManager::Compact()::Enumerator()");
-				RET_BY_SENDER(tmpBucket.Put(key, value), "BucketManager::Compact()::Enumerator()");
+			// sealed at once, so every record left in active files is newer than any sealed one
+			RET_IFNOT_OK(parkLanes([this]() -> Status {
+				for (uint32_t lane = 0; lane < writers.size(); lane++)
+					RET_IFNOT_OK(engine->SealLane(lane), "BucketManager::Compact()::Seal()");
+				RET_BY_SENDER(Status::OK(), "BucketManager::Compact()::Seal()");
 			}), "BucketManager::Compact()");
 
-			RET_IFNOT_OK(this->Close(false), "BucketManager::Compact()");
-			RET_IFNOT_OK(tmpBucket.Close(), "BucketManger::Compact()");
+			std::vector<uint32_t> fileIds;
+			engine->GetOlderFileIds(fileIds);
+			RET_BY_SENDER(mergeFiles(fileIds), "BucketManager::Compact()");
+		}
 
-			RET_IFNOT_OK(RemoveDir(bucketDir), "BucketManager::Compact()");
-#ifdef WIN32
-			::Sleep(1);	// fuck windows, must wait 1 ms.
-#endif
-			RET_IFNOT_OK(RenameFile(tmpBucketDir.str(), bucketDir), "BucketManager::Compact()");
-			RET_BY_SENDER(this->Open(bucketDir), "BucketManager::Compact()");
+		//************************************
+		// Method:    GetFileUsage
+		// FullName:  FreshCask::BucketManager::GetFileUsage
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Live and dead bytes of every data file
+		// Parameter: std::vector<DataFileUsage> & out
+		//************************************
+		Status GetFileUsage(std::vector<DataFileUsage>& out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::GetFileUsage()");
+
+			RET_IFNOT_OK(engine->GetFileUsage(out), "BucketManager::GetFileUsage()");
+
+			LockGuard lock(keydirMutex);
+			for (auto& usage : out)
+			{
+				std::map<uint32_t, uint64_t>::iterator it = liveBytes.find(usage.FileId);
+				if (it != liveBytes.end()) usage.LiveBytes = it->second;
+			}
+			RET_BY_SENDER(Status::OK(), "BucketManager::GetFileUsage()");
+		}
+
+		//************************************
+		// Method:    GetWritePressure
+		// FullName:  FreshCask::BucketManager::GetWritePressure
+		// Access:    public 
+		// Returns:   WritePressure
+		// Desc:      Debt of merge and checkpoint that admission control watches
+		//************************************
+		WritePressure GetWritePressure() const
+		{
+			WritePressure pressure;
+			uint64_t recordBytes = engine->GetRecordBytes(), live = totalLiveBytes.load(std::memory_order_relaxed);
+			pressure.DeadBytes = recordBytes > live ? recordBytes - live : 0;
+			pressure.FileCount = engine->GetFileCount();
+			pressure.CheckpointLag = engine->GetCheckpointLag();
+			return pressure;
+		}
+
+		//************************************
+		// Method:    SetCache
+		// FullName:  FreshCask::BucketManager::SetCache
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Resize the value cache and switch its eviction policy, the cache starts out empty.
+		//            A shared cache is reset for every bucket using it.
+		// Parameter: uint64_t capacity, in bytes
+		// Parameter: CachePolicy::Type policy
+		//************************************
+		void SetCache(uint64_t capacity, CachePolicy::Type policy)
+		{
+			cache->Reset(capacity, policy);
+		}
+
+		//************************************
+		// Method:    ShareCache
+		// FullName:  FreshCask::BucketManager::ShareCache
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Cache values in sharedCache instead of a cache of our own, under keys of
+		//            space. Every bucket sharing the cache needs a space of its own, but 0.
+		//            Close() leaves the space to eviction, a bucket opened again needs a new one.
+		// Qualifier: While the bucket is closed.
+		// Parameter: const std::shared_ptr<LRUCache> & sharedCache
+		// Parameter: uint32_t space
+		//************************************
+		void ShareCache(const std::shared_ptr<LRUCache> &sharedCache, uint32_t space)
+		{
+			cache = sharedCache;
+			cacheSpace = space;
+		}
+
+		// true while the cache is still being filled from the warm-up file
+		bool IsWarmingUp() const { return warming; }
+
+		void SetAdmissionLimits(const AdmissionController::Limits& limits) { admission.SetLimits(limits); }
+		AdmissionController::Stats GetAdmissionStats() const { return admission.GetStats(); }
+
+		struct Stats
+		{
+			LRUCache::Stats Cache;    // of the whole cache if shared
+			uint64_t KeyCount;
+			uint64_t KeydirBytes;     // estimated
+			uint64_t KeydirLookups;
+			uint64_t KeydirProbes;    // key comparisons made by all lookups
+			uint64_t MaxKeydirProbes; // by a single lookup
+		};
+
+		//************************************
+		// Method:    GetStats
+		// FullName:  FreshCask::BucketManager::GetStats
+		// Access:    public 
+		// Returns:   FreshCask::BucketManager::Stats
+		// Desc:      Cache and keydir counters, read without stopping the readers and writers
+		//************************************
+		Stats GetStats() const
+		{
+			Stats stats;
+			stats.Cache = cache->GetStats();
+			stats.KeyCount = PairCount();
+			stats.KeydirBytes = GetKeydirMemory();
+			stats.KeydirLookups = keydirLookups.Get();
+			stats.KeydirProbes = keydirProbes.Get();
+			stats.MaxKeydirProbes = maxKeydirProbes.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+		void SetMergePolicy(const MergePolicy& policy)
+		{
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			mergePolicy = policy;
 		}
 
 		//************************************
@@ -227,9 +672,17 @@ namespace FreshCask
 		//************************************
 		size_t PairCount() const
 		{
+			LockGuard lock(keydirMutex);
 			return hashTree.size();
 		}
 
+		// memory the keydir takes, estimated from its size: a tree node and its entry per key,
+		// longer keys take a heap buffer on top which isn't counted
+		uint64_t GetKeydirMemory() const
+		{
+			return PairCount() * (sizeof(HashFile::HashTree::value_type) + KeydirNodeOverhead);
+		}
+
 		//************************************
 		// Method:    CotainsKey
 		// FullName:  FreshCask::BucketManager::CotainsKey
@@ -240,31 +693,620 @@ namespace FreshCask
 		//************************************
 		bool CotainsKey(const SmartByteArray& Key)
 		{
+			LockGuard lock(keydirMutex);
 			return hashTree.find(Key) != hashTree.end();
 		}
 
+		//************************************
+		// Method:    CotainsKey
+		// FullName:  FreshCask::BucketManager::CotainsKey
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Test if each of keys exists, probing the keydir as a batch
+		// Parameter: const std::vector<SmartByteArray> & keys
+		// Parameter: std::vector<bool> & out
+		//************************************
+		void CotainsKey(const std::vector<SmartByteArray>& keys, std::vector<bool> &out)
+		{
+			std::vector<HashFile::Record> hashRecs;
+			lookupBatch(keys, hashRecs, out);
+		}
+
 	private:
+		bool lookup(const SmartByteArray& key, HashFile::Record &hashRecOut)
+		{
+			LockGuard lock(keydirMutex);
+
+			uint64_t probes = HashFile::KeyLess::Probes();
+			HashFile::HashTree::iterator it = hashTree.find(key);
+			probes = HashFile::KeyLess::Probes() - probes;
+
+			keydirLookups.Add();
+			keydirProbes.Add((int64_t)probes);
+			if (probes > maxKeydirProbes.load(std::memory_order_relaxed))
+				maxKeydirProbes.store(probes, std::memory_order_relaxed); // keydirMutex is held
+
+			if (it == hashTree.end()) return false;
+			hashRecOut = it->second;
+			return true;
+		}
+
+		// lookup() for many keys under one hold of keydirMutex. Keys are probed in key order:
+		// successive descents share the upper levels of the tree while they are still cached, and
+		// a key shortly behind the previous one is reached by stepping forward from it instead.
+		// Nothing is prefetched: std::map hands out no child pointers to fetch a search path
+		// ahead, stepping forward is a chain of dependent loads, and the keys are warm from sorting.
+		void lookupBatch(const std::vector<SmartByteArray>& keys, std::vector<HashFile::Record> &hashRecsOut, std::vector<bool> &foundOut)
+		{
+			std::vector<size_t> order(keys.size());
+			for (size_t i = 0; i < order.size(); i++) order[i] = i;
+			std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return keys[lhs] < keys[rhs]; });
+
+			hashRecsOut.resize(keys.size());
+			foundOut.assign(keys.size(), false);
+
+			LockGuard lock(keydirMutex);
+
+			HashFile::HashTree::key_compare less = hashTree.key_comp();
+			HashFile::HashTree::iterator it = hashTree.end();
+			for (size_t j = 0; j < order.size(); j++)
+			{
+				const SmartByteArray &key = keys[order[j]];
+				uint64_t probes = HashFile::KeyLess::Probes();
+
+				bool stepped = it != hashTree.end();
+				for (uint32_t steps = 0; it != hashTree.end() && less(it->first, key); ++it)
+				{
+					if (++steps > KeydirFingerSteps) { stepped = false; break; }
+				}
+				if (!stepped) it = hashTree.lower_bound(key);
+
+				probes = HashFile::KeyLess::Probes() - probes;
+				keydirLookups.Add();
+				keydirProbes.Add((int64_t)probes);
+				if (probes > maxKeydirProbes.load(std::memory_order_relaxed))
+					maxKeydirProbes.store(probes, std::memory_order_relaxed); // keydirMutex is held
+
+				if (it != hashTree.end() && !less(key, it->first))
+				{
+					hashRecsOut[order[j]] = it->second;
+					foundOut[order[j]] = true;
+				}
+			}
+		}
+
 		//************************************
-		// Method:    listKey
-		// FullName:  FreshCask::BucketManager::listKey
+		// Method:    readValue
+		// FullName:  FreshCask::BucketManager::readValue
 		// Access:    private 
 		// Returns:   Status
-		// Qualifier: Internal implement of ListKey.
-		// Parameter: const InternalEnumeratorType & func
+		// Desc:      Read a value that missed the cache from its data file and cache it
+		// Parameter: const SmartByteArray & key
+		// Parameter: HashFile::Record hashRec, as looked up
+		// Parameter: SmartByteArray & out
+		// Parameter: bool fillCache, false leaves the cache alone
+		// Parameter: IOClass::Type ioClass
 		//************************************
-		Status listKey(const InternalEnumeratorType& func)
+		Status readValue(const SmartByteArray& key, HashFile::Record hashRec, SmartByteArray &out, bool fillCache = true, IOClass::Type ioClass = IOClass::UserRead)
 		{
-			for (auto& item : hashTree)
-				RET_IFNOT_OK(func(item.first), "BucketManager::listKeys()");
+			Status ret = engine->ReadValue(hashRec, out, ioClass);
+			if (ret.IsNotFound())
+			{
+				// the file was merged away after the lookup, hash tree already points to the copy
+				if (!lookup(key, hashRec))
+					RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "BucketManager::readValue()");
+				ret = engine->ReadValue(hashRec, out, ioClass);
+			}
+			RET_IFNOT_OK(ret, "BucketManager::readValue()");
+			if (!fillCache) RET_BY_SENDER(Status::OK(), "BucketManager::readValue()");
+			RET_BY_SENDER(cacheIfCurrent(key, hashRec, out), "BucketManager::readValue()");
+		}
+
+		// values of keys at hashRecs for MultiGet(), those whose statuses are set already are
+		// skipped. Cache misses are read in data file order, values lying close together with
+		// a single read, and the reads are run in parallel. A scan passes fillCache false so
+		// that it doesn't push the working set out of the cache, and reads as background I/O
+		// so that a long export doesn't hold merges back.
+		void readValues(const std::vector<SmartByteArray>& keys, const std::vector<HashFile::Record> &hashRecs, std::vector<SmartByteArray> &values, std::vector<Status> &statuses,
+			bool fillCache = true, IOClass::Type ioClass = IOClass::UserRead)
+		{
+			std::vector<size_t> misses;
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				if (statuses[i].IsOK() && !cache->Get(keys[i], values[i], cacheSpace).IsOK())
+					misses.push_back(i);
+			}
+
+			std::sort(misses.begin(), misses.end(), [&](size_t lhs, size_t rhs) {
+				return hashRecs[lhs].DataFileId != hashRecs[rhs].DataFileId ? hashRecs[lhs].DataFileId < hashRecs[rhs].DataFileId
+					: hashRecs[lhs].OffsetOfValue < hashRecs[rhs].OffsetOfValue;
+			});
+
+			// values of a file no more than MultiGetReadGap apart are read as one span
+			std::vector<ReadRun> runs;
+			for (size_t m = 0; m < misses.size(); m++)
+			{
+				const HashFile::Record &hashRec = hashRecs[misses[m]];
+				uint64_t end = (uint64_t)hashRec.OffsetOfValue + hashRec.SizeOfValue;
+				if (!runs.empty())
+				{
+					ReadRun &run = runs.back();
+					uint64_t runEnd = (uint64_t)run.Span.OffsetOfValue + run.Span.SizeOfValue;
+					if (hashRec.DataFileId == run.Span.DataFileId && hashRec.OffsetOfValue <= runEnd + MultiGetReadGap
+						&& std::max(end, runEnd) - run.Span.OffsetOfValue <= MultiGetMaxRead)
+					{
+						run.Span.SizeOfValue = (uint32_t)(std::max(end, runEnd) - run.Span.OffsetOfValue);
+						run.End = m + 1;
+						continue;
+					}
+				}
+
+				ReadRun run;
+				run.Span = hashRec;
+				run.Begin = m, run.End = m + 1;
+				runs.push_back(run);
+			}
+
+			// helpers run on the shared scheduler, runs none of them got to are read here
+			std::atomic<size_t> nextRun(0);
+			auto work = [&]() {
+				for (size_t r; (r = nextRun.fetch_add(1)) < runs.size(); )
+					readRun(runs[r], keys, hashRecs, misses, values, statuses, fillCache, ioClass);
+			};
+
+			TaskGroup helpers;
+			for (size_t i = 1; i < std::min<size_t>(runs.size(), MultiGetParallelReads); i++)
+				context.GetTaskScheduler().Submit(work, TaskPriority::Foreground, &helpers);
+			work();
+			helpers.Cancel(); // not started by now, nothing is left for them
+			helpers.Wait();
+		}
 
-			RET_BY_SENDER(Status::OK(), "BucketManager::listKeys()");
+		// pairs with keys after `after` (all of them if it's Null) in key order for Cursor, at
+		// most maxKeys of them and about CursorPageBytes. lastOut is the last key looked at, pairs
+		// deleted meanwhile are left out. more tells if any keys follow.
+		Status getRange(const SmartByteArray &after, uint32_t maxKeys, std::vector<SmartByteArray> &keys, std::vector<SmartByteArray> &values, SmartByteArray &lastOut, bool &more)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "BucketManager::getRange()");
+
+			std::vector<HashFile::Record> hashRecs;
+			keys.clear();
+			{
+				LockGuard lock(keydirMutex);
+
+				HashFile::HashTree::iterator it = after.IsNull() ? hashTree.begin() : hashTree.upper_bound(after);
+				for (uint64_t bytes = 0; it != hashTree.end() && keys.size() < maxKeys && bytes < CursorPageBytes; ++it)
+				{
+					keys.push_back(it->first);
+					hashRecs.push_back(it->second);
+					bytes += it->first.Size() + it->second.SizeOfValue;
+				}
+				more = it != hashTree.end();
+			}
+			lastOut = keys.empty() ? after : keys.back();
+
+			std::vector<Status> statuses(keys.size());
+			values.assign(keys.size(), SmartByteArray::Null());
+			readValues(keys, hashRecs, values, statuses, false, IOClass::BackgroundRead);
+
+			size_t kept = 0;
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				if (statuses[i].IsNotFound()) continue;
+				RET_IFNOT_OK(statuses[i], "BucketManager::getRange()");
+
+				keys[kept] = keys[i], values[kept] = values[i];
+				kept++;
+			}
+			keys.resize(kept), values.resize(kept);
+			RET_BY_SENDER(Status::OK(), "BucketManager::getRange()");
+		}
+
+		// bytes of bar kept past the call that got it: a copy of a borrowed or pinned buffer
+		// would still point into memory its lender frees
+		static SmartByteArray ownCopy(const SmartByteArray &bar)
+		{
+			return SmartByteArray::Copy(bar.Data(), bar.Size());
+		}
+
+		// hash tree still points at the value of hashRec, or at the copy a merge made of it in
+		// a file not in fileIds (sorted): a copy keeps sequence, time stamp and size, a new
+		// write gets a new sequence
+		bool isCurrentOrMoved(const SmartByteArray& key, const HashFile::Record &hashRec, const std::vector<uint32_t> &fileIds)
+		{
+			LockGuard lock(keydirMutex);
+			HashFile::HashTree::iterator it = hashTree.find(key);
+			if (it == hashTree.end()) return false;
+			if (it->second.DataFileId == hashRec.DataFileId) return it->second.OffsetOfValue == hashRec.OffsetOfValue;
+
+			return !std::binary_search(fileIds.begin(), fileIds.end(), it->second.DataFileId) && it->second.Sequence == hashRec.Sequence &&
+				it->second.TimeStamp == hashRec.TimeStamp && it->second.SizeOfValue == hashRec.SizeOfValue;
+		}
+
+		// don't cache a value that the writer has superseded in the meantime
+		Status cacheIfCurrent(const SmartByteArray& key, const HashFile::Record &hashRec, const SmartByteArray &value)
+		{
+			LockGuard lock(keydirMutex);
+			HashFile::HashTree::iterator it = hashTree.find(key);
+			if (it != hashTree.end() && it->second.DataFileId == hashRec.DataFileId && it->second.OffsetOfValue == hashRec.OffsetOfValue)
+				RET_BY_SENDER(cache->Put(key, value, cacheSpace), "BucketManager::cacheIfCurrent()");
+			RET_BY_SENDER(Status::OK(), "BucketManager::cacheIfCurrent()");
+		}
+
+		// values of MultiGet() read at once: misses[Begin, End) lie within Span of one file
+		struct ReadRun
+		{
+			HashFile::Record Span;
+			size_t Begin, End;
+		};
+
+		void readRun(const ReadRun &run, const std::vector<SmartByteArray>& keys, const std::vector<HashFile::Record> &hashRecs, const std::vector<size_t> &misses,
+			std::vector<SmartByteArray> &values, std::vector<Status> &statuses, bool fillCache, IOClass::Type ioClass)
+		{
+			SmartByteArray buffer;
+			bool spanRead = run.End - run.Begin > 1 && engine->ReadValue(run.Span, buffer, ioClass).IsOK();
+
+			for (size_t m = run.Begin; m < run.End; m++)
+			{
+				size_t i = misses[m];
+				if (spanRead)
+				{
+					values[i] = buffer.Slice(hashRecs[i].OffsetOfValue - run.Span.OffsetOfValue, hashRecs[i].SizeOfValue);
+					statuses[i] = fillCache ? cacheIfCurrent(keys[i], hashRecs[i], values[i]) : Status::OK();
+				}
+				else
+					statuses[i] = readValue(keys[i], hashRecs[i], values[i], fillCache, ioClass); // also if the file was merged away meanwhile
+			}
+		}
+
+		//************************************
+		// Method:    mergeFiles
+		// FullName:  FreshCask::BucketManager::mergeFiles
+		// Access:    private 
+		// Returns:   Status
+		// Qualifier: Internal implement of Merge, mergeMutex must be held.
+		// Parameter: const std::vector<uint32_t> & fileIds
+		//************************************
+		Status mergeFiles(const std::vector<uint32_t>& fileIds)
+		{
+			if (fileIds.empty())
+				RET_BY_SENDER(Status::OK(), "BucketManager::mergeFiles()");
+
+			// records written meanwhile are newer than any in fileIds
+			uint64_t oldestOutside;
+			RET_IFNOT_OK(engine->GetOldestSequence(fileIds, oldestOutside), "BucketManager::mergeFiles()");
+
+			// a value is live while hash tree points at it; a deletion is kept as long as
+			// the key is absent and a file not merged may hold an older value of it
+			std::vector<StorageEngine::Relocation> relocations;
+			RET_IFNOT_OK(engine->MergeFiles(fileIds, [this, oldestOutside](const SmartByteArray& key, const HashFile::Record& hashRec) -> bool {
+				LockGuard lock(keydirMutex);
+
+				HashFile::HashTree::iterator it = hashTree.find(key);
+				if (hashRec.SizeOfValue == 0) return it == hashTree.end() && hashRec.Sequence >= oldestOutside;
+				return it != hashTree.end() && it->second.DataFileId == hashRec.DataFileId && it->second.OffsetOfValue == hashRec.OffsetOfValue;
+			}, relocations), "BucketManager::mergeFiles()");
+
+			{
+				// writers may have superseded a copied value meanwhile, that copy is just garbage;
+				// a copied deletion stays dead as it was
+				std::lock_guard<std::mutex> relocateLock(relocateMutex);
+				LockGuard lock(keydirMutex);
+				for (auto& item : relocations)
+				{
+					if (item.To.SizeOfValue == 0) continue;
+
+					uint32_t recordSize = DataFileEngine::GetRecordSize(item.Key.Size(), item.To.SizeOfValue);
+					HashFile::HashTree::iterator it = hashTree.find(item.Key);
+					if (it != hashTree.end() && it->second.DataFileId == item.From.DataFileId && it->second.OffsetOfValue == item.From.OffsetOfValue)
+					{
+						it->second = item.To;
+						addLiveBytes(item.To.DataFileId, recordSize);
+						addLiveBytes(item.From.DataFileId, -(int64_t)recordSize);
+					}
+				}
+			}
+
+			// hint file must stop referring to older files before they are removed
+			RET_IFNOT_OK(Flush(), "BucketManager::mergeFiles()");
+			RET_IFNOT_OK(engine->RetireFiles(fileIds), "BucketManager::mergeFiles()");
+
+			LockGuard lock(keydirMutex);
+			for (auto& fileId : fileIds)
+			{
+				std::map<uint32_t, uint64_t>::iterator it = liveBytes.find(fileId);
+				if (it == liveBytes.end()) continue;
+
+				totalLiveBytes -= it->second;
+				liveBytes.erase(it);
+			}
+			RET_BY_SENDER(Status::OK(), "BucketManager::mergeFiles()");
+		}
+
+		//************************************
+		// Method:    parkLanes
+		// FullName:  FreshCask::BucketManager::parkLanes
+		// Access:    private 
+		// Returns:   Status
+		// Qualifier: Park every lane, task runs on this thread while no record is appended.
+		// Parameter: const AsyncWriter::TaskType & task
+		//************************************
+		Status parkLanes(const AsyncWriter::TaskType& task)
+		{
+			// always in lane order, so two callers can't each hold a lane the other waits for
+			for (auto& writer : writers) writer->Park();
+			Status ret = task();
+			for (auto& writer : writers) writer->Unpark();
+			RET_BY_SENDER(ret, "BucketManager::parkLanes()");
+		}
+
+		//************************************
+		// Method:    publish
+		// FullName:  FreshCask::BucketManager::publish
+		// Access:    private 
+		// Returns:   void
+		// Qualifier: Called by a lane's writer once a batch is written.
+		// Parameter: const WriteBatch::Entry * entries
+		// Parameter: const HashFile::Record * hashRecs, one per entry
+		// Parameter: size_t count
+		//************************************
+		void publish(const WriteBatch::Entry* entries, const HashFile::Record* hashRecs, size_t count)
+		{
+			LockGuard lock(keydirMutex);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				// whatever the key had is dead now, the new record is live unless it is a
+				// deletion: those count as dead from the start, as after a reopen, so that
+				// nothing has to take them off again once the key is put back or merged
+				HashFile::HashTree::iterator it = hashTree.find(entries[i].Key);
+				if (it != hashTree.end())
+					addLiveBytes(it->second.DataFileId, -(int64_t)DataFileEngine::GetRecordSize(entries[i].Key.Size(), it->second.SizeOfValue));
+
+				if (entries[i].Value.Size() > 0)
+				{
+					addLiveBytes(hashRecs[i].DataFileId, DataFileEngine::GetRecordSize(entries[i].Key.Size(), hashRecs[i].SizeOfValue));
+					if (it != hashTree.end()) it->second = hashRecs[i];
+					else hashTree[entries[i].Key] = hashRecs[i];
+					cache->Put(entries[i].Key, entries[i].Value, cacheSpace);
+				}
+				else // delete
+				{
+					if (it != hashTree.end()) hashTree.erase(it);
+					cache->Delete(entries[i].Key, cacheSpace);
+				}
+			}
+		}
+
+		void addLiveBytes(uint32_t fileId, int64_t bytes)
+		{
+			liveBytes[fileId] += bytes;
+			totalLiveBytes.fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		Status admit()
+		{
+			RET_BY_SENDER(admission.Admit([this]() { return GetWritePressure(); }, [this]() { requestMaintenance(); }), "BucketManager::admit()");
+		}
+
+		//************************************
+		// Method:    submit
+		// FullName:  FreshCask::BucketManager::submit
+		// Access:    private 
+		// Returns:   void
+		// Qualifier: Queue batch on a lane without blocking. Writes that admission control
+		//            would stop are kept aside until a maintenance pass lets them go, nothing
+		//            waits for them, neither the caller nor a scheduler worker.
+		// Parameter: const WriteBatch & batch
+		// Parameter: const CompletionType & done
+		//************************************
+		void submit(const WriteBatch &batch, const CompletionType &done)
+		{
+			{
+				std::lock_guard<std::mutex> lock(heldMutex);
+				if (!heldWrites.empty()) // behind those held already, in order
+					return hold(batch, done, heldWrites.back().Since);
+			}
+
+			bool held = false;
+			Status ret = admission.TryAdmit(GetWritePressure(), [this]() { requestMaintenance(); }, held);
+			if (!ret.IsOK()) return done(ret);
+			if (!held) return laneWriter().Submit(batch, done);
+
+			std::lock_guard<std::mutex> lock(heldMutex);
+			hold(batch, done, std::chrono::steady_clock::now());
+		}
+
+		// heldMutex must be held, a pass is asked for so the write can't be forgotten
+		void hold(const WriteBatch &batch, const CompletionType &done, std::chrono::steady_clock::time_point since)
+		{
+			heldWrites.push_back(HeldWrite(batch, done, since));
+			requestMaintenance();
+		}
+
+		// send held writes on to the lanes once debt is below stop or they waited long enough,
+		// all of them if force
+		void releaseHeld(bool force)
+		{
+			std::deque<HeldWrite> released;
+			{
+				std::lock_guard<std::mutex> lock(heldMutex);
+				if (heldWrites.empty()) return;
+
+				std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(admission.GetLimits().MaxStallMs);
+				bool stopped = !force && admission.Stopped(GetWritePressure());
+				while (!heldWrites.empty() && (!stopped || heldWrites.front().Since <= deadline))
+				{
+					released.push_back(std::move(heldWrites.front()));
+					heldWrites.pop_front();
+				}
+				if (!heldWrites.empty()) requestMaintenance(); // still in debt, keep paying it off
+			}
+
+			for (auto& write : released)
+			{
+				admission.Released(write.Since);
+				laneWriter().Submit(write.Batch, write.Done);
+			}
+		}
+
+		void requestMaintenance()
+		{
+			maintenanceRequested = true;
+			if (maintenanceScheduled.exchange(true)) return; // a pass is queued or running, it will see the request
+
+			if (!context.GetTaskScheduler().Submit([this]() { maintain(); }, TaskPriority::Background, &backgroundTasks).IsValid())
+				maintenanceScheduled = false; // closing
+		}
+
+		//************************************
+		// Method:    maintain
+		// FullName:  FreshCask::BucketManager::maintain
+		// Access:    private 
+		// Returns:   void
+		// Qualifier: Maintenance task: pays off whatever debt held writers back. Checkpoint
+		//            lag goes with a new hint file, dead bytes and files with a merge, or with
+		//            compaction if merge policy alone can't get below a stop threshold. One
+		//            pass at a time, another one follows if asked for meanwhile.
+		//************************************
+		void maintain()
+		{
+			do
+			{
+				maintenanceRequested = false;
+
+				// failures are left for the next pass, writers keep asking while in debt
+				AdmissionController::Limits limits = admission.GetLimits();
+				WritePressure pressure = GetWritePressure();
+				if (pressure.CheckpointLag >= limits.SlowdownCheckpointLag) Flush();
+				if (pressure.DeadBytes >= limits.SlowdownDeadBytes || pressure.FileCount >= limits.SlowdownFileCount)
+				{
+					Merge();
+					if (admission.Stopped(GetWritePressure())) Compact();
+				}
+
+				admission.Relieved();
+				releaseHeld(false);
+				maintenanceScheduled = false;
+			} while (maintenanceRequested && !maintenanceScheduled.exchange(true));
+		}
+
+		Status writeWarmFile()
+		{
+			std::vector<SmartByteArray> keys;
+			cache->GetHotKeys(keys, WarmFile::MaxKeys, cacheSpace);
+
+			// nothing cached yet, e.g. right after opening: keep the keys of last time
+			if (keys.empty())
+				RET_BY_SENDER(Status::OK(), "BucketManager::writeWarmFile()");
+			RET_BY_SENDER(WarmFileEngine::Write(bucketDir, keys), "BucketManager::writeWarmFile()");
+		}
+
+		//************************************
+		// Method:    warmUp
+		// FullName:  FreshCask::BucketManager::warmUp
+		// Access:    private 
+		// Returns:   void
+		// Qualifier: Warm-up thread: read the values of keys in data file order, so the disk
+		//            sees few long forward runs, then cache them coldest first so that the
+		//            hottest end up most recently used.
+		// Parameter: std::vector<SmartByteArray> keys, hottest first
+		//************************************
+		void warmUp(std::vector<SmartByteArray> keys)
+		{
+			std::vector<HashFile::Record> hashRecs(keys.size());
+			std::vector<size_t> order;
+			{
+				LockGuard lock(keydirMutex);
+				for (size_t i = 0; i < keys.size(); i++)
+				{
+					HashFile::HashTree::iterator it = hashTree.find(keys[i]);
+					if (it == hashTree.end() || it->second.SizeOfValue == 0) continue;
+
+					hashRecs[i] = it->second;
+					order.push_back(i);
+				}
+			}
+
+			std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+				return hashRecs[lhs].DataFileId != hashRecs[rhs].DataFileId ? hashRecs[lhs].DataFileId < hashRecs[rhs].DataFileId
+					: hashRecs[lhs].OffsetOfValue < hashRecs[rhs].OffsetOfValue;
+			});
+
+			std::vector<SmartByteArray> values(keys.size());
+			for (auto& i : order)
+			{
+				if (warmStopping) break;
+				if (!engine->ReadValue(hashRecs[i], values[i], IOClass::BackgroundRead).IsOK()) values[i] = SmartByteArray::Null(); // merged away meanwhile
+			}
+
+			for (size_t i = keys.size(); i-- > 0 && !warmStopping; )
+			{
+				if (values[i].Size() == 0) continue;
+
+				// same check as Get(), a value written meanwhile must not be overwritten
+				LockGuard lock(keydirMutex);
+				HashFile::HashTree::iterator it = hashTree.find(keys[i]);
+				if (it != hashTree.end() && it->second.DataFileId == hashRecs[i].DataFileId && it->second.OffsetOfValue == hashRecs[i].OffsetOfValue)
+					cache->Put(keys[i], values[i], cacheSpace);
+			}
+
+			warming = false;
+		}
+
+		//************************************
+		// Method:    laneWriter
+		// FullName:  FreshCask::BucketManager::laneWriter
+		// Access:    private 
+		// Returns:   AsyncWriter &
+		// Qualifier: Each calling thread sticks to one lane, threads are spread round-robin.
+		//************************************
+		AsyncWriter& laneWriter()
+		{
+			static std::atomic<uint32_t> nextTicket(0);
+			static thread_local uint32_t ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+			return *writers[ticket % writers.size()];
 		}
 
 	private:
 		std::string bucketDir;
 		HashFile::HashTree hashTree;
-		LRUCache cache;
+		mutable Mutex keydirMutex; // hash tree is written by lane writers, and by merges moving entries
+		std::shared_ptr<LRUCache> cache;
+		uint32_t cacheSpace;
 		std::shared_ptr<StorageEngine> engine;
+		std::vector<std::shared_ptr<AsyncWriter>> writers; // one per lane
+		uint32_t laneCount;
+
+		StatCounter keydirLookups, keydirProbes;
+		std::atomic<uint64_t> maxKeydirProbes;
+
+		std::mutex mergeMutex;
+		std::mutex relocateMutex; // a merge moves entries, Flush() dumps them: never at once
+		MergePolicy mergePolicy;
+		std::map<uint32_t, uint64_t> liveBytes; // per data file, guarded by keydirMutex
+		std::atomic<uint64_t> totalLiveBytes;
+
+		// an async write admission control stopped, see submit()
+		struct HeldWrite
+		{
+			WriteBatch Batch;
+			CompletionType Done;
+			std::chrono::steady_clock::time_point Since;
+
+			HeldWrite(const WriteBatch &Batch, const CompletionType &Done, std::chrono::steady_clock::time_point Since) : Batch(Batch), Done(Done), Since(Since) {}
+		};
+
+		AdmissionController admission;
+		std::atomic<bool> maintenanceRequested, maintenanceScheduled;
+		std::mutex heldMutex;
+		std::deque<HeldWrite> heldWrites; // oldest first
+
+		EngineContext &context;
+		TaskGroup asyncTasks;      // GetAsync() reads
+		TaskGroup backgroundTasks; // maintenance and warm-up
+		std::atomic<bool> warming, warmStopping;
 	}; 
 } // namespace FreshCask
 #endif // __CORE_BUCKETMANAGER_HPP__
\ No newline at end of file
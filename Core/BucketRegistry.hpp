@@ -0,0 +1,380 @@
+#ifndef __CORE_BUCKETREGISTRY_HPP__
+#define __CORE_BUCKETREGISTRY_HPP__
+
+#include <map>
+#include <mutex>
+#include <memory>
+
+#include <Core/BucketManager.hpp>
+
+namespace FreshCask
+{
+	// Many buckets kept as subdirectories of one root directory, such as one per tenant. The
+	// buckets share one cache, the file handle pool and threads of the context. A bucket is
+	// opened when first acquired and closed again once nobody holds it while too many are
+	// open or cache and keydirs together take more memory than allowed.
+	class BucketRegistry
+	{
+	public:
+		struct Options
+		{
+			uint64_t CacheBytes;     // one cache for all buckets
+			uint64_t MemoryLimit;    // cache plus keydirs of open buckets, 0 for no limit
+			uint32_t MaxOpenBuckets; // 0 for no limit
+			uint32_t MaxOpenFiles;   // data files of the context holding handles, active ones included, 0 for no limit
+			uint32_t WriteLanes;     // per bucket
+
+			Options() : CacheBytes(DefaultRegistryCacheBytes), MemoryLimit(0), MaxOpenBuckets(DefaultRegistryOpenBuckets),
+				MaxOpenFiles(DefaultRegistryOpenFiles), WriteLanes(DefaultRegistryWriteLanes) {}
+		};
+
+		// the bucket stays open while a handle to it is held, no handle may outlive the registry
+		typedef std::shared_ptr<BucketManager> BucketHandle;
+
+		struct Stats
+		{
+			uint32_t BucketCount, OpenBuckets, BucketsInUse;
+			uint64_t KeydirBytes; // of open buckets, estimated
+			LRUCache::Stats Cache;
+			FilePool::Stats Files;
+		};
+
+	private:
+		struct Entry
+		{
+			std::string Name;
+			std::mutex OpenMutex; // held while the bucket opens or closes
+			std::shared_ptr<BucketManager> Bucket; // null while closed, changed under both locks
+			uint32_t Users; // handles out
+			uint64_t LastUse;
+
+			Entry(const std::string &Name) : Name(Name), Users(0), LastUse(0) {}
+		};
+
+		typedef std::shared_ptr<Entry> EntryPtr;
+
+	public:
+		BucketRegistry(EngineContext &context = EngineContext::Default()) : context(context), nextSpace(1), clock(0) {}
+		~BucketRegistry() { if (IsOpen()) Close(); }
+
+		BucketRegistry(const BucketRegistry&) = delete;
+		BucketRegistry& operator=(const BucketRegistry&) = delete;
+
+		//************************************
+		// Method:    Open
+		// FullName:  FreshCask::BucketRegistry::Open
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Find the buckets under rootDir, created if missing. No bucket is opened yet.
+		// Parameter: const std::string & _rootDir
+		// Parameter: const Options & _options
+		//************************************
+		Status Open(const std::string &_rootDir, const Options &_options = Options())
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cache != nullptr)
+				RET_BY_SENDER(Status::InvalidArgument("Registry already open"), "BucketRegistry::Open()");
+
+			if (!IsDirExist(_rootDir))
+				RET_IFNOT_OK(MakeDir(_rootDir), "BucketRegistry::Open()");
+
+			RET_IFNOT_OK(ListSubDirs(_rootDir, [&](const std::string &name) -> Status {
+				entries[name] = EntryPtr(new Entry(name));
+				RET_BY_SENDER(Status::OK(), "BucketRegistry::Open()::ProcessDir()");
+			}), "BucketRegistry::Open()");
+
+			rootDir = _rootDir;
+			options = _options;
+			cache = std::make_shared<LRUCache>(options.CacheBytes);
+			context.GetFilePool().SetLimit(options.MaxOpenFiles);
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::Open()");
+		}
+
+		bool IsOpen()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return cache != nullptr;
+		}
+
+		//************************************
+		// Method:    Close
+		// FullName:  FreshCask::BucketRegistry::Close
+		// Access:    public
+		// Returns:   Status, InvalidArgument if a bucket is still held, which is left open
+		//************************************
+		Status Close()
+		{
+			std::vector<EntryPtr> all;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (cache == nullptr)
+					RET_BY_SENDER(Status::IOError("Registry not open"), "BucketRegistry::Close()");
+
+				for (auto& item : entries) all.push_back(item.second);
+			}
+
+			bool inUse = false;
+			for (auto& entry : all)
+			{
+				bool closed;
+				RET_IFNOT_OK(closeIdle(entry, closed), "BucketRegistry::Close()");
+				if (!closed) inUse = true;
+			}
+			if (inUse)
+				RET_BY_SENDER(Status::InvalidArgument("Bucket in use"), "BucketRegistry::Close()");
+
+			std::lock_guard<std::mutex> lock(mutex);
+			entries.clear();
+			cache.reset();
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::Close()");
+		}
+
+		// names of all buckets, sorted
+		Status List(std::vector<std::string> &out)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cache == nullptr)
+				RET_BY_SENDER(Status::IOError("Registry not open"), "BucketRegistry::List()");
+
+			for (auto& item : entries) out.push_back(item.first);
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::List()");
+		}
+
+		Status Create(const std::string &name)
+		{
+			RET_IFNOT_OK(checkName(name), "BucketRegistry::Create()");
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cache == nullptr)
+				RET_BY_SENDER(Status::IOError("Registry not open"), "BucketRegistry::Create()");
+			if (entries.count(name) > 0)
+				RET_BY_SENDER(Status::InvalidArgument("Bucket already exists"), "BucketRegistry::Create()");
+
+			RET_IFNOT_OK(MakeDir(pathOf(name)), "BucketRegistry::Create()");
+			entries[name] = EntryPtr(new Entry(name));
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::Create()");
+		}
+
+		//************************************
+		// Method:    Remove
+		// FullName:  FreshCask::BucketRegistry::Remove
+		// Access:    public
+		// Returns:   Status, InvalidArgument if the bucket is held
+		// Desc:      Close the bucket and delete it from disk
+		// Parameter: const std::string & name
+		//************************************
+		Status Remove(const std::string &name)
+		{
+			EntryPtr entry;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (cache == nullptr)
+					RET_BY_SENDER(Status::IOError("Registry not open"), "BucketRegistry::Remove()");
+
+				auto it = entries.find(name);
+				if (it == entries.end())
+					RET_BY_SENDER(Status::NotFound("Bucket doesn't exist"), "BucketRegistry::Remove()");
+				if (it->second->Users > 0)
+					RET_BY_SENDER(Status::InvalidArgument("Bucket in use"), "BucketRegistry::Remove()");
+
+				entry = it->second;
+				entries.erase(it); // can't be acquired any more
+			}
+
+			std::lock_guard<std::mutex> openLock(entry->OpenMutex);
+			if (entry->Bucket != nullptr)
+			{
+				RET_IFNOT_OK(entry->Bucket->Close(false), "BucketRegistry::Remove()");
+
+				std::lock_guard<std::mutex> lock(mutex);
+				entry->Bucket.reset();
+			}
+			RET_BY_SENDER(RemoveDir(pathOf(name)), "BucketRegistry::Remove()");
+		}
+
+		//************************************
+		// Method:    Acquire
+		// FullName:  FreshCask::BucketRegistry::Acquire
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Hand out a bucket, opened first if it isn't. Idle buckets may be closed
+		//            to stay within the limits.
+		// Parameter: const std::string & name
+		// Parameter: BucketHandle & out
+		//************************************
+		Status Acquire(const std::string &name, BucketHandle &out)
+		{
+			EntryPtr entry;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (cache == nullptr)
+					RET_BY_SENDER(Status::IOError("Registry not open"), "BucketRegistry::Acquire()");
+
+				auto it = entries.find(name);
+				if (it == entries.end())
+					RET_BY_SENDER(Status::NotFound("Bucket doesn't exist"), "BucketRegistry::Acquire()");
+
+				entry = it->second;
+				entry->Users++; // no closing it from now on
+				entry->LastUse = ++clock;
+			}
+
+			bool opened = false;
+			Status ret = Status::OK();
+			{
+				std::lock_guard<std::mutex> openLock(entry->OpenMutex);
+				if (entry->Bucket == nullptr)
+				{
+					std::shared_ptr<BucketManager> bucket(new BucketManager(context));
+					bucket->ShareCache(cache, nextCacheSpace());
+					ret = bucket->Open(pathOf(name), options.WriteLanes);
+					if (ret.IsOK())
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						entry->Bucket = bucket;
+						opened = true;
+					}
+				}
+			}
+			if (!ret.IsOK())
+			{
+				release(entry);
+				RET_BY_SENDER(ret, "BucketRegistry::Acquire()");
+			}
+
+			// the handle owns nothing, letting go of it just counts the user off
+			BucketManager *bucket = entry->Bucket.get();
+			out = BucketHandle(std::shared_ptr<void>(nullptr, [this, entry](void*) { release(entry); }), bucket);
+
+			if (opened) RET_IFNOT_OK(shrink(0), "BucketRegistry::Acquire()");
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::Acquire()");
+		}
+
+		//************************************
+		// Method:    CloseIdle
+		// FullName:  FreshCask::BucketRegistry::CloseIdle
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Close buckets nobody holds, least recently used first, until no more
+		//            than keep buckets are open
+		// Parameter: uint32_t keep
+		//************************************
+		Status CloseIdle(uint32_t keep = 0)
+		{
+			RET_BY_SENDER(shrink(keep, true), "BucketRegistry::CloseIdle()");
+		}
+
+		Stats GetStats()
+		{
+			Stats stats;
+			stats.BucketCount = stats.OpenBuckets = stats.BucketsInUse = 0;
+			stats.KeydirBytes = 0;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (auto& item : entries)
+				{
+					stats.BucketCount++;
+					if (item.second->Users > 0) stats.BucketsInUse++;
+					if (item.second->Bucket == nullptr) continue;
+
+					stats.OpenBuckets++;
+					stats.KeydirBytes += item.second->Bucket->GetKeydirMemory();
+				}
+				stats.Cache = cache != nullptr ? cache->GetStats() : LRUCache::Stats();
+			}
+			stats.Files = context.GetFilePool().GetStats();
+			return stats;
+		}
+
+	private:
+		void release(const EntryPtr &entry)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			entry->Users--;
+			entry->LastUse = ++clock;
+		}
+
+		// close the least recently used idle buckets while over a limit, with force until
+		// at most keep buckets are open
+		Status shrink(uint32_t keep, bool force = false)
+		{
+			while (true)
+			{
+				EntryPtr victim;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (cache == nullptr) break;
+
+					uint32_t openCount = 0;
+					uint64_t memory = cache->GetMemory();
+					for (auto& item : entries)
+					{
+						Entry &entry = *item.second;
+						if (entry.Bucket == nullptr) continue;
+
+						openCount++;
+						memory += entry.Bucket->GetKeydirMemory();
+						if (entry.Users == 0 && (victim == nullptr || entry.LastUse < victim->LastUse)) victim = item.second;
+					}
+
+					bool over = (options.MaxOpenBuckets > 0 && openCount > options.MaxOpenBuckets)
+						|| (options.MemoryLimit > 0 && memory > options.MemoryLimit)
+						|| (force && openCount > keep);
+					if (!over || victim == nullptr) break; // within limits, or everything open is held
+				}
+
+				bool closed;
+				RET_IFNOT_OK(closeIdle(victim, closed), "BucketRegistry::shrink()");
+			}
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::shrink()");
+		}
+
+		// close entry's bucket unless somebody acquired it meanwhile
+		Status closeIdle(const EntryPtr &entry, bool &closed)
+		{
+			std::lock_guard<std::mutex> openLock(entry->OpenMutex);
+
+			std::shared_ptr<BucketManager> bucket;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				closed = entry->Users == 0;
+				if (!closed || entry->Bucket == nullptr) RET_BY_SENDER(Status::OK(), "BucketRegistry::closeIdle()");
+
+				bucket = entry->Bucket;
+				entry->Bucket.reset(); // an acquirer waits for OpenMutex and opens it again
+			}
+			RET_BY_SENDER(bucket->Close(), "BucketRegistry::closeIdle()");
+		}
+
+		// a space per open, what a closed bucket left in the cache is never looked up again
+		// and eviction takes it back in time, no need to walk the whole cache for it
+		uint32_t nextCacheSpace()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (nextSpace == 0) nextSpace = 1; // wrapped around, 0 is a private cache's
+			return nextSpace++;
+		}
+
+		std::string pathOf(const std::string &name) { return rootDir + "\\" + name; }
+
+		static Status checkName(const std::string &name)
+		{
+			if (name.empty() || name == "." || name == ".." || name.find_first_of("\\/:*?\"<>|") != std::string::npos)
+				RET_BY_SENDER(Status::InvalidArgument("Invalid bucket name"), "BucketRegistry::checkName()");
+			RET_BY_SENDER(Status::OK(), "BucketRegistry::checkName()");
+		}
+
+	private:
+		EngineContext &context;
+		std::string rootDir;
+		Options options;
+		std::shared_ptr<LRUCache> cache; // null while closed
+
+		std::mutex mutex; // guards entries and what they hold but OpenMutex does
+		std::map<std::string, EntryPtr> entries;
+		uint32_t nextSpace; // cache space of the next bucket opened
+		uint64_t clock;     // for LastUse
+	};
+} // namespace FreshCask
+
+#endif // __CORE_BUCKETREGISTRY_HPP__
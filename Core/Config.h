@@ -6,15 +6,75 @@
 namespace FreshCask 
 {
 	const uint32_t CurrentMajorVersion = 1;
-	const uint32_t CurrentMinorVersion = 0;
+	const uint32_t CurrentMinorVersion = 2; // 1.1: batch frames in data files, checkpoint in hint file
+	                                        // 1.2: sequence numbers, one active data file per write lane
 
 	const bool EnableStatusTrackback = false;
-	const uint32_t DefaultLRUCacheSize = 100;
+	const uint64_t DefaultLRUCacheBytes = 8 << 20; // keys, values and per-entry overhead
+	const uint32_t DefaultLRUCacheShards = 16; // each with its own lock
+	// DefaultCachePolicy is next to CachePolicy::Type, which isn't declared yet here
+
+	// cache item memory, see SlabAllocator
+	const uint32_t SlabPageSize = 256 << 10; // larger items aren't cached
+	const uint32_t SlabMinChunkSize = 64;
+	const double SlabGrowthFactor = 1.25; // chunk size of one class to the next
+	const uint32_t SlabSparePages = 8; // over cache capacity, so every busy class gets a page
+	const uint32_t DefaultWriteLanes = 4; // active data files per bucket, appended to in parallel
+	const uint32_t WriterDrainRequests = 256; // appended by a lane's drain task before it gives its worker back
+	const uint32_t DefaultEngineThreads = 0; // background threads shared by all buckets, 0 for one per core
+	const uint32_t DefaultLockSpins = 64; // tries of a briefly held lock before a thread blocks on it, see AdaptiveSpin
+	const uint32_t KeydirNodeOverhead = 32; // bytes of a tree node besides its entry, see GetKeydirMemory
+
+	// buckets of a BucketRegistry, see BucketRegistry::Options
+	const uint64_t DefaultRegistryCacheBytes = 256 << 20; // shared by all of them
+	const uint32_t DefaultRegistryOpenBuckets = 256;
+	const uint32_t DefaultRegistryOpenFiles = 4096; // data files holding handles, active files of the open buckets included
+	const uint32_t DefaultRegistryWriteLanes = 1; // tenants are many and mostly small
+
+	// batched keydir probes, of BucketManager::MultiGet for instance
+	const uint32_t KeydirFingerSteps = 8; // entries stepped over from the previous key before descending anew
+
+	// reads of BucketManager::MultiGet
+	const uint32_t MultiGetReadGap = 4 << 10; // values at most this far apart in a file are read at once
+	const uint32_t MultiGetMaxRead = 1 << 20; // bytes of one such read
+	const uint32_t MultiGetParallelReads = 8;
+
+	// pages of a Cursor, one is walked while the next is read ahead
+	const uint32_t CursorPageKeys = 1024;
+	const uint32_t CursorPageBytes = 4 << 20; // keys and values of one page, about
+
+	// partitions of a PartitionedBucket, see PartitionedBucket::Open
+	const uint32_t DefaultPartitions = 8;
+	const uint32_t DefaultPartitionLanes = 1; // partitions already write in parallel
+	const std::string PartitionDirPrefix = "part-"; // part-0, part-1, ...
+
+	const double DefaultMergeDeadRatio = 0.5; // merge an older file once half of it is dead
+	const double DefaultMaxSpaceAmplification = 2.0; // or once data files take twice the live size
+	const uint32_t DefaultMergeThreads = 4; // input files merged in parallel
+
+	// background I/O, see IOScheduler. 0 bytes per second means unlimited
+	const uint64_t DefaultMergeBytesPerSecond = 128 << 20;
+	const uint64_t DefaultCheckpointBytesPerSecond = 0; // hint file is dumped while lanes are parked
+	const uint64_t DefaultRecoveryBytesPerSecond = 0; // nobody to yield to while opening
+	const uint64_t DefaultBackgroundReadBytesPerSecond = 64 << 20;
+	const uint64_t DefaultBackgroundBurstBytes = 8 << 20;
+	const uint32_t DefaultBackgroundMaxDeferMs = 20; // longest wait of background I/O for user reads
+
+	// write admission, see AdmissionController
+	const uint64_t DefaultSlowdownDeadBytes = 4ull << 30, DefaultStopDeadBytes = 16ull << 30;
+	const uint32_t DefaultSlowdownFileCount = 32, DefaultStopFileCount = 64;
+	const uint64_t DefaultSlowdownCheckpointLag = 256 << 20, DefaultStopCheckpointLag = 1 << 30;
+	const uint32_t DefaultMaxWriteDelayUs = 1000;
+	const uint32_t DefaultMaxStallMs = 1000;
 
 	namespace DataFile 
 	{
 		const uint32_t DefaultMagicNumber = 0x46444346; // FCDF (FreshCask Data File)
 		const uint32_t MaxFileSize = (uint32_t)(1024 << 20); // 1 GB
+		const uint32_t BatchFrameMarker = 0xFFFFFFFF; // SizeOfKey of a batch frame record
+
+		const uint32_t ScanBufferSize = 4 << 20; // read at once by recovery and merge
+		const uint32_t MergeWriteBufferSize = 4 << 20; // written at once to a merged file
 
 		const std::string FileNameSuffix = ".fcdf";
 	} // namespace DataFile
@@ -28,6 +88,14 @@ namespace FreshCask
 	{
 		const uint32_t DefaultMagicNumber = 0x54484346; // FCHT (FreshCask Hint File)
 		const std::string FileNameSuffix = ".fcht";
+		const std::string TempFileNameSuffix = ".tmp"; // appended while a hint file is being written
+	}
+
+	namespace WarmFile
+	{
+		const uint32_t DefaultMagicNumber = 0x4B574346; // FCWK (FreshCask Warm-up File)
+		const std::string FileNameSuffix = ".fcwk";
+		const uint32_t MaxKeys = 1 << 20; // of the cache written out at most
 	}
 
 } // namespace FreshCask
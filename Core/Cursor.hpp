@@ -0,0 +1,149 @@
+#ifndef __CORE_CURSOR_HPP__
+#define __CORE_CURSOR_HPP__
+
+#include <Core/BucketManager.hpp>
+
+namespace FreshCask
+{
+	// Walks the <key, value> pairs of a bucket in key order a page at a time, so memory stays
+	// bounded by two pages however large the bucket is: the page being walked, and the one after
+	// it which is read ahead on the engine's scheduler meanwhile. Position() handed to Seek() of
+	// another cursor, even one made after the bucket was reopened, resumes right after the pair
+	// it was taken at, so a long export can be paginated. Pairs written while walking may or may
+	// not be seen. Values are read as background I/O and not cached, so an export neither starves
+	// merges nor evicts the working set. The bucket must stay open while the cursor is used and
+	// outlive it.
+	//
+	//     Cursor cursor(bucket);
+	//     for (cursor.Seek(); cursor.Valid(); cursor.Next()) use(cursor.Key(), cursor.Value());
+	//     if (!cursor.GetStatus().IsOK()) ...
+	class Cursor
+	{
+	public:
+		Cursor(BucketManager &bucket, uint32_t pageKeys = CursorPageKeys) : bucket(bucket), pageKeys(pageKeys > 0 ? pageKeys : 1), index(0), aheadPending(false) {}
+		~Cursor() { stopReadAhead(); }
+
+		Cursor(const Cursor&) = delete;
+		Cursor& operator=(const Cursor&) = delete;
+
+		//************************************
+		// Method:    Seek
+		// FullName:  FreshCask::Cursor::Seek
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Move to the first pair with a key after position, to the very first pair
+		//            if position is Null
+		// Parameter: const SmartByteArray & position, as given by Position()
+		//************************************
+		Status Seek(const SmartByteArray &position = SmartByteArray::Null())
+		{
+			stopReadAhead();
+
+			current = Page();
+			current.Last = position;
+			index = 0;
+			status = Status::OK();
+			RET_BY_SENDER(fill(), "Cursor::Seek()");
+		}
+
+		//************************************
+		// Method:    Next
+		// FullName:  FreshCask::Cursor::Next
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Move to the next pair, Valid() tells if there is one
+		//************************************
+		Status Next()
+		{
+			if (!Valid())
+				RET_BY_SENDER(status.IsOK() ? Status::NotFound("Cursor::Next()", "Past the last pair") : status, "Cursor::Next()");
+
+			index++;
+			RET_BY_SENDER(fill(), "Cursor::Next()");
+		}
+
+		bool Valid() const { return status.IsOK() && index < current.Keys.size(); }
+
+		// of the pair the cursor is at, only while Valid()
+		const SmartByteArray& Key() const { return current.Keys[index]; }
+		const SmartByteArray& Value() const { return current.Values[index]; }
+
+		// where to resume after the current pair, or after the last key looked at once the
+		// cursor went past the last pair
+		SmartByteArray Position() const { return Valid() ? Key() : current.Last; }
+
+		// of the last Seek() or Next() that failed, the cursor is not Valid() then
+		Status GetStatus() const { return status; }
+
+	private:
+		struct Page
+		{
+			std::vector<SmartByteArray> Keys, Values;
+			SmartByteArray Last; // key the page ends at, the next one starts after it
+			bool More;
+			Status Result;
+
+			Page() : More(true) {}
+		};
+
+		// move on through the pages after the current one once it is used up, a page may come
+		// out empty if all of its pairs were deleted since
+		Status fill()
+		{
+			while (index >= current.Keys.size() && current.More)
+			{
+				if (aheadPending)
+				{
+					readAheads.Wait();
+					aheadPending = false;
+					current = std::move(ahead);
+				}
+				else load(current, SmartByteArray(current.Last));
+
+				index = 0;
+				if (!current.Result.IsOK())
+				{
+					status = current.Result;
+					RET_BY_SENDER(status, "Cursor::fill()");
+				}
+				readAhead();
+			}
+			RET_BY_SENDER(Status::OK(), "Cursor::fill()");
+		}
+
+		void load(Page &page, const SmartByteArray &after)
+		{
+			page.Result = bucket.getRange(after, pageKeys, page.Keys, page.Values, page.Last, page.More);
+		}
+
+		// the page after the current one, loaded by fill() itself if the scheduler refuses
+		void readAhead()
+		{
+			if (!current.More) return;
+
+			SmartByteArray after = current.Last;
+			aheadPending = bucket.context.GetTaskScheduler().Submit([this, after]() { load(ahead, after); }, TaskPriority::Foreground, &readAheads).IsValid();
+		}
+
+		void stopReadAhead()
+		{
+			readAheads.Cancel();
+			readAheads.Wait();
+			readAheads.Reset();
+			aheadPending = false;
+		}
+
+	private:
+		BucketManager &bucket;
+		uint32_t pageKeys;
+
+		Page current, ahead;
+		size_t index;
+		Status status;
+
+		TaskGroup readAheads;
+		bool aheadPending;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_CURSOR_HPP__
@@ -9,6 +9,7 @@ namespace FreshCask
 		{
 			OlderFile = 0x1,
 			ActiveFile = 0x2,
+			MergedFile = 0x4, // written by merge, holds copies of records from older files
 		};
 
 		struct Header
@@ -21,16 +22,24 @@ namespace FreshCask
 			uint16_t Reserved;
 		};
 
+		// Since 1.2 the CRC32 in front of a record covers the key and value (or batch payload)
+		// first and the header last, so the body can be checksummed before the writer lane
+		// assigns the sequence number. Files before 1.2 stop at Reserved and checksum the
+		// header first, see LegacyRecordHeaderSize.
 		struct RecordHeader
 		{
 			uint32_t TimeStamp;
 			uint32_t SizeOfKey;
 			uint32_t SizeOfValue;
+			uint32_t Reserved;
+			uint64_t Sequence; // orders writes to the same key across active files
 
-			RecordHeader() : TimeStamp(0), SizeOfKey(-1), SizeOfValue(-1) {}
-			RecordHeader(uint32_t SizeOfKey, uint32_t SizeOfValue) : TimeStamp(-1), SizeOfKey(SizeOfKey), SizeOfValue(SizeOfValue) {}
+			RecordHeader() : TimeStamp(0), SizeOfKey(-1), SizeOfValue(-1), Reserved(0), Sequence(0) {}
+			RecordHeader(uint32_t SizeOfKey, uint32_t SizeOfValue) : TimeStamp(-1), SizeOfKey(SizeOfKey), SizeOfValue(SizeOfValue), Reserved(0), Sequence(0) {}
 		};
 
+		const uint32_t LegacyRecordHeaderSize = offsetof(RecordHeader, Reserved);
+
 		struct Record
 		{
 			uint32_t CRC32;
@@ -43,6 +52,20 @@ namespace FreshCask
 			uint32_t GetSize() { return sizeof(CRC32) + sizeof(Header) + Key.Size() + Value.Size(); }
 		};
 
+		// A batch frame is stored as a single record whose Header.SizeOfKey is BatchFrameMarker
+		// and Header.SizeOfValue is the size of the payload. The payload is laid out as:
+		//   uint32_t Count | Count * (BatchEntryHeader | Key | Value)
+		// The CRC32 covers the record header and the whole payload, so a frame is either
+		// applied as a whole or not at all. Entry i gets sequence Header.Sequence + i.
+		struct BatchEntryHeader
+		{
+			uint32_t SizeOfKey;
+			uint32_t SizeOfValue;
+
+			BatchEntryHeader() : SizeOfKey(-1), SizeOfValue(-1) {}
+			BatchEntryHeader(uint32_t SizeOfKey, uint32_t SizeOfValue) : SizeOfKey(SizeOfKey), SizeOfValue(SizeOfValue) {}
+		};
+
 		class CRC32
 		{
 		public:
@@ -50,38 +73,52 @@ namespace FreshCask
 
 			static CRCType Get(const SmartByteArray &bar)
 			{
-				CRCType crc = 0xFFFFFFFF;
-				uint32_t len = bar.Size();
-				BytePtr buffer = bar.Data();
+				return Get(bar.Data(), bar.Size());
+			}
 
+			static CRCType Get(const Byte *buffer, uint32_t len)
+			{
+				return Update(0xFFFFFFFF, buffer, len) ^ 0xFFFFFFFF;
+			}
+
+			// Incremental form: start with 0xFFFFFFFF and xor the result with 0xFFFFFFFF when done.
+			static CRCType Update(CRCType crc, const Byte *buffer, uint32_t len)
+			{
 				initTable();
 
 				while (len--)
 					crc = (crc >> 8) ^ CRCTable[(crc & 0xFF) ^ *buffer++];
 
-				return crc ^ 0xFFFFFFFF;
+				return crc;
 			}
 
-			static CRCType CalcDataFileRecord(DataFile::Record dfRec)
+			static CRCType CalcDataFileRecord(const DataFile::Record &dfRec)
 			{
-				SmartByteArray buffer(sizeof(DataFile::RecordHeader) + dfRec.Key.Size() + dfRec.Value.Size());
-				BytePtr ptr = buffer.Data();
+				return CalcDataFileRecord(dfRec.Header, dfRec.Key.Data(), dfRec.Value.Data());
+			}
 
-				memcpy(ptr, &dfRec.Header, sizeof(DataFile::RecordHeader));
-				memcpy(ptr + sizeof(DataFile::RecordHeader), dfRec.Key.Data(), dfRec.Key.Size());
-				memcpy(ptr + sizeof(DataFile::RecordHeader) + dfRec.Key.Size(), dfRec.Value.Data(), dfRec.Value.Size());
+			static CRCType CalcDataFileRecord(const DataFile::RecordHeader &header, const Byte *key, const Byte *value)
+			{
+				CRCType crc = Update(0xFFFFFFFF, key, header.SizeOfKey);
+				crc = Update(crc, value, header.SizeOfValue);
+				return FinishDataFileRecord(crc, header);
+			}
 
-				return Get(buffer);
+			// crc is the running checksum of the record body, see DataFile::RecordHeader
+			static CRCType FinishDataFileRecord(CRCType crc, const DataFile::RecordHeader &header)
+			{
+				return Update(crc, reinterpret_cast<const Byte*>(&header), sizeof(DataFile::RecordHeader)) ^ 0xFFFFFFFF;
 			}
 
 		private:
 			static void initTable()
 			{
-				bool init = false;
-
-				if (init) return;
+				static bool init = buildTable(); // thread-safe, runs once
+				(void)init;
+			}
 
-				init = true;
+			static bool buildTable()
+			{
 				for (int i = 0; i < 256; i++)
 				{
 					CRCType crc = i;
@@ -94,6 +131,7 @@ namespace FreshCask
 					}
 					CRCTable[i] = crc;
 				}
+				return true;
 			}
 			static CRCType CRCTable[256];
 		};
@@ -1,9 +1,14 @@
 #ifndef __CORE_DATASTORAGEENGINE_HPP__
 #define __CORE_DATASTORAGEENGINE_HPP__
 
+#include <atomic>
+
 #include <Core/DataFile.h>
 #include <Core/HashFile.h>
+#include <Core/WriteBatch.hpp>
 #include <Core/DataFileStream.hpp>
+#include <Core/IOScheduler.hpp>
+#include <Core/FilePool.hpp>
 
 namespace FreshCask
 {
@@ -109,25 +114,45 @@ namespace FreshCask
 #else
 #endif
 	};*/
-	class DataFileEngine
+	// An older file in a pool may find its handles taken back while nobody reads it, the next
+	// read opens it again. An active file counts against the pool too, but keeps its handles.
+	class DataFileEngine : public PooledFile
 	{
 	public:
-		DataFileEngine(std::string filePath) : filePath(filePath), reader(filePath), writer(filePath), fileId(-1), fileFlag(DataFile::Flag::ActiveFile) {}
-		~DataFileEngine() { Close(); }
+		static const uint32_t RecordPrefixSize = sizeof(DataFile::CRC32::CRCType) + sizeof(DataFile::RecordHeader);
 
-		bool IsOpen() 
+		// called for every key found by Scan(), SizeOfValue = 0 means the key was deleted
+		typedef std::function<Status(const SmartByteArray&, const HashFile::Record&)> ScanCallbackType;
+
+		// called for every key found by ScanRaw() with its value and, if the record can be
+		// copied byte-for-byte (not in a batch frame, not older than 1.2), the whole record
+		typedef std::function<Status(const SmartByteArray&, const HashFile::Record&, const Byte *value, const Byte *raw, uint32_t rawSize)> RawScanCallbackType;
+
+	public:
+		DataFileEngine(std::string filePath, IOScheduler &scheduler = IOScheduler::Default(), FilePool *pool = nullptr)
+			: filePath(filePath), reader(filePath), writer(filePath), scheduler(scheduler), pool(pool), fileId(-1), fileFlag(DataFile::Flag::ActiveFile), minorVersion(CurrentMinorVersion), obsolete(false),
+			opened(false), released(false), olderSize(0) {}
+		~DataFileEngine()
 		{
-			switch (fileFlag)
-			{
-			case DataFile::Flag::OlderFile:
-				return reader.IsOpen();
+			Close();
 
-			case DataFile::Flag::ActiveFile:
-				return reader.IsOpen() && writer.IsOpen();
+			// last reference to a merged away file is gone, nobody can read it any more
+			if (obsolete)
+			{
+				RemoveFile(filePath);
+				std::string hintPath = GetHintFilePath(filePath);
+				if (IsFileExist(hintPath)) RemoveFile(hintPath);
+			}
+		}
 
-			default:
+		// a file whose handles the pool took back is still open
+		bool IsOpen() 
+		{
+			uint8_t flag = fileFlag;
+			if (flag & (DataFile::Flag::ActiveFile | DataFile::Flag::OlderFile))
+				return opened;
+			else
 				return false;
-			}
 		}
 
 		Status Open()
@@ -154,15 +179,21 @@ namespace FreshCask
 
 				fileFlag = header->Flag;
 				fileId = header->FileId;
+				minorVersion = header->MinorVersion;
 				RET_BY_SENDER(Status::OK(), "DataFileEngine::CheckHeader()");
 			};
 
 			RET_IFNOT_OK(CheckHeader(), "DataFileEngine::Open()");
 			RET_IFNOT_OK(writer.Open(), "DataFileEngine::Open()");
+
+			opened = true;
+			if (fileFlag & DataFile::Flag::OlderFile)
+				RET_IFNOT_OK(setOlder(), "DataFileEngine::Open()");
+			addToPool();
 			RET_BY_SENDER(Status::OK(), "DataFileEngine::Open()");
 		}
 
-		Status Create(uint32_t _fileId)
+		Status Create(uint32_t _fileId, uint8_t _fileFlag = DataFile::Flag::ActiveFile)
 		{
 			RET_IFNOT_OK(writer.Open(true), "DataFileEngine::Create()");
 
@@ -172,15 +203,21 @@ namespace FreshCask
 			header->MagicNumber = DataFile::DefaultMagicNumber;
 			header->MajorVersion = CurrentMajorVersion;
 			header->MinorVersion = CurrentMinorVersion;
-			header->Flag = DataFile::Flag::ActiveFile;
+			header->Flag = _fileFlag;
 			header->FileId = _fileId;
 			header->Reserved = 0x0;
 
 			RET_IFNOT_OK(writer.WriteNext(buffer), "DataFileEngine::Create()");
 			RET_IFNOT_OK(reader.Open(), "DataFileEngine::Create()");
 
-			fileFlag = DataFile::Flag::ActiveFile;
+			fileFlag = _fileFlag;
 			fileId = _fileId;
+			minorVersion = CurrentMinorVersion;
+
+			opened = true;
+			if (fileFlag & DataFile::Flag::OlderFile)
+				RET_IFNOT_OK(setOlder(), "DataFileEngine::Create()");
+			addToPool();
 			RET_BY_SENDER(Status::OK(), "DataFileEngine::Create()");
 		}
 
@@ -189,13 +226,25 @@ namespace FreshCask
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("File not open."), "DataFileEngine::Close()");
 
+			if (pool != nullptr) pool->Closed(this);
+
+			WriteLockGuard lock(handleMutex);
+			opened = false, released = false;
 			RET_IFNOT_OK(reader.Close(), "DataFileEngine::Close()");
 			RET_BY_SENDER(writer.Close(), "DataFileEngine::Close()");
 		}
 
-		Status ReadValue(const HashFile::Record &hfRec, SmartByteArray &valueOut)
+		// a user read holds background I/O back while in flight, any other class waits its turn
+		Status ReadValue(const HashFile::Record &hfRec, SmartByteArray &valueOut, IOClass::Type ioClass = IOClass::UserRead)
 		{
-			RET_BY_SENDER(reader.Read(hfRec.OffsetOfValue, valueOut = SmartByteArray(hfRec.SizeOfValue)), "DataFileEngine::ReadValue()");
+			if (ioClass != IOClass::UserRead)
+			{
+				scheduler.Acquire(ioClass, hfRec.SizeOfValue);
+				RET_BY_SENDER(readValue(hfRec, valueOut), "DataFileEngine::ReadValue()");
+			}
+
+			IOScheduler::ForegroundScope foreground(scheduler);
+			RET_BY_SENDER(readValue(hfRec, valueOut), "DataFileEngine::ReadValue()");
 		}
 
 		/*Status ReadRecord(HashFile::Record hfRec, DataFile::Record &dfRecOut)
@@ -219,36 +268,284 @@ namespace FreshCask
 			RET_BY_SENDER(Status::OK(), "DataFileEngine::ReadRecord()");
 		}*/
 
-		Status WriteRecord(DataFile::Record dfRec, HashFile::Record &hfRecOut)
+		//************************************
+		// Method:    AppendGather
+		// FullName:  FreshCask::DataFileEngine::AppendGather
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Append a frame made of several segments with a single write
+		// Parameter: const WriteSegment * segments, an encoded frame or header + key + value
+		// Parameter: uint32_t count
+		// Parameter: uint32_t & offsetOut, where the frame begins
+		//************************************
+		Status AppendGather(const WriteSegment *segments, uint32_t count, uint32_t &offsetOut)
 		{
-			if (fileFlag & DataFile::Flag::OlderFile)
-				RET_BY_SENDER(Status::NoFreeSpace("Current data file is older file."), "DataFileEngine::WriteRecord()");
+			uint64_t frameSize = 0;
+			for (uint32_t i = 0; i < count; i++) frameSize += segments[i].Size;
+
+			if (sizeof(DataFile::Header) + frameSize > DataFile::MaxFileSize)
+				RET_BY_SENDER(Status::InvalidArgument("Frame exceeds MaxFileSize."), "DataFileEngine::AppendGather()");
+
+			RET_IFNOT_OK(checkFreeSpace((uint32_t)frameSize, offsetOut), "DataFileEngine::AppendGather()");
+			RET_BY_SENDER(writer.WriteNextGather(segments, count), "DataFileEngine::AppendGather()");
+		}
+
+		//************************************
+		// Method:    EncodeBatch
+		// FullName:  FreshCask::DataFileEngine::EncodeBatch
+		// Access:    public static
+		// Returns:   Status
+		// Desc:      Encode and checksum the body of a batch without touching any file, so it
+		//            can be done on the caller's thread. The first RecordPrefixSize bytes are
+		//            left for EncodePrefix() once the writer lane has picked a sequence number.
+		// Parameter: const WriteBatch & batch
+		// Parameter: SmartByteArray & frameOut
+		// Parameter: std::vector<uint32_t> & offsetsOfValueOut, relative to the frame
+		// Parameter: DataFile::CRC32::CRCType & bodyCRCOut
+		//************************************
+		static Status EncodeBatch(const WriteBatch &batch, SmartByteArray &frameOut, std::vector<uint32_t> &offsetsOfValueOut, DataFile::CRC32::CRCType &bodyCRCOut)
+		{
+			uint64_t frameSize = GetEncodedSize(batch.Entries().data(), batch.Count());
+			if (sizeof(DataFile::Header) + frameSize > DataFile::MaxFileSize)
+				RET_BY_SENDER(Status::InvalidArgument("Batch exceeds MaxFileSize."), "DataFileEngine::EncodeBatch()");
+
+			frameOut = SmartByteArray((uint32_t)frameSize);
+			offsetsOfValueOut.resize(batch.Count());
+			bodyCRCOut = EncodeEntries(batch.Entries().data(), batch.Count(), frameOut.Data(), offsetsOfValueOut.data());
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::EncodeBatch()");
+		}
+
+		// size of the frame EncodeEntries() will produce
+		static uint64_t GetEncodedSize(const WriteBatch::Entry *entries, size_t count)
+		{
+			uint64_t size = RecordPrefixSize;
+			if (count != 1) size += sizeof(uint32_t) + count * sizeof(DataFile::BatchEntryHeader);
 
-			uint32_t curOffset;
-			RET_IFNOT_OK(writer.GetOffset(curOffset), "DataFileEngine::WriteRecord()");
+			for (size_t i = 0; i < count; i++)
+				size += (uint64_t)entries[i].Key.Size() + entries[i].Value.Size();
+			return size;
+		}
+
+		//************************************
+		// Method:    EncodeEntries
+		// FullName:  FreshCask::DataFileEngine::EncodeEntries
+		// Access:    public static
+		// Returns:   DataFile::CRC32::CRCType, running checksum of the body
+		// Desc:      Encode entries into frameOut, which must hold GetEncodedSize() bytes.
+		//            Everything but the CRC32 and record header is written.
+		// Parameter: const WriteBatch::Entry * entries
+		// Parameter: size_t count
+		// Parameter: BytePtr frameOut
+		// Parameter: uint32_t * offsetsOfValueOut, count of them, relative to the frame
+		//************************************
+		static DataFile::CRC32::CRCType EncodeEntries(const WriteBatch::Entry *entries, size_t count, BytePtr frameOut, uint32_t *offsetsOfValueOut)
+		{
+			BytePtr body = frameOut + RecordPrefixSize, ptr = body;
 
-			if (curOffset + dfRec.GetSize() > DataFile::MaxFileSize)
+			if (count == 1)
 			{
-				fileFlag = DataFile::Flag::OlderFile;
-				RET_IFNOT_OK(writer.Write(offsetof(DataFile::Header, Flag), SmartByteArray((BytePtr)&fileFlag, sizeof(fileFlag))), "DataFileEngine::WriteRecord()");
-				RET_BY_SENDER(Status::NoFreeSpace("MaxFileSize reached."), "DataFileEngine::WriteRecord()");
+				memcpy(ptr, entries[0].Key.Data(), entries[0].Key.Size()); ptr += entries[0].Key.Size();
+				offsetsOfValueOut[0] = (uint32_t)(ptr - frameOut);
+				if (entries[0].Value.Size() > 0) memcpy(ptr, entries[0].Value.Data(), entries[0].Value.Size());
+				return GetBodyCRC(entries[0]);
 			}
 
-			hfRecOut.TimeStamp = dfRec.Header.TimeStamp = GetTimeStamp();
-			dfRec.CRC32 = DataFile::CRC32::CalcDataFileRecord(dfRec);
+			uint32_t count32 = (uint32_t)count;
+			memcpy(ptr, &count32, sizeof(count32)); ptr += sizeof(count32);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				DataFile::BatchEntryHeader entryHeader(entries[i].Key.Size(), entries[i].Value.Size());
+				memcpy(ptr, &entryHeader, sizeof(entryHeader)); ptr += sizeof(entryHeader);
+
+				memcpy(ptr, entries[i].Key.Data(), entries[i].Key.Size()); ptr += entries[i].Key.Size();
+				offsetsOfValueOut[i] = (uint32_t)(ptr - frameOut);
+				if (entries[i].Value.Size() > 0) memcpy(ptr, entries[i].Value.Data(), entries[i].Value.Size()); // empty value is a deletion
+				ptr += entries[i].Value.Size();
+			}
+
+			return DataFile::CRC32::Update(0xFFFFFFFF, body, (uint32_t)(ptr - body));
+		}
+
+		// running checksum of a plain record body, key and value are only read, so they can be
+		// written straight from caller's buffers
+		static DataFile::CRC32::CRCType GetBodyCRC(const WriteBatch::Entry &entry)
+		{
+			DataFile::CRC32::CRCType crc = DataFile::CRC32::Update(0xFFFFFFFF, entry.Key.Data(), entry.Key.Size());
+			return DataFile::CRC32::Update(crc, entry.Value.Data(), entry.Value.Size());
+		}
+
+		// record header of the frame EncodeEntries() produces, Sequence is left to the writer lane
+		static DataFile::RecordHeader MakeRecordHeader(const WriteBatch::Entry *entries, size_t count, uint32_t timeStamp)
+		{
+			DataFile::RecordHeader header = count == 1 ?
+				DataFile::RecordHeader(entries[0].Key.Size(), entries[0].Value.Size()) :
+				DataFile::RecordHeader(DataFile::BatchFrameMarker, (uint32_t)(GetEncodedSize(entries, count) - RecordPrefixSize));
+			header.TimeStamp = timeStamp;
+			return header;
+		}
+
+		//************************************
+		// Method:    EncodePrefix
+		// FullName:  FreshCask::DataFileEngine::EncodePrefix
+		// Access:    public static
+		// Returns:   void
+		// Desc:      Finish the checksum and write CRC32 + RecordHeader in front of a frame
+		// Parameter: const DataFile::RecordHeader & header
+		// Parameter: DataFile::CRC32::CRCType bodyCRC, from EncodeEntries() or GetBodyCRC()
+		// Parameter: BytePtr prefixOut, RecordPrefixSize bytes
+		//************************************
+		static void EncodePrefix(const DataFile::RecordHeader &header, DataFile::CRC32::CRCType bodyCRC, BytePtr prefixOut)
+		{
+			DataFile::CRC32::CRCType crc = DataFile::CRC32::FinishDataFileRecord(bodyCRC, header);
+			memcpy(prefixOut, &crc, sizeof(crc));
+			memcpy(prefixOut + sizeof(crc), &header, sizeof(DataFile::RecordHeader));
+		}
+
+		//************************************
+		// Method:    Scan
+		// FullName:  FreshCask::DataFileEngine::Scan
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Walk records from startOffset on, stop at the end of file or at the first
+		//            torn or corrupted record. A batch frame is reported only if the whole
+		//            frame is intact.
+		// Parameter: uint32_t startOffset, 0 means right after the file header
+		// Parameter: const ScanCallbackType & func
+		// Parameter: uint32_t & endOffsetOut, offset right after the last intact record
+		//************************************
+		Status Scan(uint32_t startOffset, const ScanCallbackType &func, uint32_t &endOffsetOut)
+		{
+			RET_BY_SENDER(ScanRaw(startOffset, [&](const SmartByteArray &key, const HashFile::Record &hfRec, const Byte*, const Byte*, uint32_t) -> Status {
+				return func(key, hfRec);
+			}, endOffsetOut), "DataFileEngine::Scan()");
+		}
+
+		//************************************
+		// Method:    ScanRaw
+		// FullName:  FreshCask::DataFileEngine::ScanRaw
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Same as Scan(), but also hands out the bytes read, valid during the call.
+		//            The file is read ScanBufferSize at a time, as ioClass allows.
+		// Parameter: uint32_t startOffset, 0 means right after the file header
+		// Parameter: const RawScanCallbackType & func
+		// Parameter: uint32_t & endOffsetOut, offset right after the last intact record
+		// Parameter: IOClass::Type ioClass
+		//************************************
+		Status ScanRaw(uint32_t startOffset, const RawScanCallbackType &func, uint32_t &endOffsetOut, IOClass::Type ioClass = IOClass::Recovery)
+		{
+			const bool legacy = minorVersion < 2; // header without sequence, checksummed first
+			const uint32_t headerSize = legacy ? DataFile::LegacyRecordHeaderSize : sizeof(DataFile::RecordHeader);
+			const uint32_t prefixSize = sizeof(DataFile::CRC32::CRCType) + headerSize;
+
+			HandleScope handles(*this);
+			RET_IFNOT_OK(handles.Reopen(), "DataFileEngine::ScanRaw()");
+
+			uint32_t fileSize;
+			RET_IFNOT_OK(reader.GetSize(fileSize), "DataFileEngine::ScanRaw()");
+
+			ReadAhead window(reader, fileSize, scheduler, ioClass);
+			uint32_t offset = startOffset > sizeof(DataFile::Header) ? startOffset : sizeof(DataFile::Header);
+			while (offset <= fileSize && fileSize - offset >= prefixSize)
+			{
+				const Byte *prefix;
+				RET_IFNOT_OK(window.Fetch(offset, prefixSize, prefix), "DataFileEngine::ScanRaw()");
+
+				DataFile::CRC32::CRCType crc;
+				DataFile::RecordHeader header;
+				memcpy(&crc, prefix, sizeof(crc));
+				memcpy(&header, prefix + sizeof(crc), headerSize);
+
+				bool isBatch = header.SizeOfKey == DataFile::BatchFrameMarker;
+				uint64_t bodySize = isBatch ? header.SizeOfValue : (uint64_t)header.SizeOfKey + header.SizeOfValue;
+				if (bodySize > fileSize - offset - prefixSize) break; // torn tail
+
+				const Byte *record;
+				uint32_t recordSize = prefixSize + (uint32_t)bodySize;
+				RET_IFNOT_OK(window.Fetch(offset, recordSize, record), "DataFileEngine::ScanRaw()");
+				const Byte *body = record + prefixSize;
+
+				DataFile::CRC32::CRCType realCRC;
+				if (legacy)
+				{
+					realCRC = DataFile::CRC32::Update(0xFFFFFFFF, record + sizeof(crc), headerSize);
+					realCRC = DataFile::CRC32::Update(realCRC, body, (uint32_t)bodySize) ^ 0xFFFFFFFF;
+				}
+				else
+					realCRC = DataFile::CRC32::FinishDataFileRecord(DataFile::CRC32::Update(0xFFFFFFFF, body, (uint32_t)bodySize), header);
+				if (realCRC != crc) break;
+
+				if (isBatch)
+				{
+					bool intact = false;
+					RET_IFNOT_OK(scanBatch(offset + prefixSize, header, body, (uint32_t)bodySize, func, intact), "DataFileEngine::ScanRaw()");
+					if (!intact) break;
+				}
+				else
+				{
+					SmartByteArray key = SmartByteArray::Copy(body, header.SizeOfKey);
+
+					// only a record of current version can be copied as is
+					HashFile::Record hfRec(fileId, header.SizeOfValue, offset + prefixSize + header.SizeOfKey, header.TimeStamp, header.Sequence);
+					RET_IFNOT_OK(func(key, hfRec, body + header.SizeOfKey, legacy ? nullptr : record, recordSize), "DataFileEngine::ScanRaw()");
+				}
+
+				offset += recordSize;
+			}
+
+			endOffsetOut = offset;
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::ScanRaw()");
+		}
+
+		// drop everything after offset, used to cut a torn tail off the active file
+		Status Truncate(uint32_t offset)
+		{
+			RET_BY_SENDER(writer.Truncate(offset), "DataFileEngine::Truncate()");
+		}
+
+		// flag the file as older file, nothing will be appended to it any more
+		Status Seal()
+		{
+			uint8_t flag = (fileFlag & ~DataFile::Flag::ActiveFile) | DataFile::Flag::OlderFile;
+			RET_IFNOT_OK(writer.Write(offsetof(DataFile::Header, Flag), SmartByteArray::Borrow((BytePtr)&flag, sizeof(flag))), "DataFileEngine::Seal()");
+			RET_IFNOT_OK(setOlder(), "DataFileEngine::Seal()");
+
+			fileFlag = flag;
+			addToPool(); // in the pool already, its handles may be taken back from now on
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::Seal()");
+		}
 
-			SmartByteArray header(sizeof(dfRec.CRC32) + sizeof(DataFile::RecordHeader));
-			memcpy(header.Data(), &dfRec.CRC32, sizeof(dfRec.CRC32));
-			memcpy(header.Data() + sizeof(dfRec.CRC32), &dfRec.Header, sizeof(DataFile::RecordHeader));
+		// remove the file (and its hint file) once the last reference to this engine is released
+		void MarkObsolete() { obsolete = true; }
 
-			RET_IFNOT_OK(writer.WriteNext(header), "DataFileEngine::WriteRecord()");
-			RET_IFNOT_OK(writer.WriteNext(dfRec.Key), "DataFileEngine::WriteRecord()");
-			RET_IFNOT_OK(writer.GetOffset(hfRecOut.OffsetOfValue), "DataFileEngine::WriteRecord()");
-			RET_IFNOT_OK(writer.WriteNext(dfRec.Value), "DataFileEngine::WriteRecord()");
+		// merged files carry a hint file next to them: <id>.fcdf -> <id>.fcht
+		static std::string GetHintFilePath(const std::string &dataFilePath)
+		{
+			return dataFilePath.substr(0, dataFilePath.length() - DataFile::FileNameSuffix.length()) + HintFile::FileNameSuffix;
+		}
+
+		// bytes of records in file, without file header
+		Status GetRecordBytes(uint32_t &out)
+		{
+			// an older file doesn't grow, its size is known without handles
+			uint32_t fileSize = olderSize;
+			if (!(fileFlag & DataFile::Flag::OlderFile))
+				RET_IFNOT_OK(reader.GetSize(fileSize), "DataFileEngine::GetRecordBytes()");
 
-			hfRecOut.SizeOfValue = dfRec.Value.Size();
-			hfRecOut.DataFileId = fileId;
-			RET_BY_SENDER(Status::OK(), "DataFileEngine::WriteRecord()");
+			out = fileSize > sizeof(DataFile::Header) ? fileSize - sizeof(DataFile::Header) : 0;
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::GetRecordBytes()");
+		}
+
+		// space a record takes on disk, a record in batch frame takes about the same
+		static uint32_t GetRecordSize(uint32_t sizeOfKey, uint32_t sizeOfValue)
+		{
+			return RecordPrefixSize + sizeOfKey + sizeOfValue;
+		}
+
+		Status GetWriteOffset(uint32_t &out)
+		{
+			RET_BY_SENDER(writer.GetOffset(out), "DataFileEngine::GetWriteOffset()");
 		}
 
 		uint32_t GetFileId() 
@@ -263,12 +560,183 @@ namespace FreshCask
 			else return fileFlag;
 		}
 
+		uint8_t GetMinorVersion() { return minorVersion; }
+
+	protected:
+		bool TryReleaseHandles()
+		{
+			if (!(fileFlag & DataFile::Flag::OlderFile) || !handleMutex.TryLock()) return false;
+
+			bool release = opened && !released;
+			if (release)
+			{
+				reader.Close(), writer.Close();
+				released = true;
+			}
+
+			handleMutex.Unlock();
+			return release;
+		}
+
+	private:
+		Status readValue(const HashFile::Record &hfRec, SmartByteArray &valueOut)
+		{
+			HandleScope handles(*this);
+			RET_IFNOT_OK(handles.Reopen(), "DataFileEngine::readValue()");
+			RET_BY_SENDER(reader.Read(hfRec.OffsetOfValue, valueOut = SmartByteArray(hfRec.SizeOfValue)), "DataFileEngine::readValue()");
+		}
+
+		// holds the handles of the file for reading, so the pool can't take them back meanwhile
+		class HandleScope
+		{
+		public:
+			HandleScope(DataFileEngine &engine) : engine(engine) { engine.handleMutex.LockShared(); }
+			~HandleScope() { engine.handleMutex.UnlockShared(); }
+
+			HandleScope(const HandleScope&) = delete;
+			HandleScope& operator=(const HandleScope&) = delete;
+
+			// open the reader again if the pool released it
+			Status Reopen()
+			{
+				if (engine.pool == nullptr) RET_BY_SENDER(Status::OK(), "DataFileEngine::HandleScope::Reopen()");
+
+				while (engine.released)
+				{
+					engine.handleMutex.UnlockShared();
+					Status ret = Status::OK();
+					{
+						WriteLockGuard lock(engine.handleMutex);
+						if (engine.released && (ret = engine.reader.Open()).IsOK()) engine.released = false;
+					}
+					if (ret.IsOK()) engine.pool->Opened(&engine);
+					engine.handleMutex.LockShared();
+					RET_IFNOT_OK(ret, "DataFileEngine::HandleScope::Reopen()");
+				}
+
+				engine.touch();
+				RET_BY_SENDER(Status::OK(), "DataFileEngine::HandleScope::Reopen()");
+			}
+
+		private:
+			DataFileEngine &engine;
+		};
+
+		// the file is about to become an older file, or was opened as one
+		Status setOlder()
+		{
+			uint32_t fileSize;
+			RET_IFNOT_OK(reader.GetSize(fileSize), "DataFileEngine::setOlder()");
+			olderSize = fileSize;
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::setOlder()");
+		}
+
+		void addToPool()
+		{
+			if (pool != nullptr) pool->Opened(this);
+		}
+
+		Status checkFreeSpace(uint32_t size, uint32_t &curOffset)
+		{
+			if (fileFlag & DataFile::Flag::OlderFile)
+				RET_BY_SENDER(Status::NoFreeSpace("Current data file is older file."), "DataFileEngine::checkFreeSpace()");
+
+			RET_IFNOT_OK(writer.GetOffset(curOffset), "DataFileEngine::checkFreeSpace()");
+
+			if (curOffset + size > DataFile::MaxFileSize)
+			{
+				RET_IFNOT_OK(Seal(), "DataFileEngine::checkFreeSpace()");
+				RET_BY_SENDER(Status::NoFreeSpace("MaxFileSize reached."), "DataFileEngine::checkFreeSpace()");
+			}
+
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::checkFreeSpace()");
+		}
+
+		Status scanBatch(uint32_t payloadOffset, const DataFile::RecordHeader &header, const Byte *payload, uint32_t payloadSize, const RawScanCallbackType &func, bool &intact)
+		{
+			// validate the whole frame before reporting any entry
+			std::vector<std::pair<SmartByteArray, HashFile::Record>> entries;
+			uint32_t count, pos = sizeof(count);
+			intact = false;
+
+			if (payloadSize < sizeof(count))
+				RET_BY_SENDER(Status::OK(), "DataFileEngine::scanBatch()");
+			memcpy(&count, payload, sizeof(count));
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				DataFile::BatchEntryHeader entryHeader;
+				if (payloadSize - pos < sizeof(entryHeader))
+					RET_BY_SENDER(Status::OK(), "DataFileEngine::scanBatch()");
+				memcpy(&entryHeader, payload + pos, sizeof(entryHeader)); pos += sizeof(entryHeader);
+
+				if ((uint64_t)entryHeader.SizeOfKey + entryHeader.SizeOfValue > payloadSize - pos)
+					RET_BY_SENDER(Status::OK(), "DataFileEngine::scanBatch()");
+
+				SmartByteArray key = SmartByteArray::Copy(payload + pos, entryHeader.SizeOfKey); pos += entryHeader.SizeOfKey;
+				entries.push_back(std::make_pair(std::move(key), HashFile::Record(fileId, entryHeader.SizeOfValue, payloadOffset + pos, header.TimeStamp, header.Sequence > 0 ? header.Sequence + i : 0)));
+				pos += entryHeader.SizeOfValue;
+			}
+
+			if (pos != payloadSize)
+				RET_BY_SENDER(Status::OK(), "DataFileEngine::scanBatch()");
+
+			// an entry is covered by the checksum of its frame, so it's never copied as is
+			intact = true;
+			for (auto& entry : entries)
+				RET_IFNOT_OK(func(entry.first, entry.second, payload + (entry.second.OffsetOfValue - payloadOffset), nullptr, 0), "DataFileEngine::scanBatch()");
+
+			RET_BY_SENDER(Status::OK(), "DataFileEngine::scanBatch()");
+		}
+
+		// sequential read window of ScanRaw(), pointers it gives out last until next Fetch()
+		class ReadAhead
+		{
+		public:
+			ReadAhead(DataFileReader &reader, uint32_t fileSize, IOScheduler &scheduler, IOClass::Type ioClass)
+				: reader(reader), fileSize(fileSize), scheduler(scheduler), ioClass(ioClass), start(0), length(0) {}
+
+			Status Fetch(uint32_t offset, uint32_t size, const Byte *&out)
+			{
+				if (offset < start || offset + size > start + length)
+				{
+					uint32_t readSize = size > DataFile::ScanBufferSize ? size : DataFile::ScanBufferSize;
+					if (readSize > fileSize - offset) readSize = fileSize - offset;
+
+					if (buffer.Size() < readSize) buffer = SmartByteArray(readSize);
+					SmartByteArray window = SmartByteArray::Borrow(buffer.Data(), readSize);
+					scheduler.Acquire(ioClass, readSize);
+					RET_IFNOT_OK(reader.Read(offset, window), "DataFileEngine::ReadAhead::Fetch()");
+					start = offset, length = readSize;
+				}
+
+				out = buffer.Data() + (offset - start);
+				RET_BY_SENDER(Status::OK(), "DataFileEngine::ReadAhead::Fetch()");
+			}
+
+		private:
+			DataFileReader &reader;
+			uint32_t fileSize;
+			IOScheduler &scheduler;
+			IOClass::Type ioClass;
+			SmartByteArray buffer;
+			uint32_t start, length;
+		};
+
 	protected:
 		DataFileReader reader;
 		DataFileWriter writer;
 		std::string filePath;
-		uint8_t fileFlag;
+		IOScheduler &scheduler;
+		FilePool *pool;
+		std::atomic<uint8_t> fileFlag; // read by merge while the lane seals it
 		uint32_t fileId;
+		uint8_t minorVersion;
+		std::atomic<bool> obsolete;
+
+		RWMutex handleMutex; // shared by readers, exclusive to take handles back or reopen
+		std::atomic<bool> opened, released;
+		std::atomic<uint32_t> olderSize; // of the file once it's an older file
 	};
 } // namespace FreshCask
 #endif // __CORE_DATASTORAGEENGINE_HPP__
\ No newline at end of file
@@ -55,6 +55,21 @@ namespace FreshCask
 			RET_BY_SENDER(Status::OK(), "DataFileWriter::GetOffset()");
 		}
 
+		Status Truncate(uint32_t offset)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("File not open"), "DataFileWriter::Truncate()");
+
+#ifdef WIN32
+			if (INVALID_SET_FILE_POINTER == SetFilePointer(fileHandle, offset, NULL, FILE_BEGIN))
+				RET_BY_SENDER(Status::IOError("Failed to SetFilePointer"), "DataFileWriter::Truncate()");
+
+			if (FALSE == SetEndOfFile(fileHandle))
+				RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "DataFileWriter::Truncate()");
+#endif
+			RET_BY_SENDER(Status::OK(), "DataFileWriter::Truncate()");
+		}
+
 	private:
 		std::string filePath;
 	};
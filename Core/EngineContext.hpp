@@ -0,0 +1,51 @@
+#ifndef __CORE_ENGINECONTEXT_HPP__
+#define __CORE_ENGINECONTEXT_HPP__
+
+#include <Util/TaskScheduler.hpp>
+
+#include <Core/FilePool.hpp>
+#include <Core/IOScheduler.hpp>
+
+namespace FreshCask
+{
+	// What all buckets of a process share: the threads writes and background work run on and
+	// the disk they run against. However many buckets are open, their lanes, merges,
+	// checkpoints, warm-up and async reads together never keep more threads busy than the
+	// scheduler has, and their data files never hold more handles than the file pool allows.
+	class EngineContext
+	{
+	public:
+		//************************************
+		// Method:    EngineContext
+		// FullName:  FreshCask::EngineContext::EngineContext
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint32_t threadCount, 0 for one per core
+		// Parameter: IOScheduler & ioScheduler
+		//************************************
+		EngineContext(uint32_t threadCount = DefaultEngineThreads, IOScheduler &ioScheduler = IOScheduler::Default())
+			: tasks(threadCount), ioScheduler(ioScheduler) {}
+
+		EngineContext(const EngineContext&) = delete;
+		EngineContext& operator=(const EngineContext&) = delete;
+
+		TaskScheduler& GetTaskScheduler() { return tasks; }
+		IOScheduler& GetIOScheduler() { return ioScheduler; }
+		FilePool& GetFilePool() { return files; }
+
+		// used by every bucket not given a context of its own
+		static EngineContext& Default()
+		{
+			static EngineContext context;
+			return context;
+		}
+
+	private:
+		TaskScheduler tasks;
+		IOScheduler &ioScheduler;
+		FilePool files;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_ENGINECONTEXT_HPP__
@@ -0,0 +1,146 @@
+#ifndef __CORE_FILEPOOL_HPP__
+#define __CORE_FILEPOOL_HPP__
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+namespace FreshCask
+{
+	// A file whose handles FilePool may close while nobody uses them, to be opened again on
+	// the next read.
+	class PooledFile
+	{
+		friend class FilePool;
+
+	public:
+		PooledFile() : referenced(false), poolIndex((size_t)-1) {}
+		virtual ~PooledFile() {}
+
+	protected:
+		// close the handles unless a reader is using them right now, never blocks
+		virtual bool TryReleaseHandles() = 0;
+
+		// on every use, so the pool keeps recently read files open
+		void touch()
+		{
+			// most reads find the bit set already, don't make them all write the line
+			if (!referenced.load(std::memory_order_relaxed)) referenced.store(true, std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<bool> referenced;
+		size_t poolIndex; // in FilePool::files, guarded by the pool
+	};
+
+	// Bounds how many data files of all buckets sharing it hold handles at once. Once the
+	// limit is passed, the pool takes handles back from older files not read lately, clock
+	// style: a file read since the hand last passed it is spared once. Active files count
+	// too, but their lanes keep them busy and their handles are never taken back: with
+	// more of them than the limit allows, the pool holds just those and nothing else.
+	class FilePool
+	{
+	public:
+		//************************************
+		// Method:    FilePool
+		// FullName:  FreshCask::FilePool::FilePool
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint32_t limit, 0 for no limit
+		//************************************
+		FilePool(uint32_t limit = 0) : limit(limit), hand(0), releases(0) {}
+
+		FilePool(const FilePool&) = delete;
+		FilePool& operator=(const FilePool&) = delete;
+
+		void SetLimit(uint32_t _limit)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			limit = _limit;
+			shrink(nullptr);
+		}
+
+		//************************************
+		// Method:    Opened
+		// FullName:  FreshCask::FilePool::Opened
+		// Access:    public
+		// Returns:   void
+		// Desc:      file got handles, take those of others back if that's too many
+		// Parameter: PooledFile * file, its handles are not taken back by this call
+		//************************************
+		void Opened(PooledFile *file)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (file->poolIndex == (size_t)-1)
+			{
+				file->poolIndex = files.size();
+				files.push_back(file);
+			}
+			file->touch();
+			shrink(file);
+		}
+
+		// file let go of its handles or goes away
+		void Closed(PooledFile *file)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			remove(file);
+		}
+
+		struct Stats
+		{
+			uint32_t OpenFiles, Limit; // active files included
+			uint64_t Releases; // handles taken back from idle files
+		};
+
+		Stats GetStats()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Stats stats;
+			stats.OpenFiles = (uint32_t)files.size();
+			stats.Limit = limit;
+			stats.Releases = releases;
+			return stats;
+		}
+
+	private:
+		void shrink(PooledFile *keep)
+		{
+			// every file passed at most twice: once to clear its bit, once to release it
+			for (size_t steps = 2 * files.size(); limit > 0 && files.size() > limit && steps > 0; steps--)
+			{
+				if (hand >= files.size()) hand = 0;
+
+				PooledFile *file = files[hand];
+				if (file == keep || file->referenced.exchange(false, std::memory_order_relaxed) || !file->TryReleaseHandles())
+				{
+					hand++;
+					continue;
+				}
+
+				remove(file); // the last file moves to hand, the hand stays
+				releases++;
+			}
+		}
+
+		void remove(PooledFile *file)
+		{
+			if (file->poolIndex == (size_t)-1) return;
+
+			files[file->poolIndex] = files.back();
+			files[file->poolIndex]->poolIndex = file->poolIndex;
+			files.pop_back();
+			file->poolIndex = (size_t)-1;
+		}
+
+	private:
+		std::mutex mutex;
+		std::vector<PooledFile*> files; // holding handles
+		uint32_t limit;
+		size_t hand;
+		uint64_t releases;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_FILEPOOL_HPP__
@@ -6,10 +6,23 @@
 #else
 #endif
 
+#include <vector>
+
 #include <Util/LockGuard.hpp>
 
 namespace FreshCask
 {
+	// one piece of a gathered write
+	struct WriteSegment
+	{
+		const Byte *Data;
+		uint32_t Size;
+
+		WriteSegment() : Data(nullptr), Size(0) {}
+		WriteSegment(const Byte *Data, uint32_t Size) : Data(Data), Size(Size) {}
+		WriteSegment(const SmartByteArray &bar) : Data(bar.Data()), Size(bar.Size()) {}
+	};
+
 	class FileStream
 	{
 	public:
@@ -35,8 +48,8 @@ namespace FreshCask
 	class FileReader : public FileStream
 	{
 	public:
-		FileReader() {}
-		FileReader(const HANDLE& fileHandle) : FileStream(fileHandle) {}
+		FileReader() : readMutex("FileReader") {}
+		FileReader(const HANDLE& fileHandle) : FileStream(fileHandle), readMutex("FileReader") {}
 		virtual ~FileReader() { Close(); }
 
 		Status Close()
@@ -94,6 +107,18 @@ namespace FreshCask
 			RET_BY_SENDER(Status::OK(), "FileReader::ReadNext()");
 		}
 
+		Status GetSize(uint32_t &out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("File not open"), "FileReader::GetSize()");
+
+#ifdef WIN32
+			if (INVALID_FILE_SIZE == (out = GetFileSize(fileHandle, NULL)))
+				RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "FileReader::GetSize()");
+#endif
+			RET_BY_SENDER(Status::OK(), "FileReader::GetSize()");
+		}
+
 	private:
 		Mutex readMutex;
 	};
@@ -101,8 +126,8 @@ namespace FreshCask
 	class FileWriter : public FileStream
 	{
 	public:
-		FileWriter() {}
-		FileWriter(const HANDLE& fileHandle) : FileStream(fileHandle) {}
+		FileWriter() : writeMutex("FileWriter") {}
+		FileWriter(const HANDLE& fileHandle) : FileStream(fileHandle), writeMutex("FileWriter") {}
 		virtual ~FileWriter() { Close(); }
 
 		Status Close()
@@ -148,8 +173,59 @@ namespace FreshCask
 			RET_BY_SENDER(Status::OK(), "FileWriter::WriteNext()");
 		}
 
+		//************************************
+		// Method:    WriteNextGather
+		// FullName:  FreshCask::FileWriter::WriteNextGather
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Write segments back to back with a single system call
+		// Parameter: const WriteSegment * segments
+		// Parameter: uint32_t count
+		//************************************
+		Status WriteNextGather(const WriteSegment *segments, uint32_t count)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("File not open"), "FileWriter::WriteNextGather()");
+
+			LockGuard lock(writeMutex);
+
+#ifdef WIN32
+			// WriteFileGather() only works on unbuffered, page aligned I/O, so gather into a
+			// buffer owned by this writer; it only grows, so steady writes don't allocate.
+			size_t total = 0;
+			for (uint32_t i = 0; i < count; i++) total += segments[i].Size;
+			if (gatherBuffer.size() < total) gatherBuffer.resize(total);
+
+			BytePtr ptr = gatherBuffer.data();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (segments[i].Size > 0) memcpy(ptr, segments[i].Data, segments[i].Size);
+				ptr += segments[i].Size;
+			}
+
+			DWORD bytesWritten = 0;
+			if (FALSE == WriteFile(fileHandle, gatherBuffer.data(), (DWORD)total, &bytesWritten, NULL) || bytesWritten != total)
+				RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "FileWriter::WriteNextGather()");
+#endif
+			RET_BY_SENDER(Status::OK(), "FileWriter::WriteNextGather()");
+		}
+
+		// what was written so far reaches the disk before this returns
+		Status Sync()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("File not open"), "FileWriter::Sync()");
+
+#ifdef WIN32
+			if (FALSE == FlushFileBuffers(fileHandle))
+				RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "FileWriter::Sync()");
+#endif
+			RET_BY_SENDER(Status::OK(), "FileWriter::Sync()");
+		}
+
 	private:
 		Mutex writeMutex;
+		std::vector<Byte> gatherBuffer;
 	};
 
 } // namespace FreshCask
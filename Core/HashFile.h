@@ -13,14 +13,32 @@ namespace FreshCask
 			uint32_t SizeOfValue;
 			uint32_t OffsetOfValue;
 			uint32_t TimeStamp;
+			uint64_t Sequence; // starts from 1, 0 for records written before 1.2
 
-			Record() : DataFileId(-1), SizeOfValue(-1), OffsetOfValue(-1), TimeStamp(0) {}
+			Record() : DataFileId(-1), SizeOfValue(-1), OffsetOfValue(-1), TimeStamp(0), Sequence(0) {}
 
-			Record(uint32_t DataFileId, uint32_t SizeOfValue, uint32_t OffsetOfValue, uint32_t TimeStamp) :
-				DataFileId(DataFileId), SizeOfValue(SizeOfValue), OffsetOfValue(OffsetOfValue), TimeStamp(TimeStamp) {}
+			Record(uint32_t DataFileId, uint32_t SizeOfValue, uint32_t OffsetOfValue, uint32_t TimeStamp, uint64_t Sequence = 0) :
+				DataFileId(DataFileId), SizeOfValue(SizeOfValue), OffsetOfValue(OffsetOfValue), TimeStamp(TimeStamp), Sequence(Sequence) {}
 		};
 
-		typedef std::map<SmartByteArray, Record> HashTree;
+		// Orders keys as operator< does, counting the comparisons made by the calling thread
+		// so that a lookup can tell how deep into the tree it went.
+		struct KeyLess
+		{
+			bool operator()(const SmartByteArray& lhs, const SmartByteArray& rhs) const
+			{
+				Probes()++;
+				return lhs < rhs;
+			}
+
+			static uint64_t& Probes()
+			{
+				static thread_local uint64_t probes = 0;
+				return probes;
+			}
+		};
+
+		typedef std::map<SmartByteArray, Record, KeyLess> HashTree;
 	} // namespace HashFile
 } // namespace FreshCask
 
@@ -10,7 +10,39 @@ namespace FreshCask
 			uint32_t  MagicNumber;
 			uint8_t   MajorVersion;
 			uint8_t   MinorVersion;
-			uint16_t  Reserved;
+			uint16_t  Flags;
+		};
+
+		namespace Flag
+		{
+			const uint16_t Ended = 0x1; // the last record is an end record, a file without one is torn
+		}
+
+		// DataFileId of the end record, no data file has it
+		const uint32_t EndRecordFileId = (uint32_t)-1;
+
+		// Position of an active data file the hint file is up to date with: records before
+		// it are reflected in the hint file, records after it are replayed from the data file.
+		// 1.1 wrote a single Checkpoint right after the header.
+		struct Checkpoint
+		{
+			uint32_t DataFileId;
+			uint32_t OffsetOfRecord; // 0 means from the beginning of DataFileId
+
+			Checkpoint() : DataFileId(0), OffsetOfRecord(0) {}
+			Checkpoint(uint32_t DataFileId, uint32_t OffsetOfRecord) : DataFileId(DataFileId), OffsetOfRecord(OffsetOfRecord) {}
+		};
+
+		// Written right after the header since 1.2 and followed by Count * Checkpoint, one per
+		// write lane. Data files up to LastFileId without a checkpoint are fully reflected,
+		// later ones are replayed from the beginning.
+		struct CheckpointHeader
+		{
+			uint64_t LastSequence;
+			uint32_t LastFileId;
+			uint32_t Count;
+
+			CheckpointHeader() : LastSequence(0), LastFileId(0), Count(0) {}
 		};
 
 		struct RecordHeader
@@ -20,11 +52,15 @@ namespace FreshCask
 			uint32_t SizeOfKey;
 			uint32_t SizeOfValue;
 			uint32_t OffsetOfValue;
+			uint32_t Reserved;
+			uint64_t Sequence; // since 1.2
 
-			RecordHeader() : DataFileId(-1), SizeOfKey(-1), SizeOfValue(-1), OffsetOfValue(-1), TimeStamp(0) {}
-			RecordHeader(uint32_t SizeOfKey) : TimeStamp(-1), DataFileId(-1), SizeOfKey(SizeOfKey), SizeOfValue(-1), OffsetOfValue(-1) {}
+			RecordHeader() : DataFileId(-1), SizeOfKey(-1), SizeOfValue(-1), OffsetOfValue(-1), TimeStamp(0), Reserved(0), Sequence(0) {}
+			RecordHeader(uint32_t SizeOfKey) : TimeStamp(-1), DataFileId(-1), SizeOfKey(SizeOfKey), SizeOfValue(-1), OffsetOfValue(-1), Reserved(0), Sequence(0) {}
 		};
 
+		const uint32_t LegacyRecordHeaderSize = offsetof(RecordHeader, Reserved); // before 1.2
+
 		struct Record
 		{
 			RecordHeader Header;
@@ -15,7 +15,7 @@ namespace FreshCask
 		};
 
 	public:
-		HintFileEngine(OpenMode openMode, std::string filePath) : filePath(filePath), openMode(openMode) {}
+		HintFileEngine(OpenMode openMode, std::string filePath) : filePath(filePath), openMode(openMode), hasCheckpoint(false), minorVersion(CurrentMinorVersion), flags(0), ended(false) {}
 		~HintFileEngine() { Close(); }
 
 		bool IsOpen()
@@ -76,11 +76,29 @@ namespace FreshCask
 			if (!IsOpen())
 				RET_BY_SENDER(Status::IOError("File not open."), "HintFileEngine::ReadRecord()");
 			
-			auto header = SmartByteArray((BytePtr)&hfRecOut.Header, sizeof(HintFile::RecordHeader));
-			RET_IFNOT_OK(reader->ReadNext(header), "HintFileEngine::ReadRecord()");
+			if (ended)
+				RET_BY_SENDER(Status::EndOfFile("End record reached."), "HintFileEngine::ReadRecord()");
+
+			// records before 1.2 end at Reserved
+			hfRecOut.Header = HintFile::RecordHeader();
+			auto header = SmartByteArray::Borrow((BytePtr)&hfRecOut.Header, minorVersion < 2 ? HintFile::LegacyRecordHeaderSize : sizeof(HintFile::RecordHeader));
+			Status ret = reader->ReadNext(header);
+			if (ret.IsEndOfFile() && (flags & HintFile::Flag::Ended))
+				RET_BY_SENDER(Status::Corrupted("Hint file ends before its end record."), "HintFileEngine::ReadRecord()");
+			RET_IFNOT_OK(ret, "HintFileEngine::ReadRecord()");
+
+			if ((flags & HintFile::Flag::Ended) && hfRecOut.Header.DataFileId == HintFile::EndRecordFileId)
+			{
+				ended = true;
+				RET_BY_SENDER(Status::EndOfFile("End record reached."), "HintFileEngine::ReadRecord()");
+			}
 
+			// end of file right after a record header is a torn record, not a clean end
 			hfRecOut.Key = SmartByteArray(hfRecOut.Header.SizeOfKey);
-			RET_BY_SENDER(reader->ReadNext(hfRecOut.Key), "HintFileEngine::ReadRecord()");
+			ret = reader->ReadNext(hfRecOut.Key);
+			if (ret.IsEndOfFile())
+				RET_BY_SENDER(Status::Corrupted("Hint record is torn."), "HintFileEngine::ReadRecord()");
+			RET_BY_SENDER(ret, "HintFileEngine::ReadRecord()");
 		}
 
 		Status WriteRecord(HintFile::Record hfRec)
@@ -89,17 +107,62 @@ namespace FreshCask
 				RET_BY_SENDER(Status::IOError("File not open."), "HintFileEngine::WriteRecord()");
 
 			hfRec.Header.TimeStamp = GetTimeStamp();
-			RET_IFNOT_OK(writer->WriteNext(SmartByteArray((BytePtr)&hfRec.Header, sizeof(HintFile::RecordHeader))), "HintFileEngine::WriteRecord()");
+			RET_IFNOT_OK(writer->WriteNext(SmartByteArray::Borrow((BytePtr)&hfRec.Header, sizeof(HintFile::RecordHeader))), "HintFileEngine::WriteRecord()");
 			RET_BY_SENDER(writer->WriteNext(hfRec.Key), "HintFileEngine::WriteRecord()");
 		}
 
+		// close the records with the end record, a reader takes a file without one as torn
+		Status WriteEnd()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("File not open."), "HintFileEngine::WriteEnd()");
+
+			HintFile::RecordHeader header(0);
+			header.DataFileId = HintFile::EndRecordFileId;
+			RET_BY_SENDER(writer->WriteNext(SmartByteArray::Borrow((BytePtr)&header, sizeof(HintFile::RecordHeader))), "HintFileEngine::WriteEnd()");
+		}
+
+		// flush what was written to disk, in write mode
+		Status Sync()
+		{
+			if (!IsOpen() || openMode != Write)
+				RET_BY_SENDER(Status::IOError("File not open for writing."), "HintFileEngine::Sync()");
+
+			RET_BY_SENDER(writer->Sync(), "HintFileEngine::Sync()");
+		}
+
+		//************************************
+		// Method:    GetCheckpoint
+		// FullName:  FreshCask::HintFileEngine::GetCheckpoint
+		// Access:    public 
+		// Returns:   bool, false if the hint file predates checkpoints
+		// Desc:      Get the data file positions this hint file covers
+		// Parameter: HintFile::CheckpointHeader & headerOut
+		// Parameter: std::vector<HintFile::Checkpoint> & out, one per write lane
+		//************************************
+		bool GetCheckpoint(HintFile::CheckpointHeader &headerOut, std::vector<HintFile::Checkpoint> &out)
+		{
+			headerOut = checkpointHeader;
+			out = checkpoints;
+			return hasCheckpoint;
+		}
+
+		// must be called before Open() in write mode
+		void SetCheckpoint(const HintFile::CheckpointHeader &header, const std::vector<HintFile::Checkpoint> &cps)
+		{
+			checkpointHeader = header;
+			checkpointHeader.Count = (uint32_t)cps.size();
+			checkpoints = cps;
+			hasCheckpoint = true;
+		}
+
 	private:
 		Status readOpen()
 		{
 			RET_IFNOT_OK(reader->Open(), "HintFileEngine::Open()");
 
 			// check header
-			SmartByteArray buffer(new Byte[sizeof(HintFile::Header)], sizeof(HintFile::Header));
+			SmartByteArray buffer(sizeof(HintFile::Header));
 			RET_IFNOT_OK(reader->ReadNext(buffer), "HintFileEngine::readOpen()");
 
 			HintFile::Header *header = reinterpret_cast<HintFile::Header*>(buffer.Data());
@@ -110,6 +173,36 @@ namespace FreshCask
 			else if (header->MinorVersion > CurrentMinorVersion)
 				RET_BY_SENDER(Status::NotSupported("DataFile not supported"), "HintFileEngine::readOpen()");
 
+			minorVersion = header->MinorVersion;
+			flags = header->Flags;
+			if (header->MajorVersion == 1 && header->MinorVersion < 1)
+				RET_BY_SENDER(Status::OK(), "HintFileEngine::readOpen()");
+
+			if (header->MajorVersion == 1 && header->MinorVersion < 2)
+			{
+				// single checkpoint, everything after it was written to DataFileId and later files
+				HintFile::Checkpoint cp;
+				auto cpBuffer = SmartByteArray::Borrow((BytePtr)&cp, sizeof(HintFile::Checkpoint));
+				RET_IFNOT_OK(reader->ReadNext(cpBuffer), "HintFileEngine::readOpen()");
+
+				checkpointHeader.LastFileId = cp.DataFileId;
+				checkpointHeader.Count = 1;
+				checkpoints.assign(1, cp);
+			}
+			else
+			{
+				auto cpHeaderBuffer = SmartByteArray::Borrow((BytePtr)&checkpointHeader, sizeof(HintFile::CheckpointHeader));
+				RET_IFNOT_OK(reader->ReadNext(cpHeaderBuffer), "HintFileEngine::readOpen()");
+
+				checkpoints.resize(checkpointHeader.Count);
+				for (auto& cp : checkpoints)
+				{
+					auto cpBuffer = SmartByteArray::Borrow((BytePtr)&cp, sizeof(HintFile::Checkpoint));
+					RET_IFNOT_OK(reader->ReadNext(cpBuffer), "HintFileEngine::readOpen()");
+				}
+			}
+
+			hasCheckpoint = true;
 			RET_BY_SENDER(Status::OK(), "HintFileEngine::readOpen()");
 		}
 
@@ -123,9 +216,15 @@ namespace FreshCask
 			header->MagicNumber = HintFile::DefaultMagicNumber;
 			header->MajorVersion = CurrentMajorVersion;
 			header->MinorVersion = CurrentMinorVersion;
-			header->Reserved = 0x0;
+			header->Flags = HintFile::Flag::Ended;
 
-			RET_BY_SENDER(writer->WriteNext(buffer), "HintFileEngine::writeOpen()");
+			RET_IFNOT_OK(writer->WriteNext(buffer), "HintFileEngine::writeOpen()");
+			RET_IFNOT_OK(writer->WriteNext(SmartByteArray::Borrow((BytePtr)&checkpointHeader, sizeof(HintFile::CheckpointHeader))), "HintFileEngine::writeOpen()");
+
+			for (auto& cp : checkpoints)
+				RET_IFNOT_OK(writer->WriteNext(SmartByteArray::Borrow((BytePtr)&cp, sizeof(HintFile::Checkpoint))), "HintFileEngine::writeOpen()");
+
+			RET_BY_SENDER(Status::OK(), "HintFileEngine::writeOpen()");
 		}
 
 	protected:
@@ -134,6 +233,13 @@ namespace FreshCask
 
 		OpenMode openMode;
 		std::string filePath;
+
+		HintFile::CheckpointHeader checkpointHeader;
+		std::vector<HintFile::Checkpoint> checkpoints;
+		bool hasCheckpoint;
+		uint8_t minorVersion;
+		uint16_t flags;
+		bool ended; // end record read
 	};
 } // namespace FreshCask
 #endif // __CORE_HINTSTORAGEENGINE_HPP__
\ No newline at end of file
@@ -0,0 +1,184 @@
+#ifndef __CORE_IOSCHEDULER_HPP__
+#define __CORE_IOSCHEDULER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <Core/Config.h>
+
+namespace FreshCask
+{
+	namespace IOClass
+	{
+		enum Type
+		{
+			UserRead = 0,   // Get(), never throttled
+			Merge,          // merge and compaction, reads and writes
+			Checkpoint,     // hint files
+			Recovery,       // scans on open
+			BackgroundRead, // reads that mustn't hold users back: cache warm-up, ScanLive(), Cursor pages
+			Count
+		};
+	} // namespace IOClass
+
+	// Coordinates disk access of one process. User reads go first: background I/O waits for
+	// them to drain (at most BackgroundMaxDeferMs), and every background class is held to its
+	// own rate by a token bucket.
+	class IOScheduler
+	{
+	public:
+		struct Limit
+		{
+			uint64_t BytesPerSecond; // 0 means unlimited
+			uint64_t BurstBytes;
+
+			Limit(uint64_t BytesPerSecond = 0, uint64_t BurstBytes = 0) : BytesPerSecond(BytesPerSecond), BurstBytes(BurstBytes) {}
+		};
+
+		// marks a user read in flight
+		class ForegroundScope
+		{
+		public:
+			ForegroundScope(IOScheduler &scheduler) : scheduler(scheduler) { scheduler.beginForeground(); }
+			~ForegroundScope() { scheduler.endForeground(); }
+
+			ForegroundScope(const ForegroundScope&) = delete;
+			ForegroundScope& operator=(const ForegroundScope&) = delete;
+
+		private:
+			IOScheduler &scheduler;
+		};
+
+	public:
+		IOScheduler() : foreground(0), backgroundWaiters(0), maxDefer(DefaultBackgroundMaxDeferMs)
+		{
+			SetLimit(IOClass::Merge, Limit(DefaultMergeBytesPerSecond, DefaultBackgroundBurstBytes));
+			SetLimit(IOClass::Checkpoint, Limit(DefaultCheckpointBytesPerSecond, DefaultBackgroundBurstBytes));
+			SetLimit(IOClass::Recovery, Limit(DefaultRecoveryBytesPerSecond, DefaultBackgroundBurstBytes));
+			SetLimit(IOClass::BackgroundRead, Limit(DefaultBackgroundReadBytesPerSecond, DefaultBackgroundBurstBytes));
+		}
+
+		IOScheduler(const IOScheduler&) = delete;
+		IOScheduler& operator=(const IOScheduler&) = delete;
+
+		//************************************
+		// Method:    Acquire
+		// FullName:  FreshCask::IOScheduler::Acquire
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Block a background class until it may move bytes: no user read in flight
+		//            (or waited long enough) and enough tokens in its bucket. A request larger
+		//            than the burst goes into debt, paid off by the next ones.
+		// Parameter: IOClass::Type ioClass
+		// Parameter: uint64_t bytes
+		//************************************
+		void Acquire(IOClass::Type ioClass, uint64_t bytes)
+		{
+			if (ioClass == IOClass::UserRead || ioClass >= IOClass::Count) return;
+
+			if (foreground.load(std::memory_order_acquire) > 0)
+			{
+				std::unique_lock<std::mutex> lock(priorityMutex);
+				backgroundWaiters++;
+				priorityCond.wait_for(lock, std::chrono::milliseconds(maxDefer.load()), [&] { return foreground.load(std::memory_order_acquire) == 0; });
+				backgroundWaiters--;
+			}
+
+			buckets[ioClass].Take(bytes);
+		}
+
+		void SetLimit(IOClass::Type ioClass, const Limit &limit)
+		{
+			if (ioClass == IOClass::UserRead || ioClass >= IOClass::Count) return;
+			buckets[ioClass].SetLimit(limit);
+		}
+
+		Limit GetLimit(IOClass::Type ioClass)
+		{
+			if (ioClass == IOClass::UserRead || ioClass >= IOClass::Count) return Limit();
+			return buckets[ioClass].GetLimit();
+		}
+
+		// how long background I/O yields to user reads before it goes anyway
+		void SetBackgroundMaxDefer(uint32_t milliseconds) { maxDefer = milliseconds; }
+
+		// shared by every bucket of the process, they sit on the same disk
+		static IOScheduler& Default()
+		{
+			static IOScheduler scheduler;
+			return scheduler;
+		}
+
+	private:
+		class TokenBucket
+		{
+		public:
+			TokenBucket() : tokens(0), last(std::chrono::steady_clock::now()) {}
+
+			void SetLimit(const Limit &_limit)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				limit = _limit;
+				tokens = (double)limit.BurstBytes;
+				last = std::chrono::steady_clock::now();
+			}
+
+			Limit GetLimit()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				return limit;
+			}
+
+			void Take(uint64_t bytes)
+			{
+				std::chrono::duration<double> wait(0);
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (limit.BytesPerSecond == 0) return;
+
+					std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+					tokens += std::chrono::duration<double>(now - last).count() * limit.BytesPerSecond;
+					if (tokens > limit.BurstBytes) tokens = (double)limit.BurstBytes;
+					last = now;
+
+					tokens -= bytes;
+					if (tokens < 0) wait = std::chrono::duration<double>(-tokens / limit.BytesPerSecond);
+				}
+
+				if (wait.count() > 0) std::this_thread::sleep_for(wait);
+			}
+
+		private:
+			std::mutex mutex;
+			Limit limit;
+			double tokens; // negative while in debt
+			std::chrono::steady_clock::time_point last;
+		};
+
+		void beginForeground() { foreground.fetch_add(1, std::memory_order_acq_rel); }
+
+		void endForeground()
+		{
+			// only the last user read wakes background I/O, and only if someone waits
+			if (foreground.fetch_sub(1, std::memory_order_acq_rel) == 1 && backgroundWaiters.load(std::memory_order_acquire) > 0)
+			{
+				std::lock_guard<std::mutex> lock(priorityMutex);
+				priorityCond.notify_all();
+			}
+		}
+
+	private:
+		std::atomic<uint32_t> foreground;
+		std::atomic<uint32_t> backgroundWaiters;
+		std::atomic<uint32_t> maxDefer;
+		std::mutex priorityMutex;
+		std::condition_variable priorityCond;
+
+		TokenBucket buckets[IOClass::Count];
+	};
+} // namespace FreshCask
+
+#endif // __CORE_IOSCHEDULER_HPP__
@@ -0,0 +1,73 @@
+#ifndef __CORE_MERGEPOLICY_HPP__
+#define __CORE_MERGEPOLICY_HPP__
+
+#include <vector>
+#include <algorithm>
+
+namespace FreshCask
+{
+	// how much of a data file is still needed
+	struct DataFileUsage
+	{
+		uint32_t FileId;
+		bool IsOlder;
+		uint64_t TotalBytes; // records only, without file header
+		uint64_t LiveBytes;  // records hash tree points at, deletions count as dead
+
+		DataFileUsage() : FileId(-1), IsOlder(false), TotalBytes(0), LiveBytes(0) {}
+
+		uint64_t DeadBytes() const { return TotalBytes > LiveBytes ? TotalBytes - LiveBytes : 0; }
+		double DeadRatio() const { return TotalBytes > 0 ? (double)DeadBytes() / TotalBytes : 0.0; }
+	};
+
+	// Picks the older files worth merging: every file whose dead ratio reaches deadRatio, then
+	// the deadest of the rest while the bucket takes more than maxSpaceAmplification times the
+	// space of its live data.
+	class MergePolicy
+	{
+	public:
+		MergePolicy(double deadRatio = DefaultMergeDeadRatio, double maxSpaceAmplification = DefaultMaxSpaceAmplification)
+			: deadRatio(deadRatio), maxSpaceAmplification(maxSpaceAmplification) {}
+
+		//************************************
+		// Method:    Select
+		// FullName:  FreshCask::MergePolicy::Select
+		// Access:    public 
+		// Returns:   void
+		// Desc:      Choose files to merge, none if merging doesn't pay off
+		// Parameter: const std::vector<DataFileUsage> & files, every data file of the bucket
+		// Parameter: std::vector<uint32_t> & out
+		//************************************
+		void Select(const std::vector<DataFileUsage> &files, std::vector<uint32_t> &out) const
+		{
+			uint64_t totalBytes = 0, liveBytes = 0;
+			std::vector<const DataFileUsage*> candidates;
+			for (auto &file : files)
+			{
+				totalBytes += file.TotalBytes;
+				liveBytes += file.TotalBytes - file.DeadBytes();
+				if (file.IsOlder && file.DeadBytes() > 0) candidates.push_back(&file);
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](const DataFileUsage *a, const DataFileUsage *b) { return a->DeadRatio() > b->DeadRatio(); });
+
+			for (auto &file : candidates)
+			{
+				bool amplified = (double)totalBytes > liveBytes * maxSpaceAmplification;
+				if (file->DeadRatio() < deadRatio && !amplified) break; // the rest pay off even less
+
+				out.push_back(file->FileId);
+				totalBytes -= file->DeadBytes();
+			}
+		}
+
+		double GetDeadRatio() const { return deadRatio; }
+		double GetMaxSpaceAmplification() const { return maxSpaceAmplification; }
+
+	private:
+		double deadRatio;
+		double maxSpaceAmplification;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_MERGEPOLICY_HPP__
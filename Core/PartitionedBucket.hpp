@@ -0,0 +1,528 @@
+#ifndef __CORE_PARTITIONEDBUCKET_HPP__
+#define __CORE_PARTITIONEDBUCKET_HPP__
+
+#include <memory>
+#include <vector>
+
+#include <Core/BucketManager.hpp>
+
+namespace FreshCask
+{
+	// A bucket split by key hash into independent partitions, each a bucket of its own in a
+	// subdirectory: own keydir, active files, writers and merges. Writes to different
+	// partitions never wait on each other, partitions are recovered in parallel on open and
+	// merged one at a time. The interface is that of BucketManager, but a batch spanning
+	// partitions is atomic only per partition.
+	class PartitionedBucket
+	{
+	public:
+		typedef BucketManager::CompletionType CompletionType;
+		typedef BucketManager::Stats Stats;
+#ifdef __cpp_impl_coroutine
+		typedef BucketManager::Awaitable Awaitable;
+#endif
+
+	public:
+		//************************************
+		// Method:    PartitionedBucket
+		// FullName:  FreshCask::PartitionedBucket::PartitionedBucket
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint32_t partitionCount, must stay the same for the life of the bucket
+		// Parameter: EngineContext & context
+		//************************************
+		PartitionedBucket(uint32_t partitionCount = DefaultPartitions, EngineContext &context = EngineContext::Default())
+			: cache(new LRUCache), context(context), opened(false)
+		{
+			for (uint32_t i = 0; i < (partitionCount > 0 ? partitionCount : 1); i++)
+			{
+				partitions.push_back(std::unique_ptr<BucketManager>(new BucketManager(context)));
+				partitions.back()->ShareCache(cache, i + 1); // one cache, sized for the whole bucket
+			}
+		}
+		~PartitionedBucket() { if (IsOpen()) Close(); }
+
+		PartitionedBucket(const PartitionedBucket&) = delete;
+		PartitionedBucket& operator=(const PartitionedBucket&) = delete;
+
+		//************************************
+		// Method:    Open
+		// FullName:  FreshCask::PartitionedBucket::Open
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Open every partition at once, subdirectories of bucketDir are created
+		//            if missing. Fails on a directory partitioned another way, or not at all.
+		// Parameter: const std::string & bucketDir
+		// Parameter: uint32_t laneCount, per partition
+		//************************************
+		Status Open(const std::string &bucketDir, uint32_t laneCount = DefaultPartitionLanes)
+		{
+			if (IsOpen())
+				RET_BY_SENDER(Status::InvalidArgument("Bucket already open"), "PartitionedBucket::Open()");
+			if (!IsDirExist(bucketDir))
+				RET_BY_SENDER(Status::NotFound("Directory doesn't exist."), "PartitionedBucket::Open()");
+
+			RET_IFNOT_OK(ListDir(bucketDir, [](const std::string &filePath) -> Status {
+				if (EndWith(filePath, DataFile::FileNameSuffix))
+					RET_BY_SENDER(Status::InvalidArgument("Not a partitioned bucket"), "PartitionedBucket::Open()::ProcessFile()");
+				RET_BY_SENDER(Status::OK(), "PartitionedBucket::Open()::ProcessFile()");
+			}), "PartitionedBucket::Open()");
+
+			uint32_t found = 0;
+			RET_IFNOT_OK(ListSubDirs(bucketDir, [&](const std::string &name) -> Status {
+				if (name.compare(0, PartitionDirPrefix.length(), PartitionDirPrefix) == 0) found++;
+				RET_BY_SENDER(Status::OK(), "PartitionedBucket::Open()::ProcessDir()");
+			}), "PartitionedBucket::Open()");
+			if (found != 0 && found != partitions.size())
+				RET_BY_SENDER(Status::InvalidArgument("Partition count doesn't match"), "PartitionedBucket::Open()");
+
+			for (uint32_t i = 0; i < partitions.size(); i++)
+				if (!IsDirExist(partitionDir(bucketDir, i)))
+					RET_IFNOT_OK(MakeDir(partitionDir(bucketDir, i)), "PartitionedBucket::Open()");
+
+			Status ret = forEachPartition([&](uint32_t i) { return partitions[i]->Open(partitionDir(bucketDir, i), laneCount); });
+			if (!ret.IsOK())
+			{
+				for (auto& partition : partitions)
+					if (partition->IsOpen()) partition->Close(false);
+				RET_BY_SENDER(ret, "PartitionedBucket::Open()");
+			}
+
+			opened = true;
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::Open()");
+		}
+
+		bool IsOpen() { return opened; }
+
+		// close every partition, in parallel
+		Status Close(bool makeHintFile = true)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Close()");
+
+			opened = false;
+			RET_BY_SENDER(forEachPartition([&](uint32_t i) { return partitions[i]->Close(makeHintFile); }), "PartitionedBucket::Close()");
+		}
+
+		Status Flush()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Flush()");
+
+			RET_BY_SENDER(forEachPartition([&](uint32_t i) { return partitions[i]->Flush(); }), "PartitionedBucket::Flush()");
+		}
+
+		Status Get(const SmartByteArray& key, SmartByteArray &out)
+		{
+			BucketManager *partition;
+			RET_IFNOT_OK(partitionOf(key, partition), "PartitionedBucket::Get()");
+			RET_BY_SENDER(partition->Get(key, out), "PartitionedBucket::Get()");
+		}
+
+		Status GetPinned(const SmartByteArray& key, PinnableSlice &out)
+		{
+			BucketManager *partition;
+			RET_IFNOT_OK(partitionOf(key, partition), "PartitionedBucket::GetPinned()");
+			RET_BY_SENDER(partition->GetPinned(key, out), "PartitionedBucket::GetPinned()");
+		}
+
+		// keys are handed to their partitions' MultiGet(), the partitions in parallel
+		Status MultiGet(const std::vector<SmartByteArray>& keys, std::vector<SmartByteArray> &values, std::vector<Status> &statuses)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::MultiGet()");
+
+			values.assign(keys.size(), SmartByteArray::Null());
+			statuses.assign(keys.size(), Status::OK());
+
+			std::vector<std::vector<size_t>> groups;
+			splitKeys(keys, groups, statuses);
+
+			RET_BY_SENDER(forEachPartition([&](uint32_t i) -> Status {
+				if (groups[i].empty()) return Status::OK();
+
+				std::vector<SmartByteArray> groupKeys, groupValues;
+				std::vector<Status> groupStatuses;
+				for (auto& index : groups[i]) groupKeys.push_back(keys[index]);
+
+				Status ret = partitions[i]->MultiGet(groupKeys, groupValues, groupStatuses);
+				for (size_t j = 0; ret.IsOK() && j < groups[i].size(); j++)
+				{
+					values[groups[i][j]] = groupValues[j];
+					statuses[groups[i][j]] = groupStatuses[j];
+				}
+				return ret;
+			}), "PartitionedBucket::MultiGet()");
+		}
+
+		Status Put(const SmartByteArray& key, const SmartByteArray &value)
+		{
+			BucketManager *partition;
+			RET_IFNOT_OK(partitionOf(key, partition), "PartitionedBucket::Put()");
+			RET_BY_SENDER(partition->Put(key, value), "PartitionedBucket::Put()");
+		}
+
+		Status Delete(const SmartByteArray& key)
+		{
+			BucketManager *partition;
+			RET_IFNOT_OK(partitionOf(key, partition), "PartitionedBucket::Delete()");
+			RET_BY_SENDER(partition->Delete(key), "PartitionedBucket::Delete()");
+		}
+
+		//************************************
+		// Method:    Write
+		// FullName:  FreshCask::PartitionedBucket::Write
+		// Access:    public
+		// Returns:   Status
+		// Desc:      Apply a batch of puts and deletes. A batch within one partition is
+		//            atomic, else it is split and each part is written atomically on its own.
+		// Parameter: const WriteBatch & batch
+		//************************************
+		Status Write(const WriteBatch& batch)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Write()");
+
+			if (batch.Count() == 0)
+				RET_BY_SENDER(Status::OK(), "PartitionedBucket::Write()");
+
+			std::vector<uint32_t> indexes(batch.Count());
+			bool single = true;
+			for (size_t i = 0; i < batch.Count(); i++)
+			{
+				RET_IFNOT_OK(indexOf(batch.Entries()[i].Key, indexes[i]), "PartitionedBucket::Write()");
+				if (indexes[i] != indexes[0]) single = false;
+			}
+
+			if (single)
+				RET_BY_SENDER(partitions[indexes[0]]->Write(batch), "PartitionedBucket::Write()");
+
+			std::vector<WriteBatch> parts(partitions.size());
+			for (size_t i = 0; i < batch.Count(); i++)
+				parts[indexes[i]].Put(batch.Entries()[i].Key, batch.Entries()[i].Value);
+
+			for (uint32_t i = 0; i < parts.size(); i++)
+				RET_IFNOT_OK(partitions[i]->Write(parts[i]), "PartitionedBucket::Write()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::Write()");
+		}
+
+		void GetAsync(const SmartByteArray& key, SmartByteArray &out, const CompletionType &done)
+		{
+			BucketManager *partition;
+			Status ret = partitionOf(key, partition);
+			if (!ret.IsOK()) return done(ret);
+
+			partition->GetAsync(key, out, done);
+		}
+
+		std::future<Status> GetAsync(const SmartByteArray& key, SmartByteArray &out)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			GetAsync(key, out, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+		void PutAsync(const SmartByteArray& key, const SmartByteArray &value, const CompletionType &done)
+		{
+			BucketManager *partition;
+			Status ret = partitionOf(key, partition);
+			if (!ret.IsOK()) return done(ret);
+
+			partition->PutAsync(key, value, done);
+		}
+
+		std::future<Status> PutAsync(const SmartByteArray& key, const SmartByteArray &value)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			PutAsync(key, value, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+		void DeleteAsync(const SmartByteArray& key, const CompletionType &done)
+		{
+			BucketManager *partition;
+			Status ret = partitionOf(key, partition);
+			if (!ret.IsOK()) return done(ret);
+
+			partition->DeleteAsync(key, done);
+		}
+
+		std::future<Status> DeleteAsync(const SmartByteArray& key)
+		{
+			std::shared_ptr<std::promise<Status>> promise(new std::promise<Status>);
+			DeleteAsync(key, [promise](const Status &s) { promise->set_value(s); });
+			return promise->get_future();
+		}
+
+#ifdef __cpp_impl_coroutine
+		Awaitable GetAwaitable(const SmartByteArray& key, SmartByteArray &out)
+		{
+			return Awaitable([this, key, &out](const CompletionType &done) { GetAsync(key, out, done); });
+		}
+
+		Awaitable PutAwaitable(const SmartByteArray& key, const SmartByteArray &value)
+		{
+			return Awaitable([this, key, value](const CompletionType &done) { PutAsync(key, value, done); });
+		}
+
+		Awaitable DeleteAwaitable(const SmartByteArray& key)
+		{
+			return Awaitable([this, key](const CompletionType &done) { DeleteAsync(key, done); });
+		}
+#endif
+
+		// keys of all partitions, partition by partition
+		Status Enumerate(std::vector<std::string>& out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Enumerate()");
+
+			for (auto& partition : partitions)
+				RET_IFNOT_OK(partition->Enumerate(out), "PartitionedBucket::Enumerate()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::Enumerate()");
+		}
+
+		// partitions one after another, so that the disk reads one file at a time
+		Status ScanLive(const BucketManager::ScanLiveCallbackType &func)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::ScanLive()");
+
+			for (auto& partition : partitions)
+				RET_IFNOT_OK(partition->ScanLive(func), "PartitionedBucket::ScanLive()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::ScanLive()");
+		}
+
+		// merge what merge policy picks in every partition, one after another so that only
+		// one partition's worth of merged files is written at a time
+		Status Merge()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Merge()");
+
+			for (auto& partition : partitions)
+				RET_IFNOT_OK(partition->Merge(), "PartitionedBucket::Merge()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::Merge()");
+		}
+
+		// compact partitions one after another, see Merge()
+		Status Compact()
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::Compact()");
+
+			for (auto& partition : partitions)
+				RET_IFNOT_OK(partition->Compact(), "PartitionedBucket::Compact()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::Compact()");
+		}
+
+		// data files of all partitions, partition by partition: file ids repeat across them
+		Status GetFileUsage(std::vector<DataFileUsage>& out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::GetFileUsage()");
+
+			for (auto& partition : partitions)
+				RET_IFNOT_OK(partition->GetFileUsage(out), "PartitionedBucket::GetFileUsage()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::GetFileUsage()");
+		}
+
+		// debt of all partitions together, each holds back its own writers on its own debt
+		WritePressure GetWritePressure() const
+		{
+			WritePressure pressure;
+			for (auto& partition : partitions)
+			{
+				WritePressure part = partition->GetWritePressure();
+				pressure.DeadBytes += part.DeadBytes;
+				pressure.FileCount += part.FileCount;
+				pressure.CheckpointLag += part.CheckpointLag;
+			}
+			return pressure;
+		}
+
+		void SetCache(uint64_t capacity, CachePolicy::Type policy)
+		{
+			cache->Reset(capacity, policy);
+		}
+
+		//************************************
+		// Method:    ShareCache
+		// FullName:  FreshCask::PartitionedBucket::ShareCache
+		// Access:    public
+		// Returns:   void
+		// Desc:      Cache values in sharedCache, see BucketManager::ShareCache()
+		// Qualifier: While the bucket is closed.
+		// Parameter: const std::shared_ptr<LRUCache> & sharedCache
+		// Parameter: uint32_t firstSpace, partitions take PartitionCount() spaces from it on
+		//************************************
+		void ShareCache(const std::shared_ptr<LRUCache> &sharedCache, uint32_t firstSpace)
+		{
+			cache = sharedCache;
+			for (uint32_t i = 0; i < partitions.size(); i++)
+				partitions[i]->ShareCache(cache, firstSpace + i);
+		}
+
+		bool IsWarmingUp() const
+		{
+			for (auto& partition : partitions)
+				if (partition->IsWarmingUp()) return true;
+			return false;
+		}
+
+		// limits hold for each partition's debt on its own
+		void SetAdmissionLimits(const AdmissionController::Limits& limits)
+		{
+			for (auto& partition : partitions) partition->SetAdmissionLimits(limits);
+		}
+
+		AdmissionController::Stats GetAdmissionStats() const
+		{
+			AdmissionController::Stats stats;
+			for (auto& partition : partitions)
+			{
+				AdmissionController::Stats part = partition->GetAdmissionStats();
+				stats.DelayedWrites += part.DelayedWrites;
+				stats.StoppedWrites += part.StoppedWrites;
+				stats.RejectedWrites += part.RejectedWrites;
+				stats.StallMicros += part.StallMicros;
+			}
+			return stats;
+		}
+
+		Stats GetStats() const
+		{
+			Stats stats = partitions[0]->GetStats();
+			for (size_t i = 1; i < partitions.size(); i++)
+			{
+				Stats part = partitions[i]->GetStats();
+				stats.KeyCount += part.KeyCount;
+				stats.KeydirBytes += part.KeydirBytes;
+				stats.KeydirLookups += part.KeydirLookups;
+				stats.KeydirProbes += part.KeydirProbes;
+				if (part.MaxKeydirProbes > stats.MaxKeydirProbes) stats.MaxKeydirProbes = part.MaxKeydirProbes;
+			}
+			return stats;
+		}
+
+		void SetMergePolicy(const MergePolicy& policy)
+		{
+			for (auto& partition : partitions) partition->SetMergePolicy(policy);
+		}
+
+		size_t PairCount() const
+		{
+			size_t count = 0;
+			for (auto& partition : partitions) count += partition->PairCount();
+			return count;
+		}
+
+		uint64_t GetKeydirMemory() const
+		{
+			uint64_t bytes = 0;
+			for (auto& partition : partitions) bytes += partition->GetKeydirMemory();
+			return bytes;
+		}
+
+		bool CotainsKey(const SmartByteArray& Key)
+		{
+			BucketManager *partition;
+			return partitionOf(Key, partition).IsOK() && partition->CotainsKey(Key);
+		}
+
+		void CotainsKey(const std::vector<SmartByteArray>& keys, std::vector<bool> &out)
+		{
+			out.assign(keys.size(), false);
+			if (!IsOpen()) return;
+
+			std::vector<Status> statuses(keys.size());
+			std::vector<std::vector<size_t>> groups;
+			splitKeys(keys, groups, statuses);
+
+			for (uint32_t i = 0; i < partitions.size(); i++)
+			{
+				std::vector<SmartByteArray> groupKeys;
+				std::vector<bool> groupContains;
+				for (auto& index : groups[i]) groupKeys.push_back(keys[index]);
+
+				partitions[i]->CotainsKey(groupKeys, groupContains);
+				for (size_t j = 0; j < groups[i].size(); j++) out[groups[i][j]] = groupContains[j];
+			}
+		}
+
+		uint32_t PartitionCount() const { return (uint32_t)partitions.size(); }
+
+	private:
+		// partition a key belongs to, by MurmurHash3 of the key
+		Status indexOf(const SmartByteArray& key, uint32_t &out)
+		{
+			HashType hash;
+			RET_IFNOT_OK(HashFunction(key, hash), "PartitionedBucket::indexOf()");
+
+			out = hash % (uint32_t)partitions.size();
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::indexOf()");
+		}
+
+		Status partitionOf(const SmartByteArray& key, BucketManager *&out)
+		{
+			if (!IsOpen())
+				RET_BY_SENDER(Status::IOError("Bucket not open"), "PartitionedBucket::partitionOf()");
+
+			uint32_t index;
+			RET_IFNOT_OK(indexOf(key, index), "PartitionedBucket::partitionOf()");
+			out = partitions[index].get();
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::partitionOf()");
+		}
+
+		// indexes of keys by partition, a key no partition takes gets its status set instead
+		void splitKeys(const std::vector<SmartByteArray>& keys, std::vector<std::vector<size_t>> &groupsOut, std::vector<Status> &statuses)
+		{
+			groupsOut.assign(partitions.size(), std::vector<size_t>());
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				uint32_t index;
+				Status ret = indexOf(keys[i], index);
+				if (ret.IsOK()) groupsOut[index].push_back(i);
+				else statuses[i] = ret;
+			}
+		}
+
+		// run func for every partition on the shared scheduler, the calling thread helps.
+		// Returns the first failure.
+		template <typename Func>
+		Status forEachPartition(Func func)
+		{
+			std::vector<Status> results(partitions.size());
+			std::atomic<uint32_t> next(0);
+			auto work = [&]() {
+				for (uint32_t i; (i = next.fetch_add(1)) < partitions.size(); )
+					results[i] = func(i);
+			};
+
+			TaskGroup helpers;
+			for (size_t i = 1; i < partitions.size(); i++)
+				context.GetTaskScheduler().Submit(work, TaskPriority::Foreground, &helpers);
+			work();
+			helpers.Cancel(); // not started by now, nothing is left for them
+			helpers.Wait();
+
+			for (auto& result : results)
+				if (!result.IsOK()) RET_BY_SENDER(result, "PartitionedBucket::forEachPartition()");
+			RET_BY_SENDER(Status::OK(), "PartitionedBucket::forEachPartition()");
+		}
+
+		static std::string partitionDir(const std::string &bucketDir, uint32_t index)
+		{
+			return bucketDir + "\\" + PartitionDirPrefix + std::to_string(index);
+		}
+
+	private:
+		std::vector<std::unique_ptr<BucketManager>> partitions;
+		std::shared_ptr<LRUCache> cache;
+		EngineContext &context;
+		std::atomic<bool> opened;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_PARTITIONEDBUCKET_HPP__
@@ -3,10 +3,14 @@
 
 #include <map>
 #include <memory>
+#include <algorithm>
 
 #include <Core/FileStream.hpp>
 #include <Core/DataFileEngine.hpp>
 #include <Core/HintFileEngine.hpp>
+#include <Core/WriteSequencer.hpp>
+#include <Core/MergePolicy.hpp>
+#include <Core/EngineContext.hpp>
 
 namespace FreshCask
 {
@@ -17,12 +21,22 @@ namespace FreshCask
 		typedef std::map<uint32_t, std::shared_ptr<DataFileEngine>> DataFileEngineMap;
 
 	public:
-		StorageEngine(std::string bucketDir, HashFile::HashTree& hashTree) 
-			: bucketDir(bucketDir), hashTree(hashTree), lastFileId(0), 
+		// asked for every record found in merge input, false means it's dead and is dropped
+		typedef std::function<bool(const SmartByteArray&, const HashFile::Record&)> LiveCheckType;
+
+		struct Relocation
+		{
+			SmartByteArray Key;
+			HashFile::Record From, To;
+		};
+
+	public:
+		StorageEngine(std::string bucketDir, HashFile::HashTree& hashTree, uint32_t laneCount = DefaultWriteLanes, EngineContext &context = EngineContext::Default()) 
+			: bucketDir(bucketDir), hashTree(hashTree), scheduler(context.GetIOScheduler()), tasks(context.GetTaskScheduler()), files(context.GetFilePool()), engineMapMutex("StorageEngine.EngineMap"), recordBytes(0), checkpointLag(0), fileCount(0), lastFileId(0), 
 #ifndef _M_CEE // fuck C++/CLI!!!
-			dfActiveEngine(std::pair<uint32_t, DataFileEnginePtr>((uint32_t)-1, nullptr)) {}
+			dfActiveEngines(laneCount > 0 ? laneCount : 1, std::pair<uint32_t, DataFileEnginePtr>((uint32_t)-1, nullptr)) {}
 #else
-			dfActiveEngine(std::pair<uint32_t, DataFileEnginePtr>((uint32_t)-1, __nullptr)) {}
+			dfActiveEngines(laneCount > 0 ? laneCount : 1, std::pair<uint32_t, DataFileEnginePtr>((uint32_t)-1, __nullptr)) {}
 #endif
 		~StorageEngine() { Close(true); }
 
@@ -31,49 +45,57 @@ namespace FreshCask
 			if (!IsDirExist(bucketDir))
 				return Status::NotFound("StorageEngine::Open()", "Directory doesn't exist.");
 
+			std::string hintFilePath;
+			std::vector<DataFileEnginePtr> activeFiles;
 			RET_IFNOT_OK(ListDir(bucketDir, [&](const std::string &filePath) -> Status {
 				if (EndWith(filePath, DataFile::FileNameSuffix))
 				{
-					std::shared_ptr<DataFileEngine> engine = std::shared_ptr<DataFileEngine>(new DataFileEngine(filePath));
+					std::shared_ptr<DataFileEngine> engine = std::shared_ptr<DataFileEngine>(new DataFileEngine(filePath, scheduler, &files));
 					RET_IFNOT_OK(engine->Open(), "StorageEngine::Open()::ProcessFile()");
 					dfEngineMap[engine->GetFileId()] = engine;
 
 					uint32_t curFileId = engine->GetFileId();
-					if (engine->GetFileFlag() & DataFile::Flag::ActiveFile)
-						dfActiveEngine = std::pair<uint32_t, DataFileEnginePtr>(curFileId, engine.get());
-
-					if (curFileId > lastFileId) lastFileId = curFileId;
-				}
-				else if (EndWith(filePath, HintFile::FileNameSuffix))
-				{
-					// load hint file
-					HintFileEngine engine(HintFileEngine::OpenMode::Read, filePath);
-					RET_IFNOT_OK(engine.Open(), "StorageEngine::Open()::ProcessFile()");
-
-					while (true)
+					uint8_t flag = engine->GetFileFlag();
+					if ((flag & DataFile::Flag::ActiveFile) && (flag & DataFile::Flag::MergedFile))
 					{
-						HintFile::Record hfRec;
-						Status s = engine.ReadRecord(hfRec);
-
-						if (!s.IsOK())
-						{
-							if (s.IsEndOfFile()) break;
-							else RET_BY_SENDER(s, "StorageEngine::Open()::ProcessFile()");
-						}
-							
-						//HashFile::HashType hash;
-						//RET_IFNOT_OK(HashFile::HashFunction(hfRec.Key, hash), "StorageEngine::Open()::ProcessFile()");
-						hashTree[hfRec.Key] = HashFile::Record(hfRec.Header.DataFileId, hfRec.Header.SizeOfValue, hfRec.Header.OffsetOfValue, hfRec.Header.TimeStamp);
+						// merge didn't finish, its inputs are all still there and its hint file may be torn
+						std::string mergedHintPath = DataFileEngine::GetHintFilePath(filePath);
+						if (IsFileExist(mergedHintPath)) RET_IFNOT_OK(RemoveFile(mergedHintPath), "StorageEngine::Open()::ProcessFile()");
+						RET_IFNOT_OK(engine->Seal(), "StorageEngine::Open()::ProcessFile()");
 					}
+					else if (flag & DataFile::Flag::ActiveFile)
+						activeFiles.push_back(engine.get());
 
-					RET_IFNOT_OK(engine.Close(), "StorageEngine::Open()::ProcessFile()");
-					// delete hint file when re-creation done
-					// RET_IFNOT_OK(RemoveFile(filePath), "StorageEngine::Open()::ProcessFile()");
+					if (curFileId > lastFileId) lastFileId = curFileId;
 				}
+				else if (filePath == genHintFilePath(bucketDir)) // <id>.fcht of merged files are read by replay()
+					hintFilePath = filePath;
 
 				RET_BY_SENDER(Status::OK(), "StorageEngine::Open()::ProcessFile()");
 			}), "StorageEngine::Open()");
 
+			HintFile::CheckpointHeader cpHeader;
+			std::vector<HintFile::Checkpoint> checkpoints;
+			if (!hintFilePath.empty() && !loadHintFile(hintFilePath, cpHeader, checkpoints).IsOK())
+			{
+				// torn or unreadable: start over from the data files, they hold all it did
+				hashTree.clear();
+				cpHeader = HintFile::CheckpointHeader();
+				checkpoints.clear();
+			}
+
+			RET_IFNOT_OK(assignLanes(activeFiles), "StorageEngine::Open()");
+			RET_IFNOT_OK(replay(cpHeader, checkpoints), "StorageEngine::Open()");
+
+			uint64_t totalBytes = 0;
+			for (auto &item : dfEngineMap)
+			{
+				uint32_t bytes;
+				RET_IFNOT_OK(item.second->GetRecordBytes(bytes), "StorageEngine::Open()");
+				totalBytes += bytes;
+			}
+			recordBytes = totalBytes;
+			fileCount = countUnmerged();
 			RET_BY_SENDER(Status::OK(), "StorageEngine::Open()");
 		}
 
@@ -81,24 +103,34 @@ namespace FreshCask
 		{
 			if (dfEngineMap.size() > 0)
 			{
+				if (makeHintFile) RET_IFNOT_OK(CreateHintFile(), "StorageEngine::Close()");
+
 				for (auto &engine : dfEngineMap)
 					RET_IFNOT_OK(engine.second->Close(), "StorageEngine::Close()");
 
 				dfEngineMap.clear();
-				if (makeHintFile) RET_BY_SENDER(CreateHintFile(bucketDir, hashTree), "StorageEngine::Close()");
+				for (auto &lane : dfActiveEngines)
+					lane.first = (uint32_t)-1, lane.second = NULL;
+				recordBytes = 0, fileCount = 0, checkpointLag = 0;
 			}
 
 			// that means already closed
 			RET_BY_SENDER(Status::OK(), "StorageEngine::Close()");
 		}
 
-		Status ReadValue(HashFile::Record hfRec, SmartByteArray &valueOut)
+		Status ReadValue(HashFile::Record hfRec, SmartByteArray &valueOut, IOClass::Type ioClass = IOClass::UserRead)
 		{
-			DataFileEngineMap::iterator it = dfEngineMap.find(hfRec.DataFileId);
-			if (it == dfEngineMap.end())
-				return Status::NotFound("StorageEngine::ReadValue()", "Invalid File ID.");
+			std::shared_ptr<DataFileEngine> engine;
+			{
+				ReadLockGuard lock(engineMapMutex);
+
+				DataFileEngineMap::iterator it = dfEngineMap.find(hfRec.DataFileId);
+				if (it == dfEngineMap.end())
+					return Status::NotFound("StorageEngine::ReadValue()", "Invalid File ID.");
+				engine = it->second;
+			}
 
-			RET_BY_SENDER(it->second->ReadValue(hfRec, valueOut), "StorageEngine::ReadValue()");
+			RET_BY_SENDER(engine->ReadValue(hfRec, valueOut, ioClass), "StorageEngine::ReadValue()");
 		}
 
 		/*Status ReadRecord(HashFile::Record hfRec, DataFile::Record &dfRecOut)
@@ -110,24 +142,738 @@ namespace FreshCask
 			RET_BY_SENDER(it->second->ReadRecord(hfRec, dfRecOut), "StorageEngine::ReadRecord()");
 		}*/
 
-		Status WriteRecord(DataFile::Record dfRec, HashFile::Record &hfRecOut)
+		//************************************
+		// Method:    AppendGather
+		// FullName:  FreshCask::StorageEngine::AppendGather
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Append an encoded frame to the active file of a lane, create a new one
+		//            if it's full. Each lane must be driven by one thread only.
+		// Parameter: uint32_t lane
+		// Parameter: const WriteSegment * segments
+		// Parameter: uint32_t count
+		// Parameter: uint32_t & fileIdOut
+		// Parameter: uint32_t & offsetOut
+		//************************************
+		Status AppendGather(uint32_t lane, const WriteSegment *segments, uint32_t count, uint32_t &fileIdOut, uint32_t &offsetOut)
 		{
-			if (dfActiveEngine.first != -1 && dfActiveEngine.second != nullptr)
+			if (lane >= dfActiveEngines.size())
+				RET_BY_SENDER(Status::InvalidArgument("Invalid lane."), "StorageEngine::AppendGather()");
+
+			uint64_t frameSize = 0;
+			for (uint32_t i = 0; i < count; i++) frameSize += segments[i].Size;
+
+			std::pair<uint32_t, DataFileEnginePtr> &active = dfActiveEngines[lane];
+			if (active.first != -1 && active.second != nullptr)
 			{
-				Status ret = dfActiveEngine.second->WriteRecord(dfRec, hfRecOut);
+				Status ret = active.second->AppendGather(segments, count, offsetOut);
 				if (!ret.IsNoFreeSpace())
-					RET_BY_SENDER(ret, "StorageEngine::WriteRecord()");
+				{
+					if (ret.IsOK()) appended(frameSize, true);
+					fileIdOut = active.first;
+					RET_BY_SENDER(ret, "StorageEngine::AppendGather()");
+				}
 			}
 
-			// create new data file
-			dfEngineMap[lastFileId] = std::shared_ptr<DataFileEngine>(new DataFileEngine(genDataFilePath(++lastFileId)));
-			RET_IFNOT_OK(dfEngineMap[lastFileId]->Create(lastFileId), "StorageEngine::WriteRecord()");
+			RET_IFNOT_OK(createActiveFile(lane), "StorageEngine::AppendGather()");
 
-			dfActiveEngine = std::pair<uint32_t, DataFileEnginePtr>(lastFileId, dfEngineMap[lastFileId].get());
-			RET_BY_SENDER(dfActiveEngine.second->WriteRecord(dfRec, hfRecOut), "StorageEngine::WriteRecord()");
+			fileIdOut = active.first;
+			RET_IFNOT_OK(active.second->AppendGather(segments, count, offsetOut), "StorageEngine::AppendGather()");
+			appended(frameSize, true);
+			RET_BY_SENDER(Status::OK(), "StorageEngine::AppendGather()");
 		}
 
+		// what admission control watches, cheap enough to read on every write
+		uint64_t GetRecordBytes() const { return recordBytes.load(std::memory_order_relaxed); }
+		uint32_t GetFileCount() const { return fileCount.load(std::memory_order_relaxed); } // data files not written by merge
+		uint64_t GetCheckpointLag() const { return checkpointLag.load(std::memory_order_relaxed); } // bytes written since hint file
+
+		//************************************
+		// Method:    MergeFiles
+		// FullName:  FreshCask::StorageEngine::MergeFiles
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Copy records of older files that isLive accepts into new merged files,
+		//            each followed by a hint file. Input files are scanned with large reads
+		//            on up to DefaultMergeThreads threads, each writing its own merged files;
+		//            records are copied byte-for-byte with their checksum where possible.
+		//            Readers and lanes keep running; the caller applies relocationsOut to
+		//            hash tree and then retires the input files.
+		// Parameter: const std::vector<uint32_t> & fileIds, older files only
+		// Parameter: const LiveCheckType & isLive, called from several threads at once
+		// Parameter: std::vector<Relocation> & relocationsOut, deletions carried over included
+		//************************************
+		Status MergeFiles(const std::vector<uint32_t> &fileIds, const LiveCheckType &isLive, std::vector<Relocation> &relocationsOut)
+		{
+			std::vector<std::shared_ptr<DataFileEngine>> inputs;
+			{
+				ReadLockGuard lock(engineMapMutex);
+				for (auto &fileId : fileIds)
+				{
+					DataFileEngineMap::iterator it = dfEngineMap.find(fileId);
+					if (it == dfEngineMap.end() || !(it->second->GetFileFlag() & DataFile::Flag::OlderFile))
+						RET_BY_SENDER(Status::InvalidArgument("Only older files can be merged."), "StorageEngine::MergeFiles()");
+					inputs.push_back(it->second);
+				}
+			}
+
+			size_t threadCount = std::min<size_t>(std::max<uint32_t>(DefaultMergeThreads, 1), inputs.size());
+			std::vector<MergeWorker> workers;
+			workers.reserve(threadCount + 1);
+			for (size_t i = 0; i < threadCount + 1; i++) // the last one writes deletions
+				workers.push_back(MergeWorker(*this));
+
+			std::atomic<size_t> nextInput(0);
+			auto work = [&](MergeWorker &worker) {
+				for (size_t i; worker.Result.IsOK() && (i = nextInput.fetch_add(1)) < inputs.size(); )
+					worker.Result = worker.Merge(*inputs[i], isLive);
+				if (worker.Result.IsOK()) worker.Result = worker.Output.Finish();
+			};
+
+			// helpers run on the shared scheduler, inputs none of them got to are merged here
+			TaskGroup helpers;
+			for (size_t i = 1; i < threadCount; i++)
+				tasks.Submit(std::bind(work, std::ref(workers[i])), TaskPriority::Background, &helpers);
+			if (threadCount > 0) work(workers[0]);
+			helpers.Cancel(); // not started by now, nothing is left for them
+			helpers.Wait();
+
+			// the same key may be deleted in inputs merged by different threads
+			MergeWorker &last = workers.back();
+			std::map<SmartByteArray, HashFile::Record> tombstones;
+			for (auto &worker : workers)
+				for (auto &item : worker.Tombstones)
+				{
+					std::map<SmartByteArray, HashFile::Record>::iterator it = tombstones.find(item.first);
+					if (it == tombstones.end() || it->second.Sequence <= item.second.Sequence) tombstones[item.first] = item.second;
+				}
+
+			for (auto &item : tombstones)
+			{
+				if (!last.Result.IsOK()) break;
+
+				Relocation relocation;
+				relocation.Key = item.first;
+				relocation.From = item.second;
+				last.Result = last.Output.Append(item.first, SmartByteArray::Null(), item.second, relocation.To);
+				last.Relocations.push_back(relocation);
+			}
+			if (last.Result.IsOK()) last.Result = last.Output.Finish();
+
+			for (auto &worker : workers)
+			{
+				if (!worker.Result.IsOK())
+				{
+					// nothing refers to merged files yet, drop all of them
+					std::vector<uint32_t> created;
+					for (auto &item : workers) created.insert(created.end(), item.Output.GetCreatedFiles().begin(), item.Output.GetCreatedFiles().end());
+					RetireFiles(created);
+					RET_BY_SENDER(worker.Result, "StorageEngine::MergeFiles()");
+				}
+			}
+
+			for (auto &worker : workers)
+				relocationsOut.insert(relocationsOut.end(), worker.Relocations.begin(), worker.Relocations.end());
+			RET_BY_SENDER(Status::OK(), "StorageEngine::MergeFiles()");
+		}
+
+		// every data file as of now in id order, one merged away meanwhile stays on disk while held
+		void GetFiles(std::vector<std::shared_ptr<DataFileEngine>> &out)
+		{
+			ReadLockGuard lock(engineMapMutex);
+			for (auto &item : dfEngineMap) out.push_back(item.second);
+		}
+
+		//************************************
+		// Method:    ScanFiles
+		// FullName:  FreshCask::StorageEngine::ScanFiles
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Walk the records of files, file by file and each from front to back with
+		//            ScanBufferSize reads. Records appended after a file's walk began are
+		//            left out.
+		// Parameter: const std::vector<std::shared_ptr<DataFileEngine>> & files, from GetFiles()
+		// Parameter: const DataFileEngine::RawScanCallbackType & func, a status other than OK
+		//            stops the walk and is returned
+		// Parameter: IOClass::Type ioClass
+		//************************************
+		Status ScanFiles(const std::vector<std::shared_ptr<DataFileEngine>> &files, const DataFileEngine::RawScanCallbackType &func, IOClass::Type ioClass)
+		{
+			for (auto &file : files)
+			{
+				uint32_t endOffset;
+				RET_IFNOT_OK(file->ScanRaw(0, func, endOffset, ioClass), "StorageEngine::ScanFiles()");
+			}
+			RET_BY_SENDER(Status::OK(), "StorageEngine::ScanFiles()");
+		}
+
+		//************************************
+		// Method:    GetOldestSequence
+		// FullName:  FreshCask::StorageEngine::GetOldestSequence
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Lowest sequence of any record in the data files other than excluded, so a
+		//            deletion below it can't hide an older value in one of them. A lane's file
+		//            starts with its lowest, a merged file's hint file has them all; both are
+		//            looked up once per file, an empty active file counts as newer than all.
+		// Parameter: const std::vector<uint32_t> & excluded
+		// Parameter: uint64_t & oldestOut, UINT64_MAX if those files hold no record
+		//************************************
+		Status GetOldestSequence(const std::vector<uint32_t> &excluded, uint64_t &oldestOut)
+		{
+			std::vector<std::pair<uint32_t, std::shared_ptr<DataFileEngine>>> files;
+			{
+				ReadLockGuard lock(engineMapMutex);
+				for (auto &item : dfEngineMap)
+					if (std::find(excluded.begin(), excluded.end(), item.first) == excluded.end()) files.push_back(item);
+			}
+
+			oldestOut = UINT64_MAX;
+			for (auto &item : files)
+			{
+				uint64_t oldest;
+				RET_IFNOT_OK(getOldestSequence(item.first, *item.second, oldest), "StorageEngine::GetOldestSequence()");
+				oldestOut = std::min(oldestOut, oldest);
+			}
+			RET_BY_SENDER(Status::OK(), "StorageEngine::GetOldestSequence()");
+		}
+
+		// ids of sealed data files, the candidates for MergeFiles()
+		void GetOlderFileIds(std::vector<uint32_t> &out)
+		{
+			ReadLockGuard lock(engineMapMutex);
+			for (auto &item : dfEngineMap)
+				if (item.second->GetFileFlag() & DataFile::Flag::OlderFile) out.push_back(item.first);
+		}
+
+		// size of every data file, LiveBytes is left for the owner of hash tree to fill in
+		Status GetFileUsage(std::vector<DataFileUsage> &out)
+		{
+			ReadLockGuard lock(engineMapMutex);
+			for (auto &item : dfEngineMap)
+			{
+				DataFileUsage usage;
+				uint32_t recordBytes;
+				RET_IFNOT_OK(item.second->GetRecordBytes(recordBytes), "StorageEngine::GetFileUsage()");
+
+				usage.FileId = item.first;
+				usage.IsOlder = (item.second->GetFileFlag() & DataFile::Flag::OlderFile) != 0;
+				usage.TotalBytes = recordBytes;
+				out.push_back(usage);
+			}
+
+			RET_BY_SENDER(Status::OK(), "StorageEngine::GetFileUsage()");
+		}
+
+		//************************************
+		// Method:    RetireFiles
+		// FullName:  FreshCask::StorageEngine::RetireFiles
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Drop merged away files, each is removed from disk once the last reader
+		//            holding it is done. Hash tree and hint file must not refer to them.
+		// Parameter: const std::vector<uint32_t> & fileIds
+		//************************************
+		Status RetireFiles(const std::vector<uint32_t> &fileIds)
+		{
+			std::vector<std::shared_ptr<DataFileEngine>> retired; // closed and removed once the lock is let go
+			WriteLockGuard lock(engineMapMutex);
+			for (auto &fileId : fileIds)
+			{
+				DataFileEngineMap::iterator it = dfEngineMap.find(fileId);
+				if (it == dfEngineMap.end()) continue;
+
+				uint32_t bytes;
+				if (it->second->GetRecordBytes(bytes).IsOK()) recordBytes -= bytes;
+
+				it->second->MarkObsolete();
+				retired.push_back(std::move(it->second));
+				dfEngineMap.erase(it);
+
+				std::lock_guard<std::mutex> sequenceLock(sequenceMutex);
+				oldestSequences.erase(fileId);
+			}
+
+			fileCount = countUnmerged();
+			RET_BY_SENDER(Status::OK(), "StorageEngine::RetireFiles()");
+		}
+
+		// seal the active file of a lane, the lane starts a new one on next write.
+		// Must run while holding the lane, see AsyncWriter, or while every lane is parked.
+		Status SealLane(uint32_t lane)
+		{
+			if (lane >= dfActiveEngines.size())
+				RET_BY_SENDER(Status::InvalidArgument("Invalid lane."), "StorageEngine::SealLane()");
+
+			std::pair<uint32_t, DataFileEnginePtr> &active = dfActiveEngines[lane];
+			if (active.first != -1 && active.second != nullptr)
+			{
+				RET_IFNOT_OK(active.second->Seal(), "StorageEngine::SealLane()");
+				active.first = (uint32_t)-1, active.second = NULL;
+			}
+
+			RET_BY_SENDER(Status::OK(), "StorageEngine::SealLane()");
+		}
+
+		//************************************
+		// Method:    CreateHintFile
+		// FullName:  FreshCask::StorageEngine::CreateHintFile
+		// Access:    public 
+		// Returns:   Status
+		// Desc:      Dump hash tree to hint file, along with current position of every lane.
+		//            No lane may be writing meanwhile.
+		//************************************
+		Status CreateHintFile()
+		{
+			HintFile::CheckpointHeader cpHeader;
+			std::vector<HintFile::Checkpoint> checkpoints;
+
+			checkpointLag = 0; // lanes are parked
+			cpHeader.LastSequence = sequencer.GetLastSequence();
+			{
+				ReadLockGuard lock(engineMapMutex);
+				cpHeader.LastFileId = lastFileId;
+			}
+
+			for (auto &lane : dfActiveEngines)
+			{
+				if (lane.first == -1 || lane.second == nullptr) continue;
+
+				HintFile::Checkpoint checkpoint(lane.first, 0);
+				RET_IFNOT_OK(lane.second->GetWriteOffset(checkpoint.OffsetOfRecord), "StorageEngine::CreateHintFile()");
+				checkpoints.push_back(checkpoint);
+			}
+
+			RET_BY_SENDER(CreateHintFile(bucketDir, hashTree, cpHeader, checkpoints, scheduler), "StorageEngine::CreateHintFile()");
+		}
+
+		uint32_t GetLaneCount() { return (uint32_t)dfActiveEngines.size(); }
+		WriteSequencer& GetSequencer() { return sequencer; }
+
 	private:
+		// older and active files, those merge hasn't written and can still reduce to fewer;
+		// engineMapMutex must be held, or the engine not shared yet
+		uint32_t countUnmerged()
+		{
+			uint32_t count = 0;
+			for (auto &item : dfEngineMap)
+				if (!(item.second->GetFileFlag() & DataFile::Flag::MergedFile)) count++;
+			return count;
+		}
+
+		Status getOldestSequence(uint32_t fileId, DataFileEngine &engine, uint64_t &oldestOut)
+		{
+			{
+				std::lock_guard<std::mutex> lock(sequenceMutex);
+				std::map<uint32_t, uint64_t>::iterator it = oldestSequences.find(fileId);
+				if (it != oldestSequences.end())
+				{
+					oldestOut = it->second;
+					RET_BY_SENDER(Status::OK(), "StorageEngine::getOldestSequence()");
+				}
+			}
+
+			oldestOut = UINT64_MAX;
+			uint8_t flag = engine.GetFileFlag();
+			auto lowest = [&](const SmartByteArray&, const HashFile::Record &hfRec) -> Status {
+				oldestOut = std::min(oldestOut, hfRec.Sequence);
+				RET_BY_SENDER(Status::OK(), "StorageEngine::getOldestSequence()::Lowest()");
+			};
+
+			uint32_t endOffset;
+			if (flag & DataFile::Flag::MergedFile)
+			{
+				if (!replayMergedHint(fileId, lowest).IsOK())
+					RET_IFNOT_OK(engine.ScanRaw(0, [&](const SmartByteArray &key, const HashFile::Record &hfRec, const Byte*, const Byte*, uint32_t) -> Status {
+						return lowest(key, hfRec);
+					}, endOffset, IOClass::Merge), "StorageEngine::getOldestSequence()");
+			}
+			else
+			{
+				// stopped right after the first record
+				Status ret = engine.Scan(0, [&](const SmartByteArray&, const HashFile::Record &hfRec) -> Status {
+					oldestOut = hfRec.Sequence;
+					return Status::EndOfFile("First record read.");
+				}, endOffset);
+				if (!ret.IsOK() && !ret.IsEndOfFile()) RET_BY_SENDER(ret, "StorageEngine::getOldestSequence()");
+			}
+
+			// an active file without records yet may still get its first one
+			if (oldestOut != UINT64_MAX || !(flag & DataFile::Flag::ActiveFile))
+			{
+				std::lock_guard<std::mutex> lock(sequenceMutex);
+				oldestSequences[fileId] = oldestOut;
+			}
+			RET_BY_SENDER(Status::OK(), "StorageEngine::getOldestSequence()");
+		}
+
+		Status createActiveFile(uint32_t lane)
+		{
+			std::shared_ptr<DataFileEngine> engine;
+			RET_IFNOT_OK(createDataFile(DataFile::Flag::ActiveFile, engine), "StorageEngine::createActiveFile()");
+
+			dfActiveEngines[lane] = std::pair<uint32_t, DataFileEnginePtr>(engine->GetFileId(), engine.get());
+			RET_BY_SENDER(Status::OK(), "StorageEngine::createActiveFile()");
+		}
+
+		Status createDataFile(uint8_t flag, std::shared_ptr<DataFileEngine> &engineOut)
+		{
+			uint32_t fileId;
+			{
+				WriteLockGuard lock(engineMapMutex);
+				fileId = ++lastFileId;
+			}
+
+			std::shared_ptr<DataFileEngine> engine(new DataFileEngine(genDataFilePath(fileId), scheduler, &files));
+			RET_IFNOT_OK(engine->Create(fileId, flag), "StorageEngine::createDataFile()");
+
+			WriteLockGuard lock(engineMapMutex);
+			dfEngineMap[fileId] = engine;
+			fileCount = countUnmerged();
+			engineOut = engine;
+			RET_BY_SENDER(Status::OK(), "StorageEngine::createDataFile()");
+		}
+
+		// merged files being written by MergeFiles(), rolls over at MaxFileSize. Records are
+		// gathered in a large buffer, a merged file is read only after Finish()
+		class MergeOutput
+		{
+		public:
+			MergeOutput(StorageEngine &storage) : storage(storage), fileOffset(0) {}
+
+			// copy a record as it is on disk, checksum included
+			Status AppendRaw(const SmartByteArray &key, const HashFile::Record &hfRec, const Byte *raw, uint32_t rawSize, HashFile::Record &hfRecOut)
+			{
+				uint32_t offset;
+				RET_IFNOT_OK(reserve(rawSize, offset), "StorageEngine::MergeOutput::AppendRaw()");
+
+				buffer.insert(buffer.end(), raw, raw + rawSize);
+				RET_BY_SENDER(appended(key, hfRec, offset, hfRecOut), "StorageEngine::MergeOutput::AppendRaw()");
+			}
+
+			// encode a record again (deletions, batch entries, files before 1.2), sequence and time stamp kept
+			Status Append(const SmartByteArray &key, const SmartByteArray &value, const HashFile::Record &hfRec, HashFile::Record &hfRecOut)
+			{
+				WriteBatch::Entry entry(key, value);
+				DataFile::RecordHeader header = DataFileEngine::MakeRecordHeader(&entry, 1, hfRec.TimeStamp);
+				header.Sequence = hfRec.Sequence; // a copy, not a new write
+
+				Byte prefix[DataFileEngine::RecordPrefixSize];
+				DataFileEngine::EncodePrefix(header, DataFileEngine::GetBodyCRC(entry), prefix);
+
+				uint32_t offset;
+				RET_IFNOT_OK(reserve(DataFileEngine::GetRecordSize(key.Size(), value.Size()), offset), "StorageEngine::MergeOutput::Append()");
+
+				buffer.insert(buffer.end(), prefix, prefix + DataFileEngine::RecordPrefixSize);
+				buffer.insert(buffer.end(), key.Data(), key.Data() + key.Size());
+				buffer.insert(buffer.end(), value.Data(), value.Data() + value.Size());
+				RET_BY_SENDER(appended(key, hfRec, offset, hfRecOut), "StorageEngine::MergeOutput::Append()");
+			}
+
+			// write hint file of current merged file and seal it
+			Status Finish()
+			{
+				if (current == nullptr)
+					RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::Finish()");
+
+				RET_IFNOT_OK(flush(), "StorageEngine::MergeOutput::Finish()");
+				uint64_t hintFileSize = sizeof(HintFile::Header);
+				for (auto &item : hints) hintFileSize += sizeof(HintFile::RecordHeader) + item.first.Size();
+				storage.scheduler.Acquire(IOClass::Merge, hintFileSize);
+
+				HintFileEngine engine(HintFileEngine::OpenMode::Write, DataFileEngine::GetHintFilePath(storage.genDataFilePath(current->GetFileId())));
+				RET_IFNOT_OK(engine.Open(), "StorageEngine::MergeOutput::Finish()");
+				for (auto &item : hints)
+				{
+					HintFile::Record hfRec(item.first);
+					hfRec.Header.TimeStamp = item.second.TimeStamp;
+					hfRec.Header.SizeOfValue = item.second.SizeOfValue;
+					hfRec.Header.OffsetOfValue = item.second.OffsetOfValue;
+					hfRec.Header.DataFileId = item.second.DataFileId;
+					hfRec.Header.Sequence = item.second.Sequence;
+					RET_IFNOT_OK(engine.WriteRecord(hfRec), "StorageEngine::MergeOutput::Finish()");
+				}
+				RET_IFNOT_OK(engine.WriteEnd(), "StorageEngine::MergeOutput::Finish()");
+				RET_IFNOT_OK(engine.Close(), "StorageEngine::MergeOutput::Finish()");
+
+				// sealed only now, so a merged file without complete hint file is never taken as done
+				RET_IFNOT_OK(current->Seal(), "StorageEngine::MergeOutput::Finish()");
+				hints.clear();
+				current.reset();
+				RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::Finish()");
+			}
+
+			const std::vector<uint32_t>& GetCreatedFiles() const { return created; }
+
+		private:
+			Status reserve(uint32_t size, uint32_t &offsetOut)
+			{
+				if (current == nullptr || (uint64_t)fileOffset + buffer.size() + size > DataFile::MaxFileSize)
+				{
+					RET_IFNOT_OK(Finish(), "StorageEngine::MergeOutput::reserve()");
+					RET_IFNOT_OK(storage.createDataFile(DataFile::Flag::ActiveFile | DataFile::Flag::MergedFile, current), "StorageEngine::MergeOutput::reserve()");
+					created.push_back(current->GetFileId());
+					RET_IFNOT_OK(current->GetWriteOffset(fileOffset), "StorageEngine::MergeOutput::reserve()");
+				}
+				else if (buffer.size() + size > DataFile::MergeWriteBufferSize)
+					RET_IFNOT_OK(flush(), "StorageEngine::MergeOutput::reserve()");
+
+				offsetOut = fileOffset + (uint32_t)buffer.size();
+				RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::reserve()");
+			}
+
+			Status appended(const SmartByteArray &key, const HashFile::Record &hfRec, uint32_t offset, HashFile::Record &hfRecOut)
+			{
+				hfRecOut = HashFile::Record(current->GetFileId(), hfRec.SizeOfValue, offset + DataFileEngine::RecordPrefixSize + key.Size(), hfRec.TimeStamp, hfRec.Sequence);
+				hints.push_back(std::make_pair(key, hfRecOut));
+				RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::appended()");
+			}
+
+			Status flush()
+			{
+				if (buffer.empty())
+					RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::flush()");
+
+				uint32_t offset;
+				WriteSegment segment(buffer.data(), (uint32_t)buffer.size());
+				storage.scheduler.Acquire(IOClass::Merge, buffer.size());
+				RET_IFNOT_OK(current->AppendGather(&segment, 1, offset), "StorageEngine::MergeOutput::flush()");
+				if (offset != fileOffset)
+					RET_BY_SENDER(Status::Corrupted("Merged file was appended to by someone else."), "StorageEngine::MergeOutput::flush()");
+
+				fileOffset += (uint32_t)buffer.size();
+				storage.appended(buffer.size(), false);
+				buffer.clear();
+				RET_BY_SENDER(Status::OK(), "StorageEngine::MergeOutput::flush()");
+			}
+
+		private:
+			StorageEngine &storage;
+			std::shared_ptr<DataFileEngine> current;
+			uint32_t fileOffset; // where buffer goes in current
+			std::vector<Byte> buffer;
+			std::vector<std::pair<SmartByteArray, HashFile::Record>> hints;
+			std::vector<uint32_t> created;
+		};
+
+		// one merge thread: its input files go to its own merged files
+		struct MergeWorker
+		{
+			MergeOutput Output;
+			std::vector<Relocation> Relocations;
+			std::map<SmartByteArray, HashFile::Record> Tombstones; // latest deletion per key, written last
+			Status Result;
+
+			MergeWorker(StorageEngine &storage) : Output(storage) {}
+
+			// an input is merged whole or not at all: ScanRaw() stops quietly at a torn or damaged
+			// record, and the input is deleted once merged while records past it still count
+			Status Merge(DataFileEngine &input, const LiveCheckType &isLive)
+			{
+				uint32_t recordBytes, endOffset;
+				RET_IFNOT_OK(input.GetRecordBytes(recordBytes), "StorageEngine::MergeWorker::Merge()");
+				RET_IFNOT_OK(input.ScanRaw(0, [&](const SmartByteArray &key, const HashFile::Record &hfRec, const Byte *value, const Byte *raw, uint32_t rawSize) -> Status {
+					if (!isLive(key, hfRec))
+						RET_BY_SENDER(Status::OK(), "StorageEngine::MergeWorker::Copy()");
+
+					if (hfRec.SizeOfValue == 0)
+					{
+						std::map<SmartByteArray, HashFile::Record>::iterator it = Tombstones.find(key);
+						if (it == Tombstones.end() || it->second.Sequence <= hfRec.Sequence) Tombstones[key] = hfRec;
+						RET_BY_SENDER(Status::OK(), "StorageEngine::MergeWorker::Copy()");
+					}
+
+					Relocation relocation;
+					relocation.Key = key;
+					relocation.From = hfRec;
+					Status ret = raw != nullptr ? Output.AppendRaw(key, hfRec, raw, rawSize, relocation.To)
+						: Output.Append(key, SmartByteArray::Borrow((BytePtr)value, hfRec.SizeOfValue), hfRec, relocation.To);
+					RET_IFNOT_OK(ret, "StorageEngine::MergeWorker::Copy()");
+
+					Relocations.push_back(relocation);
+					RET_BY_SENDER(Status::OK(), "StorageEngine::MergeWorker::Copy()");
+				}, endOffset, IOClass::Merge), "StorageEngine::MergeWorker::Merge()");
+
+				if (endOffset != sizeof(DataFile::Header) + recordBytes)
+					RET_BY_SENDER(Status::Corrupted("Data file " + std::to_string(input.GetFileId()) + " has a damaged record, not merged."), "StorageEngine::MergeWorker::Merge()");
+				RET_BY_SENDER(Status::OK(), "StorageEngine::MergeWorker::Merge()");
+			}
+		};
+
+		//************************************
+		// Method:    loadHintFile
+		// FullName:  FreshCask::StorageEngine::loadHintFile
+		// Access:    private 
+		// Returns:   Status
+		// Desc:      Fill hash tree from the bucket's hint file and get its checkpoints
+		// Parameter: const std::string & hintFilePath
+		// Parameter: HintFile::CheckpointHeader & cpHeaderOut
+		// Parameter: std::vector<HintFile::Checkpoint> & checkpointsOut
+		//************************************
+		Status loadHintFile(const std::string &hintFilePath, HintFile::CheckpointHeader &cpHeaderOut, std::vector<HintFile::Checkpoint> &checkpointsOut)
+		{
+			HintFileEngine engine(HintFileEngine::OpenMode::Read, hintFilePath);
+			RET_IFNOT_OK(engine.Open(), "StorageEngine::loadHintFile()");
+
+			while (true)
+			{
+				HintFile::Record hfRec;
+				Status ret = engine.ReadRecord(hfRec);
+
+				if (!ret.IsOK())
+				{
+					if (ret.IsEndOfFile()) break;
+					else RET_BY_SENDER(ret, "StorageEngine::loadHintFile()");
+				}
+
+				hashTree[std::move(hfRec.Key)] = HashFile::Record(hfRec.Header.DataFileId, hfRec.Header.SizeOfValue, hfRec.Header.OffsetOfValue, hfRec.Header.TimeStamp, hfRec.Header.Sequence);
+			}
+
+			// hint files without checkpoint were always written on a clean close
+			if (!engine.GetCheckpoint(cpHeaderOut, checkpointsOut))
+			{
+				cpHeaderOut.LastFileId = lastFileId;
+				checkpointsOut.clear();
+			}
+
+			RET_BY_SENDER(engine.Close(), "StorageEngine::loadHintFile()");
+		}
+
+		//************************************
+		// Method:    assignLanes
+		// FullName:  FreshCask::StorageEngine::assignLanes
+		// Access:    private 
+		// Returns:   Status
+		// Desc:      Hand active files left by last run to lanes. Files of an older version,
+		//            and those beyond lane count, are sealed as older files.
+		// Parameter: std::vector<DataFileEnginePtr> & activeFiles
+		//************************************
+		Status assignLanes(std::vector<DataFileEnginePtr> &activeFiles)
+		{
+			std::sort(activeFiles.begin(), activeFiles.end(), [](DataFileEnginePtr lhs, DataFileEnginePtr rhs) {
+				return lhs->GetFileId() < rhs->GetFileId();
+			});
+
+			size_t lane = 0;
+			for (auto &engine : activeFiles)
+			{
+				if (engine->GetMinorVersion() == CurrentMinorVersion && lane < dfActiveEngines.size())
+					dfActiveEngines[lane++] = std::pair<uint32_t, DataFileEnginePtr>(engine->GetFileId(), engine);
+				else
+					RET_IFNOT_OK(engine->Seal(), "StorageEngine::assignLanes()");
+			}
+
+			RET_BY_SENDER(Status::OK(), "StorageEngine::assignLanes()");
+		}
+
+		//************************************
+		// Method:    replay
+		// FullName:  FreshCask::StorageEngine::replay
+		// Access:    private 
+		// Returns:   Status
+		// Desc:      Apply records written after the hint file checkpoints to hash tree. Lanes
+		//            interleave their writes, so for each key the highest sequence wins,
+		//            deletions included. A torn tail of a lane's active file is cut off.
+		//            Merged files keep the sequence of what they copied, so they replay like
+		//            any other file, from their own hint file when it's there.
+		// Parameter: const HintFile::CheckpointHeader & cpHeader
+		// Parameter: const std::vector<HintFile::Checkpoint> & checkpoints
+		//************************************
+		Status replay(const HintFile::CheckpointHeader &cpHeader, const std::vector<HintFile::Checkpoint> &checkpoints)
+		{
+			std::map<uint32_t, uint32_t> startOffsets;
+			for (auto &cp : checkpoints)
+				startOffsets[cp.DataFileId] = cp.OffsetOfRecord;
+
+			uint64_t lastSequence = cpHeader.LastSequence;
+			std::map<SmartByteArray, uint64_t> tombstones; // sequence of deletions seen so far
+
+			// records before 1.2 all have sequence 0, so ties go to the one scanned later
+			auto apply = [&](const SmartByteArray &key, const HashFile::Record &hfRec) -> Status {
+				if (hfRec.Sequence > lastSequence) lastSequence = hfRec.Sequence;
+
+				auto tomb = tombstones.find(key);
+				if (tomb != tombstones.end() && tomb->second > hfRec.Sequence)
+					RET_BY_SENDER(Status::OK(), "StorageEngine::replay()::Apply()");
+
+				HashFile::HashTree::iterator it = hashTree.find(key);
+				if (it != hashTree.end() && it->second.Sequence > hfRec.Sequence)
+					RET_BY_SENDER(Status::OK(), "StorageEngine::replay()::Apply()");
+
+				if (hfRec.SizeOfValue > 0) hashTree[key] = hfRec;
+				else
+				{
+					if (it != hashTree.end()) hashTree.erase(it);
+					tombstones[key] = hfRec.Sequence;
+				}
+				RET_BY_SENDER(Status::OK(), "StorageEngine::replay()::Apply()");
+			};
+
+			for (auto &item : dfEngineMap)
+			{
+				if (item.second->GetMinorVersion() < 1) continue; // 1.0 files are covered by hint file
+
+				std::map<uint32_t, uint32_t>::iterator cp = startOffsets.find(item.first);
+				if (cp == startOffsets.end() && item.first <= cpHeader.LastFileId) continue;
+
+				if ((item.second->GetFileFlag() & DataFile::Flag::MergedFile) && replayMergedHint(item.first, apply).IsOK())
+					continue;
+
+				uint32_t startOffset = cp != startOffsets.end() ? cp->second : 0, endOffset, fileSize;
+				RET_IFNOT_OK(item.second->Scan(startOffset, apply, endOffset), "StorageEngine::replay()");
+
+				if (isLaneFile(item.first))
+				{
+					RET_IFNOT_OK(item.second->GetWriteOffset(fileSize), "StorageEngine::replay()");
+					if (endOffset < fileSize) RET_IFNOT_OK(item.second->Truncate(endOffset), "StorageEngine::replay()");
+				}
+			}
+
+			sequencer.Reset(lastSequence);
+			RET_BY_SENDER(Status::OK(), "StorageEngine::replay()");
+		}
+
+		// a merged file's hint holds every record in it, tombstones included
+		Status replayMergedHint(uint32_t fileId, const DataFileEngine::ScanCallbackType &apply)
+		{
+			std::vector<std::pair<SmartByteArray, HashFile::Record>> records;
+			{
+				HintFileEngine engine(HintFileEngine::OpenMode::Read, DataFileEngine::GetHintFilePath(genDataFilePath(fileId)));
+				RET_IFNOT_OK(engine.Open(), "StorageEngine::replayMergedHint()");
+
+				while (true)
+				{
+					HintFile::Record hfRec;
+					Status ret = engine.ReadRecord(hfRec);
+					if (ret.IsEndOfFile()) break;
+					RET_IFNOT_OK(ret, "StorageEngine::replayMergedHint()");
+
+					if (hfRec.Header.DataFileId != fileId)
+						RET_BY_SENDER(Status::InvalidArgument("Hint file doesn't match data file."), "StorageEngine::replayMergedHint()");
+					records.push_back(std::make_pair(hfRec.Key, HashFile::Record(fileId, hfRec.Header.SizeOfValue, hfRec.Header.OffsetOfValue, hfRec.Header.TimeStamp, hfRec.Header.Sequence)));
+				}
+				RET_IFNOT_OK(engine.Close(), "StorageEngine::replayMergedHint()");
+			}
+
+			// applied only once the whole hint file is read, a bad one falls back to Scan()
+			for (auto &item : records)
+				RET_IFNOT_OK(apply(item.first, item.second), "StorageEngine::replayMergedHint()");
+			RET_BY_SENDER(Status::OK(), "StorageEngine::replayMergedHint()");
+		}
+
+		void appended(uint64_t bytes, bool byLane)
+		{
+			recordBytes.fetch_add(bytes, std::memory_order_relaxed);
+			if (byLane) checkpointLag.fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		bool isLaneFile(uint32_t fileId)
+		{
+			for (auto &lane : dfActiveEngines)
+				if (lane.first == fileId && lane.second != nullptr) return true;
+			return false;
+		}
+
 		std::string genDataFilePath(uint32_t fileId)
 		{
 			std::stringstream stream;
@@ -139,22 +885,38 @@ namespace FreshCask
 		}
 
 	public:
-		static Status CreateHintFile(const std::string& bucketDir, const HashFile::HashTree &hashTree)
+		// written aside and swapped in once on disk: a crash leaves either the old hint file or
+		// the new one, never a torn one the data files it covers may already be gone behind
+		static Status CreateHintFile(const std::string& bucketDir, const HashFile::HashTree &hashTree, const HintFile::CheckpointHeader &cpHeader, const std::vector<HintFile::Checkpoint> &checkpoints, IOScheduler &scheduler = IOScheduler::Default())
 		{
-			HintFileEngine engine(HintFileEngine::OpenMode::Write, genHintFilePath(bucketDir));
+			std::string tempPath = genHintFilePath(bucketDir) + HintFile::TempFileNameSuffix;
+			HintFileEngine engine(HintFileEngine::OpenMode::Write, tempPath);
+			engine.SetCheckpoint(cpHeader, checkpoints);
 			RET_IFNOT_OK(engine.Open(), "StorageEngine::CreateHintFile()");
 
+			uint64_t unscheduled = sizeof(HintFile::Header);
 			for (auto& item : hashTree)
 			{
+				unscheduled += sizeof(HintFile::RecordHeader) + item.first.Size();
+				if (unscheduled >= DataFile::ScanBufferSize)
+				{
+					scheduler.Acquire(IOClass::Checkpoint, unscheduled);
+					unscheduled = 0;
+				}
+
 				HintFile::Record hfRec(item.first);
 				hfRec.Header.TimeStamp = item.second.TimeStamp;
 				hfRec.Header.SizeOfValue = item.second.SizeOfValue;
 				hfRec.Header.OffsetOfValue = item.second.OffsetOfValue;
 				hfRec.Header.DataFileId = item.second.DataFileId;
+				hfRec.Header.Sequence = item.second.Sequence;
 				RET_IFNOT_OK(engine.WriteRecord(hfRec), "StorageEngine::CreateHintFile()");
 			}
 
-			RET_BY_SENDER(engine.Close(), "StorageEngine::CreateHintFile()");
+			RET_IFNOT_OK(engine.WriteEnd(), "StorageEngine::CreateHintFile()");
+			RET_IFNOT_OK(engine.Sync(), "StorageEngine::CreateHintFile()");
+			RET_IFNOT_OK(engine.Close(), "StorageEngine::CreateHintFile()");
+			RET_BY_SENDER(RenameFile(tempPath, genHintFilePath(bucketDir), true), "StorageEngine::CreateHintFile()");
 		}
 
 		static std::string genHintFilePath(const std::string &bucketDir)
@@ -171,10 +933,20 @@ namespace FreshCask
 	private:
 		std::string bucketDir;
 		HashFile::HashTree& hashTree;
+		IOScheduler &scheduler;
+		TaskScheduler &tasks;
+		FilePool &files; // older data files hold handles only as long as it lets them
 
 		DataFileEngineMap dfEngineMap;
-		std::pair<uint32_t, DataFileEnginePtr> dfActiveEngine;
+		RWMutex engineMapMutex; // guards dfEngineMap and lastFileId, lanes create files concurrently, readers look files up
+		std::atomic<uint64_t> recordBytes, checkpointLag;
+		std::atomic<uint32_t> fileCount;
+		std::vector<std::pair<uint32_t, DataFileEnginePtr>> dfActiveEngines; // one per lane
 		uint32_t lastFileId;
+		WriteSequencer sequencer;
+
+		std::mutex sequenceMutex;
+		std::map<uint32_t, uint64_t> oldestSequences; // per data file, see GetOldestSequence()
 	};
 } // namespace FreshCask
 #endif // __CORE_STORAGEENGINE_HPP__
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __CORE_WARMFILE_H__
+#define __CORE_WARMFILE_H__
+
+namespace FreshCask
+{
+	namespace WarmFile
+	{
+		// Keys of the cache, hottest first, so a reopened bucket can fill its cache again.
+		// Header is followed by Count * (uint32_t SizeOfKey, key), CRC32 covers all of them.
+		struct Header
+		{
+			uint32_t  MagicNumber;
+			uint8_t   MajorVersion;
+			uint8_t   MinorVersion;
+			uint16_t  Reserved;
+			uint32_t  Count;
+			uint32_t  CRC32;
+
+			Header() : MagicNumber(DefaultMagicNumber), MajorVersion(CurrentMajorVersion), MinorVersion(CurrentMinorVersion), Reserved(0), Count(0), CRC32(0) {}
+		};
+	} // namespace WarmFile
+} // namespace FreshCask
+
+#endif // __CORE_WARMFILE_H__
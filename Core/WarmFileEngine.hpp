@@ -0,0 +1,115 @@
+#ifndef __CORE_WARMFILEENGINE_HPP__
+#define __CORE_WARMFILEENGINE_HPP__
+
+#include <vector>
+#include <sstream>
+
+#include <Core/WarmFile.h>
+#include <Core/DataFile.h>
+#include <Core/HintFileStream.hpp>
+
+namespace FreshCask
+{
+	// Reads and writes the warm-up file of a bucket. The file is only a hint: it is written
+	// whole in a single write, and one that is missing, torn or from another version is
+	// simply not used.
+	class WarmFileEngine
+	{
+	public:
+		//************************************
+		// Method:    Write
+		// FullName:  FreshCask::WarmFileEngine::Write
+		// Access:    public static
+		// Returns:   Status
+		// Desc:      Replace the warm-up file of bucketDir with keys
+		// Parameter: const std::string & bucketDir
+		// Parameter: const std::vector<SmartByteArray> & keys, hottest first
+		//************************************
+		static Status Write(const std::string &bucketDir, const std::vector<SmartByteArray> &keys)
+		{
+			uint32_t size = sizeof(WarmFile::Header);
+			for (auto& key : keys) size += sizeof(uint32_t) + key.Size();
+
+			SmartByteArray buffer(size);
+			BytePtr ptr = buffer.Data() + sizeof(WarmFile::Header);
+			for (auto& key : keys)
+			{
+				uint32_t sizeOfKey = key.Size();
+				memcpy(ptr, &sizeOfKey, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+				memcpy(ptr, key.Data(), sizeOfKey); ptr += sizeOfKey;
+			}
+
+			WarmFile::Header header;
+			header.Count = (uint32_t)keys.size();
+			header.CRC32 = DataFile::CRC32::Get(buffer.Data() + sizeof(WarmFile::Header), size - sizeof(WarmFile::Header));
+			memcpy(buffer.Data(), &header, sizeof(WarmFile::Header));
+
+			HintFileWriter writer(GetFilePath(bucketDir));
+			RET_IFNOT_OK(writer.Open(), "WarmFileEngine::Write()");
+			RET_IFNOT_OK(writer.WriteNext(buffer), "WarmFileEngine::Write()");
+			RET_BY_SENDER(writer.Close(), "WarmFileEngine::Write()");
+		}
+
+		//************************************
+		// Method:    Read
+		// FullName:  FreshCask::WarmFileEngine::Read
+		// Access:    public static
+		// Returns:   Status, NotFound or Corrupted if there is nothing to warm up with
+		// Parameter: const std::string & bucketDir
+		// Parameter: std::vector<SmartByteArray> & keysOut, hottest first
+		//************************************
+		static Status Read(const std::string &bucketDir, std::vector<SmartByteArray> &keysOut)
+		{
+			std::string filePath = GetFilePath(bucketDir);
+			if (!IsFileExist(filePath))
+				RET_BY_SENDER(Status::NotFound("File doesn't exist."), "WarmFileEngine::Read()");
+
+			HintFileReader reader(filePath);
+			RET_IFNOT_OK(reader.Open(), "WarmFileEngine::Read()");
+
+			uint32_t size;
+			RET_IFNOT_OK(reader.GetSize(size), "WarmFileEngine::Read()");
+			if (size < sizeof(WarmFile::Header))
+				RET_BY_SENDER(Status::Corrupted("Warm-up file is truncated."), "WarmFileEngine::Read()");
+
+			SmartByteArray buffer(size);
+			RET_IFNOT_OK(reader.Read(0, buffer), "WarmFileEngine::Read()");
+
+			WarmFile::Header header;
+			memcpy(&header, buffer.Data(), sizeof(WarmFile::Header));
+			if (header.MagicNumber != WarmFile::DefaultMagicNumber || header.MajorVersion != CurrentMajorVersion)
+				RET_BY_SENDER(Status::Corrupted("Not a warm-up file of this version."), "WarmFileEngine::Read()");
+			if (header.CRC32 != DataFile::CRC32::Get(buffer.Data() + sizeof(WarmFile::Header), size - sizeof(WarmFile::Header)))
+				RET_BY_SENDER(Status::Corrupted("CRC32 checksum incorrect"), "WarmFileEngine::Read()");
+
+			BytePtr ptr = buffer.Data() + sizeof(WarmFile::Header), end = buffer.Data() + size;
+			keysOut.clear();
+			for (uint32_t i = 0; i < header.Count; i++)
+			{
+				uint32_t sizeOfKey;
+				if (end - ptr < (ptrdiff_t)sizeof(uint32_t))
+					RET_BY_SENDER(Status::Corrupted("Warm-up file is truncated."), "WarmFileEngine::Read()");
+				memcpy(&sizeOfKey, ptr, sizeof(uint32_t)); ptr += sizeof(uint32_t);
+
+				if ((uint64_t)(end - ptr) < sizeOfKey)
+					RET_BY_SENDER(Status::Corrupted("Warm-up file is truncated."), "WarmFileEngine::Read()");
+				keysOut.push_back(SmartByteArray(sizeOfKey));
+				memcpy(keysOut.back().Data(), ptr, sizeOfKey); ptr += sizeOfKey;
+			}
+
+			RET_BY_SENDER(Status::OK(), "WarmFileEngine::Read()");
+		}
+
+		static std::string GetFilePath(const std::string &bucketDir)
+		{
+			std::stringstream stream;
+#ifdef WIN32
+			stream << bucketDir << "\\_bc" << WarmFile::FileNameSuffix;
+			return stream.str();
+#else
+#endif
+		}
+	};
+} // namespace FreshCask
+
+#endif // __CORE_WARMFILEENGINE_HPP__
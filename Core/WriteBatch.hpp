@@ -0,0 +1,70 @@
+#ifndef __CORE_WRITEBATCH_HPP__
+#define __CORE_WRITEBATCH_HPP__
+
+#include <vector>
+
+#include <Core/DataFile.h>
+
+namespace FreshCask
+{
+	class WriteBatch
+	{
+	public:
+		struct Entry
+		{
+			SmartByteArray Key;
+			SmartByteArray Value; // empty value means delete
+
+			Entry(SmartByteArray Key, SmartByteArray Value) : Key(std::move(Key)), Value(std::move(Value)) {}
+		};
+
+	public:
+		WriteBatch() : payloadSize(sizeof(uint32_t)) {}
+
+		//************************************
+		// Method:    Put
+		// FullName:  FreshCask::WriteBatch::Put
+		// Access:    public
+		// Returns:   void
+		// Desc:      Append a <key, value> pair to the batch
+		// Parameter: const SmartByteArray & key
+		// Parameter: const SmartByteArray & value
+		//************************************
+		void Put(const SmartByteArray& key, const SmartByteArray& value)
+		{
+			entries.emplace_back(key, value);
+			payloadSize += sizeof(DataFile::BatchEntryHeader) + key.Size() + value.Size();
+		}
+
+		//************************************
+		// Method:    Delete
+		// FullName:  FreshCask::WriteBatch::Delete
+		// Access:    public
+		// Returns:   void
+		// Desc:      Append a deletion of key to the batch
+		// Parameter: const SmartByteArray & key
+		//************************************
+		void Delete(const SmartByteArray& key)
+		{
+			Put(key, SmartByteArray::Null());
+		}
+
+		void Clear()
+		{
+			entries.clear();
+			payloadSize = sizeof(uint32_t);
+		}
+
+		size_t Count() const { return entries.size(); }
+		const std::vector<Entry>& Entries() const { return entries; }
+
+		// size of the encoded payload, see DataFile::BatchEntryHeader
+		uint32_t GetPayloadSize() const { return payloadSize; }
+
+	private:
+		std::vector<Entry> entries;
+		uint32_t payloadSize;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_WRITEBATCH_HPP__
@@ -0,0 +1,80 @@
+#ifndef __CORE_WRITESEQUENCER_HPP__
+#define __CORE_WRITESEQUENCER_HPP__
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace FreshCask
+{
+	// Hands out sequence numbers to the write lanes and lets them publish strictly in sequence
+	// order. Lanes append in parallel, but a newer write to a key is never overtaken in the
+	// hash tree by an older one from another lane, so the hash tree always agrees with what
+	// recovery rebuilds by sequence number.
+	class WriteSequencer
+	{
+	public:
+		WriteSequencer() : next(1), published(0) {}
+
+		WriteSequencer(const WriteSequencer&) = delete;
+		WriteSequencer& operator=(const WriteSequencer&) = delete;
+
+		// only while no lane is running
+		void Reset(uint64_t lastSequence)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			next = lastSequence + 1;
+			published = lastSequence;
+		}
+
+		//************************************
+		// Method:    Reserve
+		// FullName:  FreshCask::WriteSequencer::Reserve
+		// Access:    public
+		// Returns:   uint64_t, the first of count sequence numbers
+		// Desc:      Must be followed by Commit() of the same range, even if the write failed,
+		//            or every later lane blocks forever
+		// Parameter: uint32_t count
+		//************************************
+		uint64_t Reserve(uint32_t count)
+		{
+			return next.fetch_add(count, std::memory_order_relaxed);
+		}
+
+		//************************************
+		// Method:    Commit
+		// FullName:  FreshCask::WriteSequencer::Commit
+		// Access:    public
+		// Returns:   void
+		// Desc:      Wait until every earlier sequence is committed, then run publish
+		// Parameter: uint64_t first
+		// Parameter: uint32_t count
+		// Parameter: const FuncType & publish
+		//************************************
+		template <typename FuncType>
+		void Commit(uint64_t first, uint32_t count, const FuncType &publish)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [&] { return published + 1 == first; });
+
+			publish();
+			published += count;
+			cond.notify_all();
+		}
+
+		uint64_t GetLastSequence()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return published;
+		}
+
+	private:
+		std::atomic<uint64_t> next;
+		uint64_t published;
+
+		std::mutex mutex;
+		std::condition_variable cond;
+	};
+} // namespace FreshCask
+
+#endif // __CORE_WRITESEQUENCER_HPP__
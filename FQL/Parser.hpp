@@ -47,6 +47,7 @@ namespace FreshCask
 					{ "delete",				{ MAKE_TOKEN_PARSER(DeleteParser),			true	} },
 					{ "enumerate",			{ MAKE_TOKEN_PARSER(EnumerateParser),		true	} },
 					{ "compact",			{ MAKE_TOKEN_PARSER(CompactParser),			true	} },
+					{ "stats",				{ MAKE_TOKEN_PARSER(StatsParser),			true	} },
 					{ "proc",				{ MAKE_TOKEN_PARSER(ProcParser),			false	} },
 					{ "proc begin",			{ MAKE_TOKEN_PARSER(ProcBeginParser),		true	} },
 					{ "proc end",			{ MAKE_TOKEN_PARSER(ProcEndParser),			true	} },
@@ -73,6 +74,7 @@ namespace FreshCask
 					{ "delete",				MAKE_TOKEN_STATEMENT(DeleteParser)		  },
 					{ "enumerate",			MAKE_TOKEN_STATEMENT(EnumerateParser)	  },
 					{ "compact",			MAKE_TOKEN_STATEMENT(CompactParser)		  },
+					{ "stats",				MAKE_TOKEN_STATEMENT(StatsParser)		  },
 					{ "proc",				MAKE_TOKEN_STATEMENT(ProcParser)		  },
 					{ "proc begin",			MAKE_TOKEN_STATEMENT(ProcBeginParser)	  },
 					{ "proc end",			MAKE_TOKEN_STATEMENT(ProcEndParser)		  },
@@ -232,15 +234,16 @@ namespace FreshCask
 				if (q.empty())
 					return Fail("Expected `<key>` after `get`");
 
-				if (q.size() > 1) // other chars after <key>
-					return Fail(std::string("Unexpected verb `") + q[1] + "` after `" + q[0] + "`");
-
-				std::string key;
-				RetType ret = dealQuotation(q[0], "Expected NOT NULL `<key>` after `get`", key);
-				if (!IsOK(ret)) return ret;
+				ParamArray param; // get <key> [<key> ...]
+				for (size_t i = 0; i < q.size(); i++)
+				{
+					std::string key;
+					RetType ret = dealQuotation(q[i], i == 0 ? std::string("Expected NOT NULL `<key>` after `get`")
+						: std::string("Expected NOT NULL `<key>` after `") + q[i - 1] + "`", key);
+					if (!IsOK(ret)) return ret;
 
-				ParamArray param;
-				param.push_back(key);
+					param.push_back(key);
+				}
 				
 				if (s != nullptr) s(param);
 				if (out != nullptr) *out = param;
@@ -316,6 +319,16 @@ namespace FreshCask
 				return OK("compact");
 			}
 
+			RetType StatsParser(const VerbArray& q, BindStatement s, ParamArray* out)
+			{
+				if (!q.empty()) // other chars after stats
+					return Fail(std::string("Unexpected verb `") + q[0] + "` after `stats`");
+
+				if (s != nullptr) s(ParamArray());
+				if (out != nullptr) *out = ParamArray();
+				return OK("stats");
+			}
+
 			RetType ProcParser(const VerbArray& q, BindStatement, ParamArray* out)
 			{
 				if (q.empty())
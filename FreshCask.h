@@ -15,5 +15,8 @@ namespace FreshCask
 #include <Util/Misc.hpp>
 
 #include <Core/BucketManager.hpp>
+#include <Core/Cursor.hpp>
+#include <Core/BucketRegistry.hpp>
+#include <Core/PartitionedBucket.hpp>
 
 #endif // __FRESHCASK_H__
\ No newline at end of file
@@ -1,9 +1,29 @@
 #include <iostream>
 #include <chrono>
 #include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <map>
 
 #include <FreshCask.h>
 
+// count every heap allocation, for the allocation benchmark
+std::atomic<uint64_t> allocCount(0);
+
+void* operator new(size_t size)
+{
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
 void doTest(FreshCask::Status s)
 { 
 	if (!s.IsOK()) 
@@ -24,8 +44,14 @@ void printHelp()
 	std::cout << "(d)elete <key> - Delete a <key, value> pair by key." << std::endl;
 	std::cout << "(e)numerate - Enumerate all <key, value> pairs." << std::endl;
 	std::cout << "compac(t) - Compact bucket to increase performance." << std::endl;
+	std::cout << "(m)erge - Merge older data files worth merging while bucket stays open." << std::endl;
+	std::cout << "(u)sage - Show live and dead bytes of every data file and write stalls." << std::endl;
+	std::cout << "(s)tats - Show cache and keydir counters." << std::endl;
+	std::cout << "(l)ocks <on|off|show|reset> - Profile lock contention, show counters per lock site." << std::endl;
 	std::cout << "(f)qltest - Test FQL." << std::endl;
-	std::cout << "(a)utotests - Automated Tests." << std::endl;
+	std::cout << "(a)utotests - Automated Tests: FQL parsing, then buckets at D:\\BucketAutoTest." << std::endl;
+	std::cout << "alloc(b)ench - Count heap allocations per Put and pinned Get in steady state." << std::endl;
+	std::cout << "(k)eybench - Time keydir probes of random key batches, batched against one by one." << std::endl;
 }
 
 void FQLTest()
@@ -44,7 +70,9 @@ void FQLTest()
 		std::cout << "remove bucket " << param[0] << " :";
 	});
 	parser.Bind("get", [](FreshCask::FQL::Parser::ParamArray param){
-		std::cout << "get " << param[0] << " :";
+		std::cout << "get";
+		for (auto& key : param) std::cout << " " << key;
+		std::cout << " :";
 	});
 	parser.Bind("put", [](FreshCask::FQL::Parser::ParamArray param){
 		std::cout << "put " << param[0] << " " << param[1] << " :";
@@ -58,6 +86,9 @@ void FQLTest()
 	parser.Bind("compact", [](FreshCask::FQL::Parser::ParamArray param){
 		std::cout << "compact :";
 	});
+	parser.Bind("stats", [](FreshCask::FQL::Parser::ParamArray param){
+		std::cout << "stats :";
+	});
 	parser.Bind("proc begin", [](FreshCask::FQL::Parser::ParamArray param){
 		std::cout << "proc begin :";
 	});
@@ -92,20 +123,349 @@ void FQLTest()
 	testParse("put 'key' 'value more"); testParse("put 'key' 'value' more"); testParse("put \"key\" 'value more"); testParse("put \"key\" 'value' more");
 	testParse("put 'key' \"value more"); testParse("put 'key' \"value\" more"); testParse("delete"); testParse("delete key"); testParse("delete \"key");
 	testParse("delete \"key\""); testParse("delete \"key\" more"); testParse("delete 'key"); testParse("delete 'key'"); testParse("delete 'key' more");
-	testParse("enumerate"); testParse("enumerate more"); testParse("compact"); testParse("compact more"); testParse("proc"); testParse("proc no");
+	testParse("enumerate"); testParse("enumerate more"); testParse("compact"); testParse("compact more"); testParse("stats"); testParse("stats more"); testParse("proc"); testParse("proc no");
 	testParse("proc begin"); testParse("proc begin more"); testParse("proc end"); testParse("proc end more");
 }
 
+// checks of BucketTest(), each failure is reported with its line
+int checkFailures = 0;
+#define CHECK_THAT(cond) do { if (!(cond)) { checkFailures++; std::cout << "[Check] Failed at line " << __LINE__ << ": " #cond << std::endl; } } while (0)
+
+// an empty directory for one test, whatever an earlier run left there is removed
+std::string freshDir(const std::string& path)
+{
+	if (FreshCask::IsDirExist(path)) doTest(FreshCask::RemoveDir(path));
+	doTest(FreshCask::MakeDir(path));
+	return path;
+}
+
+std::string valueOf(FreshCask::BucketManager& bc, const std::string& key)
+{
+	FreshCask::SmartByteArray value;
+	return bc.Get(key, value).IsOK() ? value.ToString() : "<not found>";
+}
+
+// cut the last bytes off the newest data file of a bucket, as a crash in the middle of a write would
+void tearNewestDataFile(const std::string& bucketDir, uint32_t bytes)
+{
+	std::string newest;
+	uint32_t newestId = 0;
+	FreshCask::ListDir(bucketDir, [&](const std::string& path) -> FreshCask::Status {
+		std::string name = path.substr(path.find_last_of('\\') + 1);
+		if (FreshCask::EndWith(name, FreshCask::DataFile::FileNameSuffix) && (uint32_t)std::stoul(name) >= newestId)
+			newestId = (uint32_t)std::stoul(name), newest = path;
+		return FreshCask::Status::OK();
+	});
+
+#ifdef WIN32
+	HANDLE file = CreateFileA(newest.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+
+	DWORD size = GetFileSize(file, NULL);
+	SetFilePointer(file, size > bytes ? size - bytes : 0, NULL, FILE_BEGIN);
+	SetEndOfFile(file);
+	CloseHandle(file);
+#else
+#endif
+}
+
+void TestBatchRecovery(const std::string& dir)
+{
+	{
+		FreshCask::BucketManager bc;
+		doTest(bc.Open(dir));
+		for (int i = 0; i < 100; i++) doTest(bc.Put("key" + std::to_string(i), "value" + std::to_string(i)));
+
+		FreshCask::WriteBatch batch;
+		for (int i = 0; i < 10; i++) batch.Put("torn" + std::to_string(i), "lost");
+		batch.Delete("key5");
+		doTest(bc.Write(batch));
+		doTest(bc.Close(false)); // no hint file, reopening replays the data file
+	}
+
+	tearNewestDataFile(dir, 3);
+
+	FreshCask::BucketManager bc;
+	doTest(bc.Open(dir));
+	CHECK_THAT(bc.PairCount() == 100);
+	CHECK_THAT(valueOf(bc, "torn0") == "<not found>" && valueOf(bc, "torn9") == "<not found>");
+	CHECK_THAT(valueOf(bc, "key5") == "value5"); // the whole frame is dropped, its deletion too
+	CHECK_THAT(valueOf(bc, "key99") == "value99");
+	doTest(bc.Close());
+}
+
+void TestMergeReopen(const std::string& dir)
+{
+	std::map<std::string, std::string> model;
+	{
+		FreshCask::BucketManager bc;
+		doTest(bc.Open(dir));
+		for (int round = 0; round < 3; round++)
+		{
+			for (int i = 0; i < 300; i++)
+			{
+				std::string key = "key" + std::to_string(i), value = "value" + std::to_string(round) + "_" + std::to_string(i);
+				doTest(bc.Put(key, value));
+				model[key] = value;
+			}
+			for (int i = round; i < 300; i += 7)
+			{
+				doTest(bc.Delete("key" + std::to_string(i)));
+				model.erase("key" + std::to_string(i));
+			}
+			doTest(bc.Compact());
+		}
+		for (int i = 0; i < 300; i += 2) doTest(bc.Put("key" + std::to_string(i), model["key" + std::to_string(i)] = "last"));
+		doTest(bc.Merge());
+		doTest(bc.Close());
+	}
+
+	FreshCask::BucketManager bc;
+	doTest(bc.Open(dir));
+	CHECK_THAT(bc.PairCount() == model.size());
+	int wrong = 0;
+	for (int i = 0; i < 300; i++)
+	{
+		std::string key = "key" + std::to_string(i);
+		if (valueOf(bc, key) != (model.count(key) ? model[key] : "<not found>")) wrong++;
+	}
+	CHECK_THAT(wrong == 0);
+
+	// a compacted bucket owes nothing, however many merged files it takes
+	doTest(bc.Compact());
+	FreshCask::WritePressure pressure = bc.GetWritePressure();
+	CHECK_THAT(pressure.DeadBytes == 0 && pressure.FileCount == 0 && pressure.CheckpointLag == 0);
+	doTest(bc.Close());
+}
+
+void TestMultiGet(const std::string& dir)
+{
+	FreshCask::BucketManager bc;
+	doTest(bc.Open(dir));
+	for (int i = 0; i < 500; i++) doTest(bc.Put("key" + std::to_string(i), std::string(i % 50 == 0 ? 5000 : 10, 'a' + i % 26)));
+	doTest(bc.Compact()); // these are in merged files now
+	for (int i = 0; i < 500; i += 4) doTest(bc.Put("key" + std::to_string(i), "new" + std::to_string(i)));
+	doTest(bc.Delete("key7"));
+
+	std::vector<FreshCask::SmartByteArray> keys, values;
+	std::vector<FreshCask::Status> statuses;
+	for (int i = 501; i >= 0; i--) keys.push_back("key" + std::to_string(i));
+	doTest(bc.MultiGet(keys, values, statuses));
+
+	int wrong = 0;
+	for (int i = 501; i >= 0; i--)
+	{
+		size_t j = 501 - i;
+		if (i >= 500 || i == 7) { if (!statuses[j].IsNotFound()) wrong++; }
+		else if (!statuses[j].IsOK() || values[j].ToString() != (i % 4 == 0 ? "new" + std::to_string(i) : std::string(i % 50 == 0 ? 5000 : 10, 'a' + i % 26))) wrong++;
+	}
+	CHECK_THAT(wrong == 0);
+	doTest(bc.Close());
+}
+
+void TestCursorResume(const std::string& dir)
+{
+	FreshCask::SmartByteArray position;
+	int seen = 0;
+	{
+		FreshCask::BucketManager bc;
+		doTest(bc.Open(dir));
+		for (int i = 0; i < 1000; i++) doTest(bc.Put("key" + std::to_string(1000 + i), "value" + std::to_string(i)));
+
+		FreshCask::Cursor cursor(bc, 64);
+		for (cursor.Seek(); cursor.Valid() && seen < 400; cursor.Next(), seen++)
+			position = FreshCask::SmartByteArray::Copy(cursor.Position().Data(), cursor.Position().Size());
+		doTest(bc.Close());
+	}
+
+	FreshCask::BucketManager bc;
+	doTest(bc.Open(dir));
+	FreshCask::Cursor cursor(bc, 64);
+	std::string last = position.ToString();
+	bool ordered = true;
+	for (cursor.Seek(position); cursor.Valid(); cursor.Next(), seen++)
+	{
+		ordered = ordered && last < cursor.Key().ToString();
+		last = cursor.Key().ToString();
+	}
+	CHECK_THAT(cursor.GetStatus().IsOK());
+	CHECK_THAT(ordered && seen == 1000);
+	doTest(bc.Close());
+}
+
+void TestScanLive(const std::string& dir)
+{
+	FreshCask::BucketManager bc;
+	doTest(bc.Open(dir));
+
+	std::map<std::string, std::string> model;
+	for (int i = 0; i < 1000; i++) doTest(bc.Put("key" + std::to_string(i), model["key" + std::to_string(i)] = "old" + std::to_string(i)));
+	doTest(bc.Compact());
+	for (int i = 0; i < 1000; i += 3) doTest(bc.Put("key" + std::to_string(i), model["key" + std::to_string(i)] = "new" + std::to_string(i)));
+	for (int i = 1; i < 1000; i += 5)
+	{
+		doTest(bc.Delete("key" + std::to_string(i)));
+		model.erase("key" + std::to_string(i));
+	}
+
+	std::map<std::string, std::string> scanned;
+	int duplicates = 0;
+	doTest(bc.ScanLive([&](const FreshCask::SmartByteArray& key, const FreshCask::SmartByteArray& value) -> FreshCask::Status {
+		if (!scanned.insert(std::make_pair(key.ToString(), value.ToString())).second) duplicates++;
+		return FreshCask::Status::OK();
+	}));
+	CHECK_THAT(duplicates == 0);
+	CHECK_THAT(scanned == model);
+	doTest(bc.Close());
+}
+
+void BucketTest(const std::string& dir)
+{
+	checkFailures = 0;
+	if (!FreshCask::IsDirExist(dir)) doTest(FreshCask::MakeDir(dir));
+
+	TestBatchRecovery(freshDir(dir + "\\BatchRecovery"));
+	TestMergeReopen(freshDir(dir + "\\MergeReopen"));
+	TestMultiGet(freshDir(dir + "\\MultiGet"));
+	TestCursorResume(freshDir(dir + "\\CursorResume"));
+	TestScanLive(freshDir(dir + "\\ScanLive"));
+
+	if (checkFailures == 0) std::cout << "[Check] Bucket tests passed." << std::endl;
+	else std::cout << "[Check] " << checkFailures << " bucket checks failed." << std::endl;
+}
+
+void AllocBench(FreshCask::BucketManager& bc)
+{
+	const int keyCount = 64, rounds = 10000;
+
+	// build keys and values up front, Put() itself should not touch the heap
+	std::vector<FreshCask::SmartByteArray> keys, values;
+	for (int i = 0; i < keyCount; i++)
+	{
+		keys.push_back(FreshCask::SmartByteArray("allocbench_key_" + std::to_string(i)));
+		values.push_back(FreshCask::SmartByteArray("allocbench_value_" + std::to_string(i)));
+	}
+
+	// warm up: keydir, cache and the per-thread scratch arena reach their steady size
+	for (int i = 0; i < keyCount * 4; i++)
+		doTest(bc.Put(keys[i % keyCount], values[i % keyCount]));
+
+	uint64_t before = allocCount.load();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < rounds; i++)
+		bc.Put(keys[i % keyCount], values[i % keyCount]);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	uint64_t allocs = allocCount.load() - before;
+
+	std::cout << rounds << " puts, " << allocs << " allocations ("
+		<< (double)allocs / rounds << " per put), "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / (double)rounds << " us per put." << std::endl;
+
+	// values are cached by now, a pinned get points into the cache
+	FreshCask::PinnableSlice slice;
+	before = allocCount.load();
+	start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < rounds; i++)
+		bc.GetPinned(keys[i % keyCount], slice);
+
+	end = std::chrono::high_resolution_clock::now();
+	allocs = allocCount.load() - before;
+	slice.Reset();
+
+	std::cout << rounds << " pinned gets, " << allocs << " allocations ("
+		<< (double)allocs / rounds << " per get), "
+		<< std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / (double)rounds << " us per get." << std::endl;
+}
+
+void KeyBench(FreshCask::BucketManager& bc)
+{
+	const int keyCount = 100000, batchSize = 20000, rounds = 10;
+
+	std::vector<FreshCask::SmartByteArray> keys;
+	for (int i = 0; i < keyCount; i++)
+	{
+		keys.push_back(FreshCask::SmartByteArray("keybench_key_" + std::to_string(i)));
+		if (!bc.CotainsKey(keys.back())) doTest(bc.Put(keys.back(), FreshCask::SmartByteArray("v")));
+	}
+
+	std::mt19937 random(20);
+	std::vector<FreshCask::SmartByteArray> batch(batchSize);
+	std::vector<bool> found;
+	int64_t batchedUs = 0, singleUs = 0;
+	size_t hits = 0;
+
+	for (int round = 0; round < rounds; round++)
+	{
+		for (auto& key : batch) key = keys[random() % keyCount];
+
+		auto start = std::chrono::high_resolution_clock::now();
+		bc.CotainsKey(batch, found);
+		auto end = std::chrono::high_resolution_clock::now();
+		batchedUs += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		for (auto& key : batch) hits += bc.CotainsKey(key) ? 1 : 0;
+		end = std::chrono::high_resolution_clock::now();
+		singleUs += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	}
+
+	std::cout << rounds << " batches of " << batchSize << " out of " << keyCount << " keys: "
+		<< batchedUs / (double)rounds << " us batched, " << singleUs / (double)rounds << " us one by one ("
+		<< (singleUs > 0 ? batchedUs * 100.0 / singleUs : 0) << "%), " << hits << " found." << std::endl;
+}
+
+void ShowUsage(FreshCask::BucketManager& bc)
+{
+	std::vector<FreshCask::DataFileUsage> usage;
+	doTest(bc.GetFileUsage(usage));
+
+	for (auto& file : usage)
+		std::cout << file.FileId << (file.IsOlder ? " (older)" : " (active)") << ": " << file.TotalBytes << " bytes, "
+			<< file.LiveBytes << " live, " << file.DeadBytes() << " dead (" << file.DeadRatio() * 100 << "%)" << std::endl;
+
+	FreshCask::WritePressure pressure = bc.GetWritePressure();
+	FreshCask::AdmissionController::Stats stats = bc.GetAdmissionStats();
+	std::cout << "Debt: " << pressure.DeadBytes << " dead bytes, " << pressure.FileCount << " files, "
+		<< pressure.CheckpointLag << " bytes since checkpoint." << std::endl;
+	std::cout << "Writes held back: " << stats.DelayedWrites << " delayed, " << stats.StoppedWrites << " stopped, "
+		<< stats.RejectedWrites << " rejected, " << stats.StallMicros << " us in total." << std::endl;
+}
+
+void ShowStats(FreshCask::BucketManager& bc)
+{
+	FreshCask::BucketManager::Stats stats = bc.GetStats();
+	uint64_t reads = stats.Cache.Hits + stats.Cache.Misses;
+	std::cout << "Cache: " << stats.Cache.Hits << " hits, " << stats.Cache.Misses << " misses ("
+		<< (reads > 0 ? stats.Cache.Hits * 100.0 / reads : 0) << "% hit), " << stats.Cache.Inserts << " inserts, "
+		<< stats.Cache.Evictions << " evictions." << std::endl;
+	std::cout << "Resident: " << stats.Cache.Entries << " entries, " << stats.Cache.ResidentBytes << " bytes, "
+		<< stats.Cache.MemoryBytes << " bytes of slabs." << std::endl;
+	std::cout << "Keydir: " << stats.KeyCount << " keys, " << stats.KeydirLookups << " lookups, "
+		<< (stats.KeydirLookups > 0 ? stats.KeydirProbes / (double)stats.KeydirLookups : 0) << " probes per lookup, "
+		<< stats.MaxKeydirProbes << " at most." << std::endl;
+}
+
 int main()
 {
 	FreshCask::BucketManager bc;
-	std::string input;
+	FreshCask::BucketRegistry registry; // buckets of FQL, bc until one is selected
+	FreshCask::BucketRegistry::BucketHandle selected;
+	std::string selectedName, input;
 
 	printHelp(); std::cout << "> ";
 	while (std::cin >> input)
 	{
 		if (input == "help" || input == "h") printHelp();
-		else if (input == "quit" || input == "q") { if (bc.IsOpen()) doTest( bc.Close() ); break; }
+		else if (input == "quit" || input == "q")
+		{
+			if (bc.IsOpen()) doTest( bc.Close() );
+			selected.reset();
+			if (registry.IsOpen()) doTest( registry.Close() );
+			break;
+		}
 		else if (input == "open" || input == "o") doTest( bc.Open("D:\\BucketTest") );
 		else if (input == "close" || input == "c") doTest( bc.Close() );
 		else if (input == "get" || input == "g")
@@ -135,19 +495,15 @@ int main()
 		}
 		else if (input == "enumerate" || input == "e")
 		{
-			std::vector<std::string> keys;
-			doTest(bc.Enumerate(keys));
-
-			for (auto& key : keys)
-			{
-				FreshCask::SmartByteArray value;
-				doTest(bc.Get(key, value));
-				std::cout << "Key: " << key << ", Value: " << value.ToString() << std::endl;
-			}
+			FreshCask::Cursor cursor(bc);
+			for (cursor.Seek(); cursor.Valid(); cursor.Next())
+				std::cout << "Key: " << cursor.Key().ToString() << ", Value: " << cursor.Value().ToString() << std::endl;
+			doTest(cursor.GetStatus());
 		}
 		else if (input == "autotests" || input == "a") 
 		{
 			FQLTest();
+			BucketTest("D:\\BucketAutoTest");
 		}
 		else if (input == "fqltest" || input == "f")
 		{
@@ -157,44 +513,73 @@ int main()
 			std::vector<std::string> commandVec;
 			bool procBegin = false, nestFlag = false;
 
-			parser.Bind("list bucket", [](FreshCask::FQL::Parser::ParamArray param){
-				std::cout << "list bucket" << std::endl;
+			auto openRegistry = [&]() {
+				if (!registry.IsOpen()) doTest(registry.Open("D:\\BucketRegistry"));
+				return registry.IsOpen();
+			};
+			auto current = [&]() -> FreshCask::BucketManager& { return selected != nullptr ? *selected : bc; };
+
+			parser.Bind("list bucket", [&](FreshCask::FQL::Parser::ParamArray param){
+				std::vector<std::string> names;
+				if (!openRegistry()) return;
+				doTest(registry.List(names));
+
+				for (auto& name : names) std::cout << "Bucket: " << name << std::endl;
 			});
-			parser.Bind("select bucket", [](FreshCask::FQL::Parser::ParamArray param){
-				std::cout << "select bucket " << param[0] << std::endl;
+			parser.Bind("select bucket", [&](FreshCask::FQL::Parser::ParamArray param){
+				FreshCask::BucketRegistry::BucketHandle handle;
+				if (!openRegistry()) return;
+
+				FreshCask::Status s = registry.Acquire(param[0], handle);
+				doTest(s);
+				if (s.IsOK()) selected = handle, selectedName = param[0];
 			});
-			parser.Bind("create bucket", [](FreshCask::FQL::Parser::ParamArray param){
-				std::cout << "create bucket " << param[0] << std::endl;
+			parser.Bind("create bucket", [&](FreshCask::FQL::Parser::ParamArray param){
+				if (openRegistry()) doTest(registry.Create(param[0]));
 			});
-			parser.Bind("remove bucket", [](FreshCask::FQL::Parser::ParamArray param){
-				std::cout << "remove bucket " << param[0] << std::endl;
+			parser.Bind("remove bucket", [&](FreshCask::FQL::Parser::ParamArray param){
+				if (!openRegistry()) return;
+				if (selected != nullptr && selectedName == param[0]) selected.reset(); // back to bc
+				doTest(registry.Remove(param[0]));
 			});
 			parser.Bind("get", [&](FreshCask::FQL::Parser::ParamArray param){
-				FreshCask::SmartByteArray out;
-				FreshCask::Status s = bc.Get(param[0], out);
-				doTest(s);
+				if (param.size() == 1)
+				{
+					FreshCask::SmartByteArray out;
+					FreshCask::Status s = current().Get(param[0], out);
+					doTest(s);
 
-				if (s.IsOK()) std::cout << "Value: " << out.ToString() << std::endl;
+					if (s.IsOK()) std::cout << "Value: " << out.ToString() << std::endl;
+					return;
+				}
+
+				std::vector<FreshCask::SmartByteArray> keys(param.begin(), param.end()), values;
+				std::vector<FreshCask::Status> statuses;
+				doTest(current().MultiGet(keys, values, statuses));
+
+				for (size_t i = 0; i < statuses.size(); i++)
+				{
+					if (statuses[i].IsOK()) std::cout << "Key: " << param[i] << ", Value: " << values[i].ToString() << std::endl;
+					else std::cout << "Key: " << param[i] << ", " << statuses[i].ToString() << std::endl;
+				}
 			});
 			parser.Bind("put", [&](FreshCask::FQL::Parser::ParamArray param){
-				doTest(bc.Put(param[0], param[1]));
+				doTest(current().Put(param[0], param[1]));
 			});
 			parser.Bind("delete", [&](FreshCask::FQL::Parser::ParamArray param){
-				doTest(bc.Delete(param[0]));
+				doTest(current().Delete(param[0]));
 			});
 			parser.Bind("enumerate", [&](FreshCask::FQL::Parser::ParamArray param){
-				std::vector<std::string> keys;
-				doTest(bc.Enumerate(keys));
-
-				for (auto& key : keys)
-				{
-					FreshCask::SmartByteArray value;
-					doTest(bc.Get(key, value));
-					std::cout << "Key: " << key << ", Value: " << value.ToString() << std::endl;
-				}
+				FreshCask::Cursor cursor(current());
+				for (cursor.Seek(); cursor.Valid(); cursor.Next())
+					std::cout << "Key: " << cursor.Key().ToString() << ", Value: " << cursor.Value().ToString() << std::endl;
+				doTest(cursor.GetStatus());
 			});
 			parser.Bind("compact", [&](FreshCask::FQL::Parser::ParamArray param){
-				doTest(bc.Compact());
+				doTest(current().Compact());
+			});
+			parser.Bind("stats", [&](FreshCask::FQL::Parser::ParamArray param){
+				ShowStats(current());
 			});
 
 			auto procBeginStatement = [&](FreshCask::FQL::Parser::ParamArray param){
@@ -257,6 +642,42 @@ int main()
 			} while (true);
 		}
 		else if (input == "compact" || input == "t") doTest( bc.Compact() );
+		else if (input == "merge" || input == "m") doTest( bc.Merge() );
+		else if (input == "usage" || input == "u")
+		{
+			if (!bc.IsOpen()) std::cout << "[Console] Open bucket first." << std::endl;
+			else ShowUsage(bc);
+		}
+		else if (input == "stats" || input == "s")
+		{
+			if (!bc.IsOpen()) std::cout << "[Console] Open bucket first." << std::endl;
+			else ShowStats(bc);
+		}
+		else if (input == "locks" || input == "l")
+		{
+			std::string action;
+			std::cin >> action;
+
+			if (action == "on") FreshCask::LockProfiler::SetEnabled(true);
+			else if (action == "off") FreshCask::LockProfiler::SetEnabled(false);
+			else if (action == "reset") FreshCask::LockProfiler::Default().Reset();
+			else if (action == "show")
+			{
+				std::string dump = FreshCask::LockProfiler::Default().Dump();
+				std::cout << (dump.empty() ? "[Console] Nothing counted, turn profiling on first.\n" : dump);
+			}
+			else std::cout << "[Console] Unknown action." << std::endl;
+		}
+		else if (input == "allocbench" || input == "b")
+		{
+			if (!bc.IsOpen()) std::cout << "[Console] Open bucket first." << std::endl;
+			else AllocBench(bc);
+		}
+		else if (input == "keybench" || input == "k")
+		{
+			if (!bc.IsOpen()) std::cout << "[Console] Open bucket first." << std::endl;
+			else KeyBench(bc);
+		}
 		else std::cout << "[Console] Unknown command." << std::endl;
 		std::cout << "> ";
 	}
@@ -0,0 +1,446 @@
+#ifndef __UTIL_CACHEPOLICY_HPP__
+#define __UTIL_CACHEPOLICY_HPP__
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+namespace FreshCask
+{
+	// An entry of LRUCache. The cache shard owns it, its hash chain and its item, a slab chunk
+	// holding key and value back to back; the policy owns the list links.
+	struct CacheNode
+	{
+		BytePtr Item;
+		void *SlabPage; // SlabAllocator::Page that Item was carved from
+		uint32_t SizeOfKey, SizeOfValue;
+		uint32_t Space; // keys of different spaces never match
+		uint8_t SizeClass;
+		HashType Hash;
+		uint64_t Charge; // bytes it counts against capacity
+		uint32_t Pins;   // PinnableSlices pointing into Item
+		bool Detached;   // removed while pinned, freed by the last unpin
+		CacheNode *Prev, *Next; // policy list
+		CacheNode *NextInSlot;  // hash chain
+
+		uint8_t Segment; // which list of the policy it is on
+		bool Referenced;
+		bool InTest;
+	};
+
+	// Intrusive doubly-linked list of cache nodes, most recent in front, with their total charge.
+	class CacheList
+	{
+	public:
+		CacheList() : bytes(0)
+		{
+			head.Prev = nullptr; head.Next = &tail;
+			tail.Prev = &head; tail.Next = nullptr;
+		}
+
+		CacheList(const CacheList&) = delete;
+		CacheList& operator=(const CacheList&) = delete;
+
+		void PushFront(CacheNode *node)
+		{
+			node->Next = head.Next;
+			node->Prev = &head;
+			head.Next = node;
+			node->Next->Prev = node;
+			bytes += node->Charge;
+		}
+
+		void Remove(CacheNode *node)
+		{
+			node->Prev->Next = node->Next;
+			node->Next->Prev = node->Prev;
+			bytes -= node->Charge;
+		}
+
+		void MoveToFront(CacheNode *node) { Remove(node); PushFront(node); }
+
+		// front to back, stops early if func returns false
+		template <typename FuncType>
+		bool ForEach(const FuncType &func) const
+		{
+			for (const CacheNode *node = head.Next; node != &tail; node = node->Next)
+				if (!func(node)) return false;
+			return true;
+		}
+
+		CacheNode* Back() { return Empty() ? nullptr : tail.Prev; }
+		bool Empty() const { return head.Next == &tail; }
+		uint64_t Bytes() const { return bytes; }
+
+	private:
+		CacheNode head, tail;
+		uint64_t bytes;
+	};
+
+	// Decides which entry of a cache shard goes when the shard is over capacity. Every call is
+	// made with the shard locked. A policy only orders nodes, the shard inserts, finds and
+	// frees them.
+	class CachePolicy
+	{
+	public:
+		enum Type
+		{
+			LRU,      // plain recency, one scan flushes everything
+			TinyLFU,  // W-TinyLFU: frequency sketch admits window victims into a segmented LRU
+			ClockPro, // CLOCK-Pro: hot and cold entries, cold ones have to prove themselves
+		};
+
+	public:
+		virtual ~CachePolicy() {}
+
+		virtual void SetCapacity(uint64_t capacity) = 0;
+
+		// a lookup of the key, hit or miss
+		virtual void Accessed(HashType hash) {}
+
+		// node is new in the shard
+		virtual void Inserted(CacheNode *node) = 0;
+
+		// node was hit, or its value was overwritten
+		virtual void Touched(CacheNode *node) = 0;
+
+		// node leaves the shard
+		virtual void Removed(CacheNode *node) = 0;
+
+		// the node to evict next, nullptr only if the policy holds none
+		virtual CacheNode* Victim() = 0;
+
+		// every node, the one most worth keeping first; stops early if func returns false
+		typedef std::function<bool(const CacheNode*)> VisitorType;
+		virtual void ForEach(const VisitorType &func) const = 0;
+
+		static CachePolicy* Create(Type type, uint64_t capacity);
+	};
+
+	const CachePolicy::Type DefaultCachePolicy = CachePolicy::TinyLFU; // holds up against scans
+
+	class LRUPolicy : public CachePolicy
+	{
+	public:
+		void SetCapacity(uint64_t) {}
+		void Inserted(CacheNode *node) { list.PushFront(node); }
+		void Touched(CacheNode *node) { list.MoveToFront(node); }
+		void Removed(CacheNode *node) { list.Remove(node); }
+		CacheNode* Victim() { return list.Back(); }
+		void ForEach(const VisitorType &func) const { list.ForEach(func); }
+
+	private:
+		CacheList list;
+	};
+
+	// Count-min sketch of 4 rows of saturating 4-bit counts, halved every sampleSize
+	// increments so that yesterday's hot keys fade.
+	class FrequencySketch
+	{
+	public:
+		FrequencySketch() : mask(0), additions(0), sampleSize(0) {}
+
+		void Resize(uint32_t expectedEntries)
+		{
+			// 16 counters per entry keep collisions from drowning out the frequency of a key
+			uint32_t width = 1024;
+			while (width < expectedEntries * 16) width <<= 1;
+
+			table.assign(width / 2, 0); // two counters per byte
+			mask = width - 1;
+			additions = 0;
+			sampleSize = (expectedEntries > 64 ? expectedEntries : 64) * 10;
+		}
+
+		uint32_t Frequency(HashType hash) const
+		{
+			uint32_t freq = 15;
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				uint32_t count = get(indexOf(hash, row));
+				if (count < freq) freq = count;
+			}
+			return freq;
+		}
+
+		void Increment(HashType hash)
+		{
+			bool added = false;
+			for (uint32_t row = 0; row < 4; row++)
+			{
+				uint32_t index = indexOf(hash, row);
+				if (get(index) < 15)
+				{
+					set(index, get(index) + 1);
+					added = true;
+				}
+			}
+
+			if (added && ++additions >= sampleSize)
+			{
+				for (auto& pair : table) pair = (pair >> 1) & 0x77; // halve both counters
+				additions /= 2;
+			}
+		}
+
+	private:
+		uint32_t indexOf(HashType hash, uint32_t row) const
+		{
+			static const uint32_t seeds[4] = { 0x97CB3127, 0xB3B6C1F5, 0x6F2A8E4B, 0xC2B2AE35 };
+			uint32_t h = (hash ^ seeds[row]) * 0x9E3779B1;
+			return (h ^ (h >> 15)) & mask;
+		}
+
+		uint32_t get(uint32_t index) const { return (table[index >> 1] >> ((index & 1) * 4)) & 0xF; }
+		void set(uint32_t index, uint32_t count)
+		{
+			uint32_t shift = (index & 1) * 4;
+			table[index >> 1] = (uint8_t)((table[index >> 1] & ~(0xF << shift)) | (count << shift));
+		}
+
+	private:
+		std::vector<uint8_t> table;
+		uint32_t mask, additions, sampleSize;
+	};
+
+	// W-TinyLFU: new entries go into a small LRU window. A window victim is only let into the
+	// main segmented LRU if the sketch has seen it more often than the main victim it would
+	// replace, so a scan of keys read once never pushes out the frequently read ones.
+	class TinyLFUPolicy : public CachePolicy
+	{
+	private:
+		enum Segment { Window, Probation, Protected };
+
+	public:
+		TinyLFUPolicy(uint64_t capacity) { SetCapacity(capacity); }
+
+		void SetCapacity(uint64_t capacity)
+		{
+			windowBytes = capacity / 100 > 0 ? capacity / 100 : 1; // 1% window
+			mainBytes = capacity - windowBytes;
+			protectedBytes = mainBytes / 5 * 4; // 80% of main
+
+			sketch.Resize((uint32_t)(capacity / ExpectedEntryBytes));
+		}
+
+		void Accessed(HashType hash) { sketch.Increment(hash); }
+
+		void Inserted(CacheNode *node)
+		{
+			node->Segment = Window;
+			window.PushFront(node);
+		}
+
+		void Touched(CacheNode *node)
+		{
+			if (node->Segment == Probation)
+			{
+				probation.Remove(node);
+				node->Segment = Protected;
+				protect.PushFront(node);
+
+				while (protect.Bytes() > protectedBytes)
+				{
+					CacheNode *demoted = protect.Back();
+					protect.Remove(demoted);
+					demoted->Segment = Probation;
+					probation.PushFront(demoted);
+				}
+			}
+			else listOf(node).MoveToFront(node);
+		}
+
+		void Removed(CacheNode *node) { listOf(node).Remove(node); }
+
+		CacheNode* Victim()
+		{
+			while (window.Bytes() > windowBytes)
+			{
+				CacheNode *candidate = window.Back();
+				if (probation.Bytes() + protect.Bytes() + candidate->Charge <= mainBytes)
+				{
+					window.Remove(candidate); // main has room, no contest
+					candidate->Segment = Probation;
+					probation.PushFront(candidate);
+					continue;
+				}
+
+				CacheNode *victim = mainVictim();
+				if (victim == nullptr || sketch.Frequency(candidate->Hash) <= sketch.Frequency(victim->Hash))
+					return candidate;
+
+				window.Remove(candidate);
+				candidate->Segment = Probation;
+				probation.PushFront(candidate);
+				return victim;
+			}
+
+			CacheNode *victim = mainVictim();
+			return victim != nullptr ? victim : window.Back();
+		}
+
+		// proven entries, then recent ones still to prove themselves
+		void ForEach(const VisitorType &func) const
+		{
+			protect.ForEach(func) && window.ForEach(func) && probation.ForEach(func);
+		}
+
+	private:
+		CacheList& listOf(CacheNode *node) { return node->Segment == Window ? window : (node->Segment == Probation ? probation : protect); }
+		CacheNode* mainVictim() { return !probation.Empty() ? probation.Back() : protect.Back(); }
+
+	private:
+		static const uint32_t ExpectedEntryBytes = 256; // sizes the sketch from a byte capacity
+
+		CacheList window, probation, protect;
+		uint64_t windowBytes, mainBytes, protectedBytes;
+		FrequencySketch sketch;
+	};
+
+	// CLOCK-Pro, with the clock kept as a list that the hand walks from the back: passing an
+	// entry moves it to the front. New entries are cold and on test; a cold entry referenced
+	// during its test becomes hot, and a key evicted while on test is remembered by hash so
+	// that its return comes back hot and gives cold entries more room.
+	class ClockProPolicy : public CachePolicy
+	{
+	public:
+		ClockProPolicy(uint64_t capacity) : hotBytes(0), coldBytes(0), residents(0) { SetCapacity(capacity); }
+
+		void SetCapacity(uint64_t _capacity)
+		{
+			capacity = _capacity;
+			minColdTarget = capacity / 100 > 0 ? capacity / 100 : 1;
+			maxColdTarget = capacity - minColdTarget;
+			coldTarget = capacity / 10 > minColdTarget ? capacity / 10 : minColdTarget;
+		}
+
+		void Inserted(CacheNode *node)
+		{
+			node->Referenced = false;
+			node->InTest = false;
+
+			std::unordered_map<HashType, uint32_t>::iterator it = ghosts.find(node->Hash);
+			if (it != ghosts.end())
+			{
+				// evicted too early, cold entries needed more room
+				coldTarget = coldTarget + node->Charge < maxColdTarget ? coldTarget + node->Charge : maxColdTarget;
+				forgetGhost(it);
+				node->Segment = Hot;
+				hotBytes += node->Charge;
+			}
+			else
+			{
+				node->Segment = Cold;
+				node->InTest = true;
+				coldBytes += node->Charge;
+			}
+
+			clock.PushFront(node);
+			residents++;
+		}
+
+		void Touched(CacheNode *node) { node->Referenced = true; }
+
+		void Removed(CacheNode *node)
+		{
+			(node->Segment == Hot ? hotBytes : coldBytes) -= node->Charge;
+			clock.Remove(node);
+			residents--;
+		}
+
+		CacheNode* Victim()
+		{
+			// every pass clears a reference bit or a test, two rounds always find a victim
+			for (uint32_t step = 0; step < 2 * residents + 2; step++)
+			{
+				CacheNode *node = clock.Back();
+				if (node == nullptr) return nullptr;
+
+				if (node->Segment == Hot)
+				{
+					if (!node->Referenced && hotBytes > capacity - coldTarget)
+					{
+						hotBytes -= node->Charge; // demote, it goes the next time round unless used
+						coldBytes += node->Charge;
+						node->Segment = Cold;
+						node->InTest = false;
+					}
+				}
+				else if (node->Referenced)
+				{
+					if (node->InTest)
+					{
+						coldBytes -= node->Charge; // reused while on test
+						hotBytes += node->Charge;
+						node->Segment = Hot;
+						node->InTest = false;
+					}
+					else node->InTest = true;
+				}
+				else
+				{
+					if (node->InTest) rememberGhost(node->Hash, node->Charge);
+					return node;
+				}
+
+				node->Referenced = false;
+				clock.MoveToFront(node);
+			}
+
+			return clock.Back();
+		}
+
+		void ForEach(const VisitorType &func) const
+		{
+			clock.ForEach([&](const CacheNode *node) { return node->Segment != Hot || func(node); }) &&
+				clock.ForEach([&](const CacheNode *node) { return node->Segment != Cold || func(node); });
+		}
+
+	private:
+		enum Segment { Hot, Cold };
+
+		void rememberGhost(HashType hash, uint64_t charge)
+		{
+			ghosts[hash]++;
+			ghostQueue.push_back(std::make_pair(hash, charge));
+
+			// as many non-resident keys as resident ones, an expired test means cold got enough
+			while (ghostQueue.size() > residents && !ghostQueue.empty())
+			{
+				std::unordered_map<HashType, uint32_t>::iterator it = ghosts.find(ghostQueue.front().first);
+				if (it != ghosts.end()) forgetGhost(it);
+
+				uint64_t expired = ghostQueue.front().second;
+				coldTarget = coldTarget > minColdTarget + expired ? coldTarget - expired : minColdTarget;
+				ghostQueue.pop_front();
+			}
+		}
+
+		void forgetGhost(std::unordered_map<HashType, uint32_t>::iterator it)
+		{
+			if (--it->second == 0) ghosts.erase(it);
+		}
+
+	private:
+		CacheList clock;
+		uint64_t capacity, coldTarget, minColdTarget, maxColdTarget;
+		uint64_t hotBytes, coldBytes;
+		uint32_t residents;
+
+		std::unordered_map<HashType, uint32_t> ghosts; // hash -> times on ghostQueue
+		std::deque<std::pair<HashType, uint64_t>> ghostQueue;
+	};
+
+	inline CachePolicy* CachePolicy::Create(Type type, uint64_t capacity)
+	{
+		switch (type)
+		{
+		case TinyLFU: return new TinyLFUPolicy(capacity);
+		case ClockPro: return new ClockProPolicy(capacity);
+		default: return new LRUPolicy;
+		}
+	}
+} // namespace FreshCask
+
+#endif // __UTIL_CACHEPOLICY_HPP__
@@ -1,141 +1,511 @@
 #ifndef __UTIL_LRUCACHE_HPP__
 #define __UTIL_LRUCACHE_HPP__
 
-#include <unordered_map>
+#include <atomic>
 #include <vector>
 
 #include <Util/LockGuard.hpp>
+#include <Util/CachePolicy.hpp>
+#include <Util/SlabAllocator.hpp>
+#include <Util/StatCounter.hpp>
+#include <Util/PinnableSlice.hpp>
 
 #include <Algorithm/MurmurHash3.hpp>
 
 namespace FreshCask
 {
+	// Value cache of a bucket. Split into shards by key hash, each with its own lock, eviction
+	// policy and share of the capacity, so hits on different shards never contend. Key and
+	// value are copied into a slab chunk, capacity counts chunk sizes plus the per-entry
+	// overhead, and a lookup always compares the full key: two keys with the same hash are
+	// simply chained in the same slot. An entry pinned by a PinnableSlice is never written
+	// over, and once removed its chunk is only freed when the last slice lets go of it.
+	// Buckets sharing one cache each keep their keys in a space of their own, a space nobody
+	// looks up any more is taken back by eviction like any other cold entry.
 	class LRUCache
 	{
 	private:
-		struct Node {
-			SmartByteArray key, value;
-			Node *prev, *next;
+		typedef CacheNode Node;
+
+		struct Counters
+		{
+			StatCounter Hits, Misses, Inserts, Evictions;
+			StatCounter ResidentBytes, Entries;
 		};
 
-	public:
-		LRUCache(size_t Size = DefaultLRUCacheSize)
+		class Shard
 		{
-			entries = new Node[Size];
+		public:
+			Shard() : syncMutex("LRUCache.Shard", DefaultLockSpins), slab(nullptr), counters(nullptr), policy(nullptr), capacity(0), usage(0), count(0), slots(InitSlotCount, nullptr) {}
 
-			for (size_t i = 0; i < Size; i++) // store avaliable nodes
-				freeEntires.push_back(entries + i);
+			~Shard()
+			{
+				Clear();
+				for (auto& node : freeNodes) delete node;
+				delete policy;
+			}
 
-			head = new Node; tail = new Node; 
-			head->prev = NULL; head->next = tail;
-			tail->prev = head; tail->next = NULL;
-		}
+			void Reset(SlabAllocator *_slab, Counters *_counters, uint64_t _capacity, CachePolicy::Type type)
+			{
+				LockGuard lock(syncMutex);
 
-		~LRUCache()
-		{
-			delete head;
-			delete tail;
-			delete[] entries;
-		}
+				slab = _slab;
+				counters = _counters;
+				clear();
+				delete policy;
+				policy = CachePolicy::Create(type, _capacity);
+				capacity = _capacity;
+			}
 
-		Status Put(const SmartByteArray& key, const SmartByteArray& value)
-		{
-			HashType hash;
-			RET_IFNOT_OK(HashFunction(key, hash), "LRUCache::Put()");
+			void SetCapacity(uint64_t _capacity)
+			{
+				LockGuard lock(syncMutex);
+				capacity = _capacity;
+				policy->SetCapacity(capacity);
+				evict();
+			}
+
+			void Put(const SmartByteArray& key, const SmartByteArray& value, HashType hash, uint32_t space)
+			{
+				uint8_t sizeClass;
+				if (!slab->ClassOf(key.Size() + value.Size(), sizeClass))
+				{
+					Delete(key, hash, space); // too large to cache, but the old value must not survive
+					return;
+				}
+				uint64_t charge = sizeof(Node) + slab->ChunkSize(sizeClass);
 
-			LockGuard lock(syncMutex);
+				LockGuard lock(syncMutex);
 
-			Node *node = hashMap[hash];
-			if (node) // node exists 
+				Node **slot = find(key, hash, space);
+				if (*slot != nullptr) // node exists
+				{
+					Node *node = *slot;
+					if (node->SizeClass == sizeClass && node->Pins == 0)
+					{
+						// same chunk size, overwrite in place
+						if (value.Size() > 0) memcpy(node->Item + node->SizeOfKey, value.Data(), value.Size());
+						node->SizeOfValue = value.Size();
+						policy->Touched(node);
+						return;
+					}
+
+					remove(slot);
+				}
+
+				if (charge > capacity) return; // would evict everything and still not fit
+
+				// out of pages, evicting frees chunks and, once a page is empty, the page
+				SlabAllocator::Page *page;
+				BytePtr item = slab->Allocate(sizeClass, page);
+				for (uint32_t tries = 0; item == nullptr && count > 0 && tries < MaxEvictTries; tries++)
+				{
+					remove(findNode(policy->Victim()), true);
+					item = slab->Allocate(sizeClass, page);
+				}
+				if (item == nullptr) return;
+
+				Node *node;
+				if (freeNodes.empty()) node = new Node;
+				else
+				{
+					node = freeNodes.back();
+					freeNodes.pop_back();
+				}
+
+				memcpy(item, key.Data(), key.Size());
+				if (value.Size() > 0) memcpy(item + key.Size(), value.Data(), value.Size());
+				node->Item = item;
+				node->SlabPage = page;
+				node->SizeOfKey = key.Size();
+				node->SizeOfValue = value.Size();
+				node->Space = space;
+				node->SizeClass = sizeClass;
+				node->Hash = hash;
+				node->Charge = charge;
+				node->Pins = 0;
+				node->Detached = false;
+				node->NextInSlot = nullptr;
+				*find(key, hash, space) = node; // evictions may have changed the chain
+				policy->Inserted(node);
+
+				usage += charge;
+				if (++count > slots.size()) rehash();
+
+				counters->Inserts.Add();
+				counters->ResidentBytes.Add(charge);
+				counters->Entries.Add();
+
+				evict();
+			}
+
+			bool Get(const SmartByteArray& key, HashType hash, uint32_t space, SmartByteArray& out)
 			{
-				Deatch(node);
-				node->value = value;
-				Attach(node);
+				LockGuard lock(syncMutex);
+
+				policy->Accessed(hash);
+
+				Node *node = *find(key, hash, space);
+				if (node == nullptr)
+				{
+					counters->Misses.Add();
+					return false;
+				}
+				counters->Hits.Add();
+
+				policy->Touched(node);
+
+				// the chunk is reused once evicted, the caller gets a copy
+				out = SmartByteArray::Copy(node->Item + node->SizeOfKey, node->SizeOfValue);
+				return true;
 			}
-			else
+
+			bool GetPinned(const SmartByteArray& key, HashType hash, uint32_t space, PinnableSlice& out)
 			{
-				if (freeEntires.empty()) // no avaliable nodes
+				out.Reset(); // may unpin a node of this very shard, so before locking
+
+				LockGuard lock(syncMutex);
+
+				policy->Accessed(hash);
+
+				Node *node = *find(key, hash, space);
+				if (node == nullptr)
 				{
-					node = tail->prev;
-					Deatch(node);
-					hashMap.erase(hash);
+					counters->Misses.Add();
+					return false;
 				}
-				else
+				counters->Hits.Add();
+
+				policy->Touched(node);
+
+				node->Pins++;
+				out.Pin(node->Item + node->SizeOfKey, node->SizeOfValue, &Shard::unpin, this, node);
+				return true;
+			}
+
+			bool Delete(const SmartByteArray& key, HashType hash, uint32_t space)
+			{
+				LockGuard lock(syncMutex);
+
+				Node **slot = find(key, hash, space);
+				if (*slot == nullptr) return false;
+
+				remove(slot);
+				return true;
+			}
+
+			void Clear()
+			{
+				LockGuard lock(syncMutex);
+				clear();
+			}
+
+			void GetKeys(std::vector<SmartByteArray> &out, size_t maxCount, uint32_t space)
+			{
+				LockGuard lock(syncMutex);
+
+				policy->ForEach([&](const Node *node) {
+					if (out.size() >= maxCount) return false;
+
+					if (node->Space == space) out.push_back(SmartByteArray::Copy(node->Item, node->SizeOfKey));
+					return true;
+				});
+			}
+
+		private:
+			// slot of the node holding key, or the empty slot at the end of its chain
+			Node** find(const SmartByteArray& key, HashType hash, uint32_t space)
+			{
+				Node **slot = &slots[hash & (slots.size() - 1)];
+				while (*slot != nullptr && !((*slot)->Hash == hash && (*slot)->Space == space && equals(*slot, key)))
+					slot = &(*slot)->NextInSlot;
+				return slot;
+			}
+
+			Node** findNode(Node *node)
+			{
+				Node **slot = &slots[node->Hash & (slots.size() - 1)];
+				while (*slot != node) slot = &(*slot)->NextInSlot;
+				return slot;
+			}
+
+			void remove(Node **slot, bool evicted = false)
+			{
+				Node *node = *slot;
+				*slot = node->NextInSlot;
+				policy->Removed(node);
+
+				usage -= node->Charge;
+				count--;
+
+				if (evicted) counters->Evictions.Add();
+				counters->ResidentBytes.Add(-(int64_t)node->Charge);
+				counters->Entries.Add(-1);
+
+				if (node->Pins > 0)
 				{
-					node = freeEntires.back();
-					freeEntires.pop_back();
+					node->Detached = true;
+					return;
 				}
-				node->key = key;
-				node->value = value;
-				hashMap[hash] = node;
-				Attach(node);
+
+				// chunk goes back to its class, the node is kept for the next insertion
+				slab->Free(node->Item, static_cast<SlabAllocator::Page*>(node->SlabPage));
+				node->Item = nullptr;
+				freeNodes.push_back(node);
 			}
 
-			RET_BY_SENDER(Status::OK(), "LRUCache::Put()");
+			static void unpin(void *owner, void *handle)
+			{
+				Shard *shard = static_cast<Shard*>(owner);
+				Node *node = static_cast<Node*>(handle);
+				LockGuard lock(shard->syncMutex);
+
+				if (--node->Pins == 0 && node->Detached)
+				{
+					shard->slab->Free(node->Item, static_cast<SlabAllocator::Page*>(node->SlabPage));
+					node->Item = nullptr;
+					node->Detached = false;
+					shard->freeNodes.push_back(node);
+				}
+			}
+
+			void evict()
+			{
+				while (usage > capacity && count > 0)
+					remove(findNode(policy->Victim()), true);
+			}
+
+			void clear()
+			{
+				while (count > 0)
+					remove(findNode(policy->Victim()));
+			}
+
+			void rehash()
+			{
+				std::vector<Node*> newSlots(slots.size() * 2, nullptr);
+				for (auto& slot : slots)
+				{
+					for (Node *node = slot; node != nullptr; )
+					{
+						Node *next = node->NextInSlot;
+						Node *&newSlot = newSlots[node->Hash & (newSlots.size() - 1)];
+						node->NextInSlot = newSlot;
+						newSlot = node;
+						node = next;
+					}
+				}
+				slots.swap(newSlots);
+			}
+
+			static bool equals(const Node *node, const SmartByteArray& key)
+			{
+				return node->SizeOfKey == key.Size() && (key.Size() == 0 || memcmp(node->Item, key.Data(), key.Size()) == 0);
+			}
+
+		private:
+			static const size_t InitSlotCount = 64; // power of 2
+			static const uint32_t MaxEvictTries = 8;
+
+			Mutex syncMutex;
+			SlabAllocator *slab;
+			Counters *counters;
+			CachePolicy *policy;
+			uint64_t capacity, usage;
+			size_t count;
+
+			std::vector<Node*> slots;
+			std::vector<Node*> freeNodes;
+		};
+
+	public:
+		//************************************
+		// Method:    LRUCache
+		// FullName:  FreshCask::LRUCache::LRUCache
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint64_t capacity, in bytes across all shards
+		// Parameter: uint32_t shardCount, rounded up to a power of 2
+		// Parameter: CachePolicy::Type policy
+		//************************************
+		LRUCache(uint64_t capacity = DefaultLRUCacheBytes, uint32_t shardCount = DefaultLRUCacheShards, CachePolicy::Type policy = DefaultCachePolicy)
+			: shardBits(0), slab(capacity)
+		{
+			while ((1u << shardBits) < shardCount) shardBits++;
+
+			shards = new Shard[1u << shardBits];
+			Reset(capacity, policy);
+		}
+
+		~LRUCache() { delete[] shards; }
+
+		LRUCache(const LRUCache&) = delete;
+		LRUCache& operator=(const LRUCache&) = delete;
+
+		void SetCapacity(uint64_t capacity)
+		{
+			uint32_t shardCount = 1u << shardBits;
+			for (uint32_t i = 0; i < shardCount; i++)
+				shards[i].SetCapacity((capacity + shardCount - 1) / shardCount);
+			slab.SetLimit(capacity);
+		}
+
+		//************************************
+		// Method:    Reset
+		// FullName:  FreshCask::LRUCache::Reset
+		// Access:    public
+		// Returns:   void
+		// Desc:      Drop every entry and start over with another capacity and policy
+		// Parameter: uint64_t capacity
+		// Parameter: CachePolicy::Type policy
+		//************************************
+		void Reset(uint64_t capacity, CachePolicy::Type policy)
+		{
+			uint32_t shardCount = 1u << shardBits;
+			for (uint32_t i = 0; i < shardCount; i++)
+				shards[i].Reset(&slab, &counters, (capacity + shardCount - 1) / shardCount, policy);
+			slab.SetLimit(capacity);
 		}
 
-		Status Get(const SmartByteArray& key, SmartByteArray& out)
+		Status Put(const SmartByteArray& key, const SmartByteArray& value, uint32_t space = 0)
 		{
 			HashType hash;
-			RET_IFNOT_OK(HashFunction(key, hash), "LRUCache::Gut()");
+			RET_IFNOT_OK(hashOf(key, space, hash), "LRUCache::Put()");
 
-			LockGuard lock(syncMutex);
+			shardOf(hash).Put(key, value, hash, space);
+			RET_BY_SENDER(Status::OK(), "LRUCache::Put()");
+		}
 
-			Node *node = hashMap[hash];
-			if (node)
-			{
-				Deatch(node);
-				Attach(node);
-				out = node->value;
+		Status Get(const SmartByteArray& key, SmartByteArray& out, uint32_t space = 0)
+		{
+			HashType hash;
+			RET_IFNOT_OK(hashOf(key, space, hash), "LRUCache::Get()");
 
+			if (shardOf(hash).Get(key, hash, space, out))
 				RET_BY_SENDER(Status::OK(), "LRUCache::Get()");
-			}
 			else
 				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "LRUCache::Get()");
 		}
 
-		Status Delete(const SmartByteArray& key)
+		//************************************
+		// Method:    GetPinned
+		// FullName:  FreshCask::LRUCache::GetPinned
+		// Access:    public
+		// Returns:   Status, NotFound if not cached
+		// Desc:      Point out at the cached value without copying it, the entry stays as it
+		//            is until out is released, however it is evicted or written over meanwhile
+		// Parameter: const SmartByteArray & key
+		// Parameter: PinnableSlice & out
+		// Parameter: uint32_t space
+		//************************************
+		Status GetPinned(const SmartByteArray& key, PinnableSlice& out, uint32_t space = 0)
 		{
 			HashType hash;
-			RET_IFNOT_OK(HashFunction(key, hash), "LRUCache::Delete()");
+			RET_IFNOT_OK(hashOf(key, space, hash), "LRUCache::GetPinned()");
 
-			LockGuard lock(syncMutex);
+			if (shardOf(hash).GetPinned(key, hash, space, out))
+				RET_BY_SENDER(Status::OK(), "LRUCache::GetPinned()");
+			else
+				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "LRUCache::GetPinned()");
+		}
 
-			Node *node = hashMap[hash];
-			if (node)
-			{
-				Deatch(node);
-				hashMap.erase(hash);
-				freeEntires.push_back(node);
+		Status Delete(const SmartByteArray& key, uint32_t space = 0)
+		{
+			HashType hash;
+			RET_IFNOT_OK(hashOf(key, space, hash), "LRUCache::Delete()");
 
+			if (shardOf(hash).Delete(key, hash, space))
 				RET_BY_SENDER(Status::OK(), "LRUCache::Delete()");
-			}
 			else
 				RET_BY_SENDER(Status::NotFound("Key doesn't exist"), "LRUCache::Delete()");
 		}
 
-	private:
-		void Deatch(Node *node)
+		void Clear()
 		{
-			node->prev->next = node->next;
-			node->next->prev = node->prev;
+			for (uint32_t i = 0; i < (1u << shardBits); i++)
+				shards[i].Clear();
 		}
 
-		void Attach(Node *node)
+		// bytes charged across all shards
+		uint64_t GetUsage() const { return (uint64_t)counters.ResidentBytes.Get(); }
+
+		struct Stats
 		{
-			node->next = head->next;
-			node->prev = head;
-			head->next = node;
-			node->next->prev = node;
+			uint64_t Hits, Misses;
+			uint64_t Inserts, Evictions; // evictions for room, deletions not counted
+			uint64_t ResidentBytes;      // as charged against capacity
+			uint64_t Entries;
+			uint64_t MemoryBytes;        // slab pages taken
+		};
+
+		// lock-free, counters are summed as they are
+		Stats GetStats() const
+		{
+			Stats stats;
+			stats.Hits = counters.Hits.Get();
+			stats.Misses = counters.Misses.Get();
+			stats.Inserts = counters.Inserts.Get();
+			stats.Evictions = counters.Evictions.Get();
+			stats.ResidentBytes = counters.ResidentBytes.Get();
+			stats.Entries = counters.Entries.Get();
+			stats.MemoryBytes = slab.GetMemory();
+			return stats;
 		}
 
+		//************************************
+		// Method:    GetHotKeys
+		// FullName:  FreshCask::LRUCache::GetHotKeys
+		// Access:    public
+		// Returns:   void
+		// Desc:      Copy out cached keys, most worth keeping first as the policies see it.
+		//            Shards are interleaved, the i-th key of every shard before any (i+1)-th.
+		// Parameter: std::vector<SmartByteArray> & out
+		// Parameter: size_t maxCount
+		// Parameter: uint32_t space
+		//************************************
+		void GetHotKeys(std::vector<SmartByteArray> &out, size_t maxCount, uint32_t space = 0)
+		{
+			uint32_t shardCount = 1u << shardBits;
+			std::vector<std::vector<SmartByteArray>> perShard(shardCount);
+			for (uint32_t i = 0; i < shardCount; i++)
+				shards[i].GetKeys(perShard[i], (maxCount + shardCount - 1) / shardCount, space);
+
+			out.clear();
+			for (size_t rank = 0; out.size() < maxCount; rank++)
+			{
+				bool any = false;
+				for (uint32_t i = 0; i < shardCount && out.size() < maxCount; i++)
+				{
+					if (rank >= perShard[i].size()) continue;
+					out.push_back(perShard[i][rank]);
+					any = true;
+				}
+				if (!any) break;
+			}
+		}
+
+		// bytes of slab pages taken, what the cache really holds on to
+		uint64_t GetMemory() const { return slab.GetMemory(); }
+
 	private:
-		Mutex syncMutex;
+		// the same key hashes apart in every space, so spaces don't crowd the same slots
+		static Status hashOf(const SmartByteArray& key, uint32_t space, HashType& hash)
+		{
+			RET_IFNOT_OK(HashFunction(key, hash), "LRUCache::hashOf()");
+			if (space != 0) hash = fmix(hash ^ (space * 0x9E3779B1u));
+			RET_BY_SENDER(Status::OK(), "LRUCache::hashOf()");
+		}
 
-		Node *entries, *head, *tail;
-		std::vector<Node*> freeEntires;
-		std::unordered_map<HashType, Node*> hashMap;
+		// high bits pick the shard, low bits the slot within it
+		Shard& shardOf(HashType hash) { return shards[shardBits == 0 ? 0 : hash >> (32 - shardBits)]; }
+
+	private:
+		Shard *shards;
+		uint32_t shardBits;
+		SlabAllocator slab; // shared by the shards, every class has its own lock
+		Counters counters;
 	};
 } // namespace FreshCask
 
-#endif // __UTIL_LRUCACHE_HPP__
\ No newline at end of file
+#endif // __UTIL_LRUCACHE_HPP__
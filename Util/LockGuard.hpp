@@ -5,14 +5,75 @@
 #include <Windows.h>
 #else
 #include <mutex>
+#include <thread>
+#include <shared_mutex>
 #endif
 
+#include <algorithm>
+
+#include <Util/LockProfiler.hpp>
+
 namespace FreshCask
 {
+	// Spin-then-block: before a thread blocks on a lock it tries it again for up to twice as
+	// many spins as acquiring it took lately, plus a few, at most maxSpins. Locks held only
+	// for a short while are then mostly taken without the thread ever going to sleep.
+	class AdaptiveSpin
+	{
+	public:
+		AdaptiveSpin(uint32_t maxSpins) : maxSpins(maxSpins), estimate(0) {}
+
+		//************************************
+		// Method:    Spin
+		// FullName:  FreshCask::AdaptiveSpin::Spin
+		// Access:    public
+		// Returns:   bool, false if the caller still has to block
+		// Parameter: TryLockFunc tryLock
+		//************************************
+		template <typename TryLockFunc>
+		bool Spin(TryLockFunc tryLock)
+		{
+			if (maxSpins == 0) return false;
+
+			int32_t last = estimate.load(std::memory_order_relaxed);
+			uint32_t limit = std::min<uint32_t>(maxSpins, (uint32_t)last * 2 + 10);
+
+			uint32_t spins = 0;
+			bool acquired = false;
+			for (; spins < limit && !(acquired = tryLock()); spins++) cpuRelax();
+
+			estimate.store(last + ((int32_t)spins - last) / 8, std::memory_order_relaxed);
+			return acquired;
+		}
+
+	private:
+		static void cpuRelax()
+		{
+#ifdef WIN32
+			YieldProcessor();
+#else
+			std::this_thread::yield();
+#endif
+		}
+
+	private:
+		uint32_t maxSpins;
+		std::atomic<int32_t> estimate; // moving average of spins it took to acquire
+	};
+
 	class Mutex
 	{
 	public:
-		Mutex() 
+		//************************************
+		// Method:    Mutex
+		// FullName:  FreshCask::Mutex::Mutex
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: const char * name, lock site the mutex reports to, see LockProfiler
+		// Parameter: uint32_t maxSpins, 0 to block at once
+		//************************************
+		Mutex(const char *name = nullptr, uint32_t maxSpins = 0) : site(name != nullptr ? LockProfiler::Default().Site(name) : nullptr), spin(maxSpins)
 		{
 #ifdef WIN32
 			InitializeCriticalSection(&cs);
@@ -30,10 +91,15 @@ namespace FreshCask
 
 		void Lock()
 		{
+			ProfiledAcquire(site, [this] { return TryLock(); }, [this] { if (!spin.Spin([this] { return TryLock(); })) lock(); });
+		}
+
+		bool TryLock()
+		{
 #ifdef WIN32
-			EnterCriticalSection(&cs);
+			return TryEnterCriticalSection(&cs) != FALSE;
 #else
-			mtx.lock();
+			return mtx.try_lock();
 #endif
 		}
 
@@ -46,12 +112,125 @@ namespace FreshCask
 #endif
 		}
 
+	private:
+		void lock()
+		{
+#ifdef WIN32
+			EnterCriticalSection(&cs);
+#else
+			mtx.lock();
+#endif
+		}
+
 	private:
 #ifdef WIN32
 		CRITICAL_SECTION cs;
 #else
 		std::mutex mtx;
 #endif
+		LockSite *site;
+		AdaptiveSpin spin;
+	};
+
+	// Many readers or one writer. Unlike Mutex it is not recursive, a thread holding it must
+	// not acquire it again in either mode.
+	class RWMutex
+	{
+	public:
+		//************************************
+		// Method:    RWMutex
+		// FullName:  FreshCask::RWMutex::RWMutex
+		// Access:    public
+		// Returns:
+		// Qualifier: Shared acquires report to a site of their own, name followed by " (shared)".
+		// Parameter: const char * name, lock site the mutex reports to, see LockProfiler
+		// Parameter: uint32_t maxSpins, 0 to block at once
+		//************************************
+		RWMutex(const char *name = nullptr, uint32_t maxSpins = 0)
+			: site(name != nullptr ? LockProfiler::Default().Site(name) : nullptr),
+			sharedSite(name != nullptr ? LockProfiler::Default().Site(std::string(name) + " (shared)") : nullptr), spin(maxSpins)
+		{
+#ifdef WIN32
+			InitializeSRWLock(&srw);
+#endif
+		}
+
+		RWMutex(const RWMutex&) = delete;
+		RWMutex& operator=(const RWMutex&) = delete;
+
+		void Lock()
+		{
+			ProfiledAcquire(site, [this] { return TryLock(); }, [this] { if (!spin.Spin([this] { return TryLock(); })) lock(); });
+		}
+
+		void LockShared()
+		{
+			ProfiledAcquire(sharedSite, [this] { return TryLockShared(); }, [this] { if (!spin.Spin([this] { return TryLockShared(); })) lockShared(); });
+		}
+
+		bool TryLock()
+		{
+#ifdef WIN32
+			return TryAcquireSRWLockExclusive(&srw) != FALSE;
+#else
+			return mtx.try_lock();
+#endif
+		}
+
+		bool TryLockShared()
+		{
+#ifdef WIN32
+			return TryAcquireSRWLockShared(&srw) != FALSE;
+#else
+			return mtx.try_lock_shared();
+#endif
+		}
+
+		void Unlock()
+		{
+#ifdef WIN32
+			ReleaseSRWLockExclusive(&srw);
+#else
+			mtx.unlock();
+#endif
+		}
+
+		void UnlockShared()
+		{
+#ifdef WIN32
+			ReleaseSRWLockShared(&srw);
+#else
+			mtx.unlock_shared();
+#endif
+		}
+
+	private:
+		void lock()
+		{
+#ifdef WIN32
+			AcquireSRWLockExclusive(&srw);
+#else
+			mtx.lock();
+#endif
+		}
+
+		void lockShared()
+		{
+#ifdef WIN32
+			AcquireSRWLockShared(&srw);
+#else
+			mtx.lock_shared();
+#endif
+		}
+
+	private:
+#ifdef WIN32
+		SRWLOCK srw;
+#else
+		std::shared_mutex mtx;
+#endif
+		LockSite *site, *sharedSite;
+		AdaptiveSpin spin;
 	};
 
 	class LockGuard
@@ -67,6 +246,32 @@ namespace FreshCask
 		Mutex& mtx;
 	};
 
+	class ReadLockGuard
+	{
+	public:
+		explicit ReadLockGuard(RWMutex& _mtx) : mtx(_mtx) { mtx.LockShared(); }
+		~ReadLockGuard() { mtx.UnlockShared(); }
+
+		ReadLockGuard(const ReadLockGuard&) = delete;
+		ReadLockGuard& operator=(const ReadLockGuard&) = delete;
+
+	private:
+		RWMutex& mtx;
+	};
+
+	class WriteLockGuard
+	{
+	public:
+		explicit WriteLockGuard(RWMutex& _mtx) : mtx(_mtx) { mtx.Lock(); }
+		~WriteLockGuard() { mtx.Unlock(); }
+
+		WriteLockGuard(const WriteLockGuard&) = delete;
+		WriteLockGuard& operator=(const WriteLockGuard&) = delete;
+
+	private:
+		RWMutex& mtx;
+	};
+
 } // namespace FreshCask
 
-#endif // __UTIL_LOCKGUARD_HPP__
\ No newline at end of file
+#endif // __UTIL_LOCKGUARD_HPP__
@@ -0,0 +1,185 @@
+#ifndef __UTIL_LOCKPROFILER_HPP__
+#define __UTIL_LOCKPROFILER_HPP__
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <Util/StatCounter.hpp>
+
+namespace FreshCask
+{
+	// Counters of one named lock site. Several locks may share a site, such as the shards of
+	// a cache, their counters add up.
+	class LockSite
+	{
+	public:
+		// waits are counted by powers of two of microseconds, bucket 0 holds waits under 1 us
+		// and the last one everything from about 4 seconds on
+		static const uint32_t HistogramBuckets = 24;
+
+		struct Stats
+		{
+			std::string Name;
+			uint64_t Acquires, Contended; // contended: the lock was held by someone else
+			uint64_t WaitNanos, MaxWaitNanos; // of contended acquires
+			uint64_t Histogram[HistogramBuckets];
+		};
+
+	public:
+		LockSite(const std::string &name) : name(name) { Reset(); }
+
+		LockSite(const LockSite&) = delete;
+		LockSite& operator=(const LockSite&) = delete;
+
+		void Acquired() { acquires.Add(); }
+
+		void Waited(uint64_t nanos)
+		{
+			acquires.Add();
+			contended.Add();
+			waitNanos.Add((int64_t)nanos);
+
+			uint32_t bucket = 0;
+			for (uint64_t us = nanos / 1000; us > 0 && bucket < HistogramBuckets - 1; us >>= 1) bucket++;
+			histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+			uint64_t max = maxWaitNanos.load(std::memory_order_relaxed);
+			while (nanos > max && !maxWaitNanos.compare_exchange_weak(max, nanos, std::memory_order_relaxed));
+		}
+
+		Stats GetStats() const
+		{
+			Stats stats;
+			stats.Name = name;
+			stats.Acquires = (uint64_t)acquires.Get();
+			stats.Contended = (uint64_t)contended.Get();
+			stats.WaitNanos = (uint64_t)waitNanos.Get();
+			stats.MaxWaitNanos = maxWaitNanos.load(std::memory_order_relaxed);
+			for (uint32_t i = 0; i < HistogramBuckets; i++) stats.Histogram[i] = histogram[i].load(std::memory_order_relaxed);
+			return stats;
+		}
+
+		void Reset()
+		{
+			acquires.Reset(), contended.Reset(), waitNanos.Reset();
+			maxWaitNanos.store(0, std::memory_order_relaxed);
+			for (auto& bucket : histogram) bucket.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		std::string name;
+		StatCounter acquires, contended, waitNanos;
+		std::atomic<uint64_t> maxWaitNanos;
+		std::atomic<uint64_t> histogram[HistogramBuckets]; // bumped only after a wait, no need to stripe
+	};
+
+	// Process-wide registry of lock sites. Profiling is off until enabled, a named lock then
+	// counts every acquire and times those it had to wait for; an unnamed lock never does.
+	class LockProfiler
+	{
+	public:
+		//************************************
+		// Method:    Site
+		// FullName:  FreshCask::LockProfiler::Site
+		// Access:    public
+		// Returns:   FreshCask::LockSite *, lives as long as the process
+		// Qualifier: Locks given the same name share one site.
+		// Parameter: const std::string & name
+		//************************************
+		LockSite* Site(const std::string &name)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::unique_ptr<LockSite> &site = sites[name];
+			if (site == nullptr) site.reset(new LockSite(name));
+			return site.get();
+		}
+
+		static void SetEnabled(bool enable) { enabled().store(enable, std::memory_order_relaxed); }
+		static bool IsEnabled() { return enabled().load(std::memory_order_relaxed); }
+
+		// sites ever acquired while profiling was on, by name
+		std::vector<LockSite::Stats> GetStats()
+		{
+			std::vector<LockSite::Stats> stats;
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& site : sites)
+			{
+				LockSite::Stats siteStats = site.second->GetStats();
+				if (siteStats.Acquires > 0) stats.push_back(siteStats);
+			}
+			return stats;
+		}
+
+		// one line per site: acquires, contended share, wait times and the histogram's non-empty buckets
+		std::string Dump()
+		{
+			std::ostringstream out;
+			for (auto& stats : GetStats())
+			{
+				out << stats.Name << ": " << stats.Acquires << " acquires, " << stats.Contended << " contended ("
+					<< stats.Contended * 100.0 / stats.Acquires << "%), ";
+				if (stats.Contended > 0)
+					out << stats.WaitNanos / stats.Contended / 1000.0 << " us avg wait, " << stats.MaxWaitNanos / 1000.0 << " us max";
+				else
+					out << "no waits";
+
+				for (uint32_t i = 0; i < LockSite::HistogramBuckets; i++)
+				{
+					if (stats.Histogram[i] == 0) continue;
+					if (i == LockSite::HistogramBuckets - 1) out << " | >=" << (1ull << (i - 1)) << "us: ";
+					else out << " | <" << (1ull << i) << "us: ";
+					out << stats.Histogram[i];
+				}
+				out << std::endl;
+			}
+			return out.str();
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& site : sites) site.second->Reset();
+		}
+
+		static LockProfiler& Default()
+		{
+			static LockProfiler profiler;
+			return profiler;
+		}
+
+	private:
+		LockProfiler() {}
+
+		static std::atomic<bool>& enabled()
+		{
+			static std::atomic<bool> flag(false);
+			return flag;
+		}
+
+	private:
+		std::mutex mutex; // not a Mutex, those report here
+		std::map<std::string, std::unique_ptr<LockSite>> sites;
+	};
+
+	// Times acquiring a lock for site, if profiling is on: counts an acquire that got the lock
+	// at once, times one that had to wait for it.
+	template <typename TryLockFunc, typename LockFunc>
+	inline void ProfiledAcquire(LockSite *site, TryLockFunc tryLock, LockFunc lock)
+	{
+		if (site == nullptr || !LockProfiler::IsEnabled()) { lock(); return; }
+
+		if (tryLock()) { site->Acquired(); return; }
+
+		auto start = std::chrono::steady_clock::now();
+		lock();
+		site->Waited((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+} // namespace FreshCask
+
+#endif // __UTIL_LOCKPROFILER_HPP__
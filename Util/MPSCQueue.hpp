@@ -0,0 +1,71 @@
+#ifndef __UTIL_MPSCQUEUE_HPP__
+#define __UTIL_MPSCQUEUE_HPP__
+
+#include <atomic>
+
+namespace FreshCask
+{
+	// Intrusive lock-free multi-producer single-consumer queue (Dmitry Vyukov's algorithm).
+	// Push() is wait-free and may be called from any thread, Pop() from one thread only.
+	class MPSCQueue
+	{
+	public:
+		struct Node
+		{
+			std::atomic<Node*> next;
+			Node() : next(nullptr) {}
+		};
+
+	public:
+		MPSCQueue() : head(&stub), tail(&stub) {}
+
+		MPSCQueue(const MPSCQueue&) = delete;
+		MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+		void Push(Node *node)
+		{
+			node->next.store(nullptr, std::memory_order_relaxed);
+			Node *prev = head.exchange(node, std::memory_order_acq_rel);
+			prev->next.store(node, std::memory_order_release);
+		}
+
+		// Returns nullptr if the queue is empty, or if a producer is in the middle of Push().
+		Node* Pop()
+		{
+			Node *first = tail, *next = first->next.load(std::memory_order_acquire);
+
+			if (first == &stub)
+			{
+				if (next == nullptr) return nullptr;
+
+				tail = first = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next != nullptr)
+			{
+				tail = next;
+				return first;
+			}
+
+			if (first != head.load(std::memory_order_acquire)) return nullptr;
+
+			Push(&stub);
+			next = first->next.load(std::memory_order_acquire);
+			if (next != nullptr)
+			{
+				tail = next;
+				return first;
+			}
+
+			return nullptr;
+		}
+
+	private:
+		std::atomic<Node*> head;
+		Node *tail;
+		Node stub;
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_MPSCQUEUE_HPP__
@@ -48,6 +48,33 @@ namespace FreshCask
 #endif
 	}
 
+	// func gets the name of each subdirectory, not its path
+	Status ListSubDirs(const std::string& dirPath, std::function<Status(const std::string&)> func)
+	{
+#ifdef WIN32
+		std::string query = dirPath + "\\*.*";
+		WIN32_FIND_DATAA fileData;
+		HANDLE hFind;
+
+		if ((hFind = FindFirstFileA(query.c_str(), &fileData)) == INVALID_HANDLE_VALUE)
+			return Status::IOError("Utils::ListSubDirs()", "Failed to FindFirstFile.");
+
+		do
+		{
+			std::string name = fileData.cFileName;
+			if ((fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && name != "." && name != "..")
+			{
+				Status ret = func(name);
+				if (!ret.IsOK()) { FindClose(hFind); RET_BY_SENDER(ret, "Utils::ListSubDirs()"); }
+			}
+		} while (FindNextFileA(hFind, &fileData));
+
+		FindClose(hFind);
+		RET_BY_SENDER(Status::OK(), "Utils::ListSubDirs()");
+#else
+#endif
+	}
+
 	bool EndWith(const std::string &str, const std::string &match)
 	{
 		return str.substr(str.length() - match.length()) == match;
@@ -73,10 +100,13 @@ namespace FreshCask
 		else RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "Utils::RemoveDir()");
 	}
 
-	Status RenameFile(const std::string& oldPath, const std::string& newPath)
+	// replaceExisting swaps newPath for oldPath in one step, and only returns once that is on disk
+	Status RenameFile(const std::string& oldPath, const std::string& newPath, bool replaceExisting = false)
 	{
 #ifdef WIN32
-		if (::MoveFileA(oldPath.c_str(), newPath.c_str())) RET_BY_SENDER(Status::OK(), "Utils::RenameFile()");
+		BOOL moved = replaceExisting ? ::MoveFileExA(oldPath.c_str(), newPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)
+			: ::MoveFileA(oldPath.c_str(), newPath.c_str());
+		if (moved) RET_BY_SENDER(Status::OK(), "Utils::RenameFile()");
 		else RET_BY_SENDER(Status::IOError(ErrnoTranslator(GetLastError())), "Utils::RenameFile()");
 #endif
 	}
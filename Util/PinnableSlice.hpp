@@ -0,0 +1,103 @@
+#ifndef __UTIL_PINNABLESLICE_HPP__
+#define __UTIL_PINNABLESLICE_HPP__
+
+namespace FreshCask
+{
+	// Read-only view of a value that keeps the memory under it alive. Either the bytes are
+	// pinned where they already are, such as a cache entry, and the owner is told through
+	// the release function once the slice lets go, or the slice holds a buffer of its own.
+	// A slice must be released, or go out of scope, before the bucket it came from is closed.
+	class PinnableSlice
+	{
+	public:
+		typedef void (*ReleaseFunction)(void *owner, void *handle);
+
+	public:
+		PinnableSlice() : data(nullptr), size(0), release(nullptr), owner(nullptr), handle(nullptr) {}
+		~PinnableSlice() { Reset(); }
+
+		PinnableSlice(const PinnableSlice&) = delete;
+		PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+		PinnableSlice(PinnableSlice&& rhs) : PinnableSlice() { *this = std::move(rhs); }
+
+		PinnableSlice& operator=(PinnableSlice&& rhs)
+		{
+			if (this != &rhs)
+			{
+				Reset();
+				buffer = std::move(rhs.buffer);
+				data = rhs.release != nullptr ? rhs.data : buffer.Data(); // an inline buffer has moved
+				size = rhs.size;
+				release = rhs.release, owner = rhs.owner, handle = rhs.handle;
+
+				rhs.data = nullptr, rhs.size = 0;
+				rhs.release = nullptr, rhs.owner = rhs.handle = nullptr;
+			}
+			return *this;
+		}
+
+		//************************************
+		// Method:    Pin
+		// FullName:  FreshCask::PinnableSlice::Pin
+		// Access:    public
+		// Returns:   void
+		// Desc:      Point at memory somebody else owns, release(owner, handle) is called once
+		//            the slice is reset, assigned or destroyed
+		// Parameter: const Byte * ptr
+		// Parameter: uint32_t length
+		// Parameter: ReleaseFunction func
+		// Parameter: void * owner
+		// Parameter: void * handle
+		//************************************
+		void Pin(const Byte *ptr, uint32_t length, ReleaseFunction func, void *_owner, void *_handle)
+		{
+			Reset();
+			data = ptr, size = length;
+			release = func, owner = _owner, handle = _handle;
+		}
+
+		// take bar over as the slice's own buffer
+		void PinSelf(SmartByteArray &&bar)
+		{
+			Reset();
+			buffer = std::move(bar);
+			data = buffer.Data(), size = buffer.Size();
+		}
+
+		void Reset()
+		{
+			if (release != nullptr) release(owner, handle);
+			release = nullptr, owner = handle = nullptr;
+			buffer = SmartByteArray::Null();
+			data = nullptr, size = 0;
+		}
+
+		const Byte* Data() const { return data; }
+		uint32_t Size() const { return size; }
+
+		// true if the bytes belong to somebody else rather than to the slice
+		bool IsPinned() const { return release != nullptr; }
+
+		// borrowed view for interfaces that take a SmartByteArray, valid while the slice is
+		SmartByteArray View() const { return SmartByteArray::Borrow(data, size); }
+
+		std::string ToString() const
+		{
+			if (data != nullptr)
+				return std::string(reinterpret_cast<const char*>(data), size);
+			else
+				return std::string();
+		}
+
+	private:
+		SmartByteArray buffer;
+		const Byte *data;
+		uint32_t size;
+
+		ReleaseFunction release;
+		void *owner, *handle;
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_PINNABLESLICE_HPP__
@@ -0,0 +1,74 @@
+#ifndef __UTIL_SCRATCHARENA_HPP__
+#define __UTIL_SCRATCHARENA_HPP__
+
+#include <vector>
+#include <memory>
+
+namespace FreshCask
+{
+	// Bump allocator for short-lived encoding buffers. Memory handed out by Allocate() stays
+	// valid until Reset(); after a Reset() the arena keeps one block big enough for everything
+	// allocated so far, so a steady workload stops hitting the heap.
+	class ScratchArena
+	{
+	public:
+		ScratchArena(uint32_t initSize = 4096) : used(0) { blocks.push_back(Block(initSize)); }
+
+		ScratchArena(const ScratchArena&) = delete;
+		ScratchArena& operator=(const ScratchArena&) = delete;
+
+		BytePtr Allocate(uint32_t size)
+		{
+			size = (size + 7) & ~7u; // keep everything 8-byte aligned
+
+			Block &cur = blocks.back();
+			if (cur.Size - used < size)
+			{
+				uint32_t newSize = cur.Size * 2;
+				while (newSize < size) newSize *= 2;
+
+				blocks.push_back(Block(newSize));
+				used = 0;
+			}
+
+			BytePtr ptr = blocks.back().Data.get() + used;
+			used += size;
+			return ptr;
+		}
+
+		void Reset()
+		{
+			if (blocks.size() > 1)
+			{
+				uint32_t total = 0;
+				for (auto& block : blocks) total += block.Size;
+
+				blocks.clear();
+				blocks.push_back(Block(total));
+			}
+			used = 0;
+		}
+
+		// one arena per thread, Reset() it when the buffers are no longer referenced
+		static ScratchArena& ThreadLocal()
+		{
+			static thread_local ScratchArena arena;
+			return arena;
+		}
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<Byte[]> Data;
+			uint32_t Size;
+
+			Block(uint32_t Size) : Data(new Byte[Size]), Size(Size) {}
+		};
+
+	private:
+		std::vector<Block> blocks;
+		uint32_t used;
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_SCRATCHARENA_HPP__
@@ -0,0 +1,217 @@
+#ifndef __UTIL_SLABALLOCATOR_HPP__
+#define __UTIL_SLABALLOCATOR_HPP__
+
+#include <atomic>
+#include <vector>
+#include <memory>
+
+#include <Util/LockGuard.hpp>
+
+namespace FreshCask
+{
+	// Memcached-style slabs for cache items. Sizes are rounded up to one of a fixed series of
+	// chunk sizes, each size class carves its chunks out of pages of its own and takes freed
+	// chunks back for reuse. A page whose chunks are all free again goes back to a shared pool
+	// for any class to take, so memory follows the item sizes as they shift, and pages are
+	// never handed back to the heap: memory stays within the limit however long the cache churns.
+	class SlabAllocator
+	{
+	public:
+		struct Page
+		{
+			std::unique_ptr<Byte[]> Data;
+			uint8_t ClassId;
+			uint32_t Used;           // chunks handed out
+			BytePtr FreeList;        // freed chunks, linked through their first bytes
+			BytePtr Cursor, End;     // not carved yet
+			Page *Prev, *Next;       // partial pages of the class
+			bool InPartial;
+
+			Page(uint32_t size) : Data(new Byte[size]), ClassId(0), Used(0), FreeList(nullptr), Cursor(nullptr), End(nullptr), Prev(nullptr), Next(nullptr), InPartial(false) {}
+			bool Full() const { return FreeList == nullptr && Cursor == End; }
+		};
+
+	private:
+		struct SizeClass
+		{
+			Mutex SyncMutex;
+			uint32_t ChunkSize;
+			Page *Partial; // pages with a chunk to spare
+
+			SizeClass() : SyncMutex("SlabAllocator.SizeClass", DefaultLockSpins), ChunkSize(0), Partial(nullptr) {}
+		};
+
+	public:
+		//************************************
+		// Method:    SlabAllocator
+		// FullName:  FreshCask::SlabAllocator::SlabAllocator
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint64_t limit, bytes of pages all classes together may take
+		// Parameter: uint32_t pageSize, also the largest chunk
+		//************************************
+		SlabAllocator(uint64_t limit, uint32_t pageSize = SlabPageSize) : pageSize(pageSize), poolMutex("SlabAllocator.Pool"), pageCount(0), pageLimit(0)
+		{
+			uint32_t chunkSize = SlabMinChunkSize;
+			while (true)
+			{
+				classes.push_back(std::unique_ptr<SizeClass>(new SizeClass));
+				classes.back()->ChunkSize = chunkSize;
+				if (chunkSize >= pageSize) break;
+
+				// next class is SlabGrowthFactor times larger, 8-byte aligned
+				uint32_t next = ((uint32_t)(chunkSize * SlabGrowthFactor) + 7) & ~7u;
+				chunkSize = next < pageSize ? next : pageSize;
+			}
+
+			SetLimit(limit);
+		}
+
+		SlabAllocator(const SlabAllocator&) = delete;
+		SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+		// pages already taken are kept, the limit only stops further growth
+		void SetLimit(uint64_t limit)
+		{
+			pageLimit.store((uint32_t)((limit + pageSize - 1) / pageSize) + SlabSparePages, std::memory_order_relaxed);
+		}
+
+		//************************************
+		// Method:    ClassOf
+		// FullName:  FreshCask::SlabAllocator::ClassOf
+		// Access:    public
+		// Returns:   bool, false if size is larger than the largest chunk
+		// Parameter: uint32_t size
+		// Parameter: uint8_t & classId
+		//************************************
+		bool ClassOf(uint32_t size, uint8_t &classId) const
+		{
+			for (size_t i = 0; i < classes.size(); i++)
+			{
+				if (classes[i]->ChunkSize >= size)
+				{
+					classId = (uint8_t)i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		uint32_t ChunkSize(uint8_t classId) const { return classes[classId]->ChunkSize; }
+
+		//************************************
+		// Method:    Allocate
+		// FullName:  FreshCask::SlabAllocator::Allocate
+		// Access:    public
+		// Returns:   BytePtr, nullptr if the class has no free chunk and no page is left
+		// Parameter: uint8_t classId
+		// Parameter: Page * & page, to be passed to Free() along with the chunk
+		//************************************
+		BytePtr Allocate(uint8_t classId, Page *&page)
+		{
+			SizeClass &sc = *classes[classId];
+			LockGuard lock(sc.SyncMutex);
+
+			page = sc.Partial;
+			if (page == nullptr)
+			{
+				page = takePage();
+				if (page == nullptr) return nullptr;
+
+				page->ClassId = classId;
+				page->Used = 0;
+				page->FreeList = nullptr;
+				page->Cursor = page->Data.get();
+				page->End = page->Cursor + pageSize / sc.ChunkSize * sc.ChunkSize;
+				link(sc, page);
+			}
+
+			BytePtr chunk;
+			if (page->FreeList != nullptr)
+			{
+				chunk = page->FreeList;
+				memcpy(&page->FreeList, chunk, sizeof(BytePtr));
+			}
+			else
+			{
+				chunk = page->Cursor;
+				page->Cursor += sc.ChunkSize;
+			}
+
+			page->Used++;
+			if (page->Full()) unlink(sc, page);
+			return chunk;
+		}
+
+		void Free(BytePtr chunk, Page *page)
+		{
+			SizeClass &sc = *classes[page->ClassId];
+			LockGuard lock(sc.SyncMutex);
+
+			memcpy(chunk, &page->FreeList, sizeof(BytePtr));
+			page->FreeList = chunk;
+			page->Used--;
+
+			if (page->Used == 0)
+			{
+				if (page->InPartial) unlink(sc, page);
+
+				LockGuard poolLock(poolMutex);
+				freePages.push_back(page); // empty, any class may have it now
+			}
+			else if (!page->InPartial) link(sc, page);
+		}
+
+		// bytes of pages taken by all classes
+		uint64_t GetMemory() const { return (uint64_t)pageCount.load(std::memory_order_relaxed) * pageSize; }
+
+	private:
+		Page* takePage()
+		{
+			LockGuard poolLock(poolMutex);
+
+			if (!freePages.empty())
+			{
+				Page *page = freePages.back();
+				freePages.pop_back();
+				return page;
+			}
+
+			if (pageCount.load(std::memory_order_relaxed) >= pageLimit.load(std::memory_order_relaxed))
+				return nullptr;
+
+			pages.push_back(std::unique_ptr<Page>(new Page(pageSize)));
+			pageCount.fetch_add(1, std::memory_order_relaxed);
+			return pages.back().get();
+		}
+
+		void link(SizeClass &sc, Page *page)
+		{
+			page->Prev = nullptr;
+			page->Next = sc.Partial;
+			if (sc.Partial != nullptr) sc.Partial->Prev = page;
+			sc.Partial = page;
+			page->InPartial = true;
+		}
+
+		void unlink(SizeClass &sc, Page *page)
+		{
+			if (page->Prev != nullptr) page->Prev->Next = page->Next;
+			else sc.Partial = page->Next;
+			if (page->Next != nullptr) page->Next->Prev = page->Prev;
+			page->InPartial = false;
+		}
+
+	private:
+		std::vector<std::unique_ptr<SizeClass>> classes;
+		uint32_t pageSize;
+
+		Mutex poolMutex;
+		std::vector<std::unique_ptr<Page>> pages; // all of them, guarded by poolMutex
+		std::vector<Page*> freePages;
+		std::atomic<uint32_t> pageCount, pageLimit;
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_SLABALLOCATOR_HPP__
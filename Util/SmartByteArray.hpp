@@ -5,17 +5,98 @@
 
 namespace FreshCask {
 
+	// Byte buffer passed between layers by value. A buffer of up to InlineSize bytes is kept
+	// inside the object itself, a larger one lives on the heap and is shared by copies and
+	// slices of it, so copying, moving or slicing a large buffer never copies its bytes. A borrowed
+	// buffer doesn't own its bytes at all, whoever lends them must keep them alive.
+	//
+	// Writing through Data() is seen by other copies and slices of a heap buffer, but not
+	// by copies of an inline one, so fill a buffer before handing copies of it around.
 	class SmartByteArray
 	{
+	public:
+		static const uint32_t InlineSize = 20; // keeps the object 48 bytes on 64-bit builds
+
 	public:
 		SmartByteArray() : data(nullptr), size(0) {}
-		SmartByteArray(const uint32_t& size) : data(new Byte[size]), size(size) {}
-		SmartByteArray(const std::string& str) : data(new Byte[str.length()]), size(str.length())
+		SmartByteArray(const uint32_t& size) : size(size) { allocate(); }
+		SmartByteArray(const std::string& str) : size((uint32_t)str.length())
+		{
+			allocate();
+			if (size > 0) memcpy(data, str.data(), size);
+		}
+		SmartByteArray(const char* str) : SmartByteArray(std::string(str)) {}
+
+		SmartByteArray(const SmartByteArray& rhs) : holder(rhs.holder), data(rhs.data), size(rhs.size) { takeInline(rhs); }
+		SmartByteArray(SmartByteArray&& rhs) noexcept : holder(std::move(rhs.holder)), data(rhs.data), size(rhs.size)
+		{
+			takeInline(rhs);
+			rhs.data = nullptr, rhs.size = 0;
+		}
+
+		SmartByteArray& operator=(const SmartByteArray& rhs)
+		{
+			if (this != &rhs)
+			{
+				holder = rhs.holder, data = rhs.data, size = rhs.size;
+				takeInline(rhs);
+			}
+			return *this;
+		}
+
+		SmartByteArray& operator=(SmartByteArray&& rhs) noexcept
+		{
+			if (this != &rhs)
+			{
+				holder = std::move(rhs.holder), data = rhs.data, size = rhs.size;
+				takeInline(rhs);
+				rhs.data = nullptr, rhs.size = 0;
+			}
+			return *this;
+		}
+
+		//************************************
+		// Method:    Borrow
+		// FullName:  FreshCask::SmartByteArray::Borrow
+		// Access:    public static
+		// Returns:   FreshCask::SmartByteArray
+		// Desc:      View size bytes at ptr without owning them, copies are views as well
+		// Parameter: const Byte * ptr
+		// Parameter: uint32_t size
+		//************************************
+		static SmartByteArray Borrow(const Byte *ptr, uint32_t size)
 		{
-			memcpy(Data(), &str[0], str.length());
+			SmartByteArray bar;
+			bar.data = const_cast<BytePtr>(ptr), bar.size = size;
+			return bar;
+		}
+
+		// a buffer of its own holding a copy of size bytes at ptr
+		static SmartByteArray Copy(const Byte *ptr, uint32_t size)
+		{
+			SmartByteArray bar(size);
+			if (size > 0) memcpy(bar.Data(), ptr, size);
+			return bar;
+		}
+
+		//************************************
+		// Method:    Slice
+		// FullName:  FreshCask::SmartByteArray::Slice
+		// Access:    public
+		// Returns:   FreshCask::SmartByteArray
+		// Desc:      length bytes from offset on, sharing a heap buffer with this one. Bytes of
+		//            an inline buffer are copied, a slice of a borrowed one is borrowed too.
+		// Parameter: uint32_t offset
+		// Parameter: uint32_t length
+		//************************************
+		SmartByteArray Slice(uint32_t offset, uint32_t length) const
+		{
+			if (isInline()) return Copy(data + offset, length);
+
+			SmartByteArray bar;
+			bar.holder = holder, bar.data = data + offset, bar.size = length;
+			return bar;
 		}
-		SmartByteArray(const char* str) { new (this) SmartByteArray(std::string(str)); }
-		SmartByteArray(const BytePtr ptr, const uint32_t& size) : data(ptr, senderAllocDeleter()), size(size) {}
 
 		std::string ToString() const
 		{
@@ -25,27 +106,51 @@ namespace FreshCask {
 				return std::string();
 		}
 
-		BytePtr Data() const { return data.get(); }
+		BytePtr Data() const { return data; }
 		uint32_t Size() const { return size; }
 
-		bool IsNull() { return size == 0 || data == nullptr; }
+		bool IsNull() const { return size == 0 || data == nullptr; }
 		static SmartByteArray Null() { return SmartByteArray();  }
 
 		friend bool operator<(const SmartByteArray& lhs, const SmartByteArray& rhs)
 		{
-			return lhs.ToString() < rhs.ToString();
+			// same order as comparing ToString(), without building two strings per comparison
+			uint32_t len = lhs.Size() < rhs.Size() ? lhs.Size() : rhs.Size();
+			int cmp = len > 0 ? memcmp(lhs.Data(), rhs.Data(), len) : 0;
+			return cmp < 0 || (cmp == 0 && lhs.Size() < rhs.Size());
 		}
 
 	private:
-		struct senderAllocDeleter { // tricky, avoid being deleted by std::shared_ptr
-			void operator()(BytePtr) { /* do nothing */ }
-		};
+		void allocate()
+		{
+			if (size <= InlineSize)
+				data = size > 0 ? inlineData : nullptr;
+			else
+			{
+				holder.reset(new Byte[size], std::default_delete<Byte[]>());
+				data = holder.get();
+			}
+		}
+
+		bool isInline() const { return data == inlineData; }
+
+		// data was copied from rhs, point it at our own bytes if rhs kept them inline
+		void takeInline(const SmartByteArray& rhs)
+		{
+			if (rhs.data == rhs.inlineData)
+			{
+				memcpy(inlineData, rhs.inlineData, size);
+				data = inlineData;
+			}
+		}
 
 	private:
-		std::shared_ptr<Byte> data;
+		std::shared_ptr<Byte> holder; // owns a heap buffer, null if inline or borrowed
+		BytePtr data;
 		uint32_t size;
+		Byte inlineData[InlineSize];
 	};
 
 }	// namespace FreshCask
 
-#endif // __UTIL_SMARTBYTEARRAY_HPP__
\ No newline at end of file
+#endif // __UTIL_SMARTBYTEARRAY_HPP__
@@ -0,0 +1,54 @@
+#ifndef __UTIL_STATCOUNTER_HPP__
+#define __UTIL_STATCOUNTER_HPP__
+
+#include <atomic>
+
+namespace FreshCask
+{
+	// Counter for statistics bumped on hot paths. Threads add to one of several slots, each
+	// on a cache line of its own, so counting never takes a lock and threads seldom share a
+	// line; reading sums the slots and is only as exact as the adds it races with.
+	class StatCounter
+	{
+	public:
+		StatCounter() { Reset(); }
+
+		StatCounter(const StatCounter&) = delete;
+		StatCounter& operator=(const StatCounter&) = delete;
+
+		void Add(int64_t n = 1) { slots[threadSlot()].Value.fetch_add(n, std::memory_order_relaxed); }
+
+		int64_t Get() const
+		{
+			int64_t sum = 0;
+			for (auto& slot : slots) sum += slot.Value.load(std::memory_order_relaxed);
+			return sum;
+		}
+
+		void Reset()
+		{
+			for (auto& slot : slots) slot.Value.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		static const uint32_t SlotCount = 16;
+
+		struct alignas(64) Slot
+		{
+			std::atomic<int64_t> Value;
+		};
+
+		// threads take slots round robin on first use
+		static uint32_t threadSlot()
+		{
+			static std::atomic<uint32_t> next(0);
+			static thread_local uint32_t slot = next.fetch_add(1, std::memory_order_relaxed) % SlotCount;
+			return slot;
+		}
+
+	private:
+		Slot slots[SlotCount];
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_STATCOUNTER_HPP__
@@ -18,19 +18,19 @@ namespace FreshCask
 	class Status
 	{
 	public:
-		Status() { code = cOK, message1 = "The operation completed successfully."; }
+		Status() : code(cOK) {} // OK carries no message, so returning it never allocates
 		explicit Status(int code) : code(code) {}
 		explicit Status(bool cond)
 		{
 			if (!cond) code = cUserDefined, message1 = "The operation was cancelled by user.";
-			else code = cOK, message1 = "The operation completed successfully.";
+			else code = cOK;
 		}
 		Status(int code, std::string message1, std::string message2)
 			: code(code), message1(message1), message2(message2) {}
 
 		static Status OK() 
 		{ 
-			return Status(cOK, "The operation completed successfully.", ""); 
+			return Status(cOK); 
 		}
 		static Status NotFound(const std::string& message1, const std::string& message2 = "")
 		{
@@ -65,9 +65,9 @@ namespace FreshCask
 			return Status(cUserDefined, message1, message2);
 		}
 
-		Status& PushSender(const std::string& caller, const char* file, const int line) 
+		Status& PushSender(const char* caller, const char* file, const int line) 
 		{ 
-			traceback.push_back(make_tuple(caller, file, line));
+			if (EnableStatusTrackback) traceback.push_back(std::make_tuple(std::string(caller), std::string(file), line));
 			return *this;
 		}
 
@@ -90,6 +90,7 @@ namespace FreshCask
 			{
 			case cOK:
 				result << "OK: ";
+				if (message1.empty()) result << "The operation completed successfully.";
 				break;
 
 			case cNotFound:
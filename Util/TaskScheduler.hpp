@@ -0,0 +1,320 @@
+#ifndef __UTIL_TASKSCHEDULER_HPP__
+#define __UTIL_TASKSCHEDULER_HPP__
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+
+namespace FreshCask
+{
+	namespace TaskPriority
+	{
+		enum Type
+		{
+			Foreground = 0, // a caller is waiting on it, e.g. GetAsync()
+			Background,     // maintenance: merge, compaction, checkpoints
+			Idle,           // nice to have, e.g. cache warm-up
+			Count
+		};
+	} // namespace TaskPriority
+
+	class TaskGroup;
+
+	// a task as queued by TaskScheduler
+	struct ScheduledTask
+	{
+		enum State { Queued, Running, Done, Cancelled };
+
+		std::function<void()> Func;
+		TaskGroup *Group;
+		std::atomic<int> CurrentState;
+
+		ScheduledTask(std::function<void()> Func, TaskGroup *Group) : Func(std::move(Func)), Group(Group), CurrentState(Queued) {}
+
+		// whoever moves the task out of Queued first owns it: a worker to run it, or a canceller
+		bool Claim(State state)
+		{
+			int expected = Queued;
+			return CurrentState.compare_exchange_strong(expected, state, std::memory_order_acq_rel);
+		}
+	};
+
+	// Tasks submitted on behalf of one owner, so the owner can drop those not started yet and
+	// wait for the rest before it goes away. A dropped task is done at once, whether or not a
+	// worker is free to take it off its queue.
+	class TaskGroup
+	{
+		friend class TaskScheduler;
+
+	public:
+		TaskGroup() : outstanding(0), cancelled(false) {}
+		~TaskGroup() { Wait(); }
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		// drop tasks not started yet and refuse new ones until Reset()
+		void Cancel()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = true;
+
+			for (auto it = tasks.begin(); it != tasks.end(); )
+			{
+				if ((*it)->Claim(ScheduledTask::Cancelled)) it = tasks.erase(it), outstanding--;
+				else ++it; // running
+			}
+			if (outstanding == 0) cond.notify_all();
+		}
+
+		// until every task submitted is done or dropped
+		void Wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this] { return outstanding == 0; });
+		}
+
+		void Reset()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = false;
+		}
+
+	private:
+		bool enter(ScheduledTask *task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (cancelled) return false;
+
+			tasks.insert(task);
+			outstanding++;
+			return true;
+		}
+
+		// by whoever claimed task, while it still holds a reference to it
+		void leave(ScheduledTask *task)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.erase(task);
+			if (--outstanding == 0) cond.notify_all();
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::unordered_set<ScheduledTask*> tasks; // queued or running
+		uint32_t outstanding;
+		bool cancelled;
+	};
+
+	// Work-stealing pool for everything that runs in the background. Every worker has a queue
+	// per priority: it takes from the back of its own, idle workers steal from the front of
+	// the others', and no task is started while one of a higher priority waits anywhere. A
+	// task submitted by a worker goes to that worker's queue, others are spread round robin.
+	class TaskScheduler
+	{
+	public:
+		typedef std::function<void()> TaskType;
+
+		// what Submit() gives back: cancel the task unless it has started
+		class Handle
+		{
+			friend class TaskScheduler;
+
+		public:
+			Handle() {}
+
+			bool IsValid() const { return task != nullptr; }
+
+			//************************************
+			// Method:    Cancel
+			// FullName:  FreshCask::TaskScheduler::Handle::Cancel
+			// Access:    public
+			// Returns:   bool, true if the task will never run
+			//************************************
+			bool Cancel()
+			{
+				if (task == nullptr) return false;
+				if (!task->Claim(ScheduledTask::Cancelled)) return task->CurrentState.load() == ScheduledTask::Cancelled;
+
+				if (task->Group != nullptr) task->Group->leave(task.get());
+				return true;
+			}
+
+		private:
+			Handle(const std::shared_ptr<ScheduledTask> &task) : task(task) {}
+
+		private:
+			std::shared_ptr<ScheduledTask> task;
+		};
+
+	private:
+		struct Worker
+		{
+			std::mutex Mutex;
+			std::deque<std::shared_ptr<ScheduledTask>> Queues[TaskPriority::Count];
+		};
+
+	public:
+		//************************************
+		// Method:    TaskScheduler
+		// FullName:  FreshCask::TaskScheduler::TaskScheduler
+		// Access:    public
+		// Returns:
+		// Qualifier:
+		// Parameter: uint32_t threadCount, 0 for one per core
+		//************************************
+		TaskScheduler(uint32_t threadCount = 0) : queuedCount(0), nextWorker(0), stopping(false)
+		{
+			if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+			for (uint32_t i = 0; i < threadCount; i++)
+				workers.push_back(std::unique_ptr<Worker>(new Worker));
+			for (uint32_t i = 0; i < threadCount; i++)
+				threads.push_back(std::thread(&TaskScheduler::run, this, i));
+		}
+
+		~TaskScheduler() { Stop(); }
+
+		TaskScheduler(const TaskScheduler&) = delete;
+		TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+		//************************************
+		// Method:    Submit
+		// FullName:  FreshCask::TaskScheduler::Submit
+		// Access:    public
+		// Returns:   FreshCask::TaskScheduler::Handle, invalid if the task was refused
+		// Desc:      Queue func, refused once the scheduler stops or group is cancelled
+		// Parameter: TaskType func
+		// Parameter: TaskPriority::Type priority
+		// Parameter: TaskGroup * group, may be nullptr
+		//************************************
+		Handle Submit(TaskType func, TaskPriority::Type priority = TaskPriority::Background, TaskGroup *group = nullptr)
+		{
+			if (stopping.load(std::memory_order_acquire)) return Handle();
+
+			std::shared_ptr<ScheduledTask> task = std::make_shared<ScheduledTask>(std::move(func), group);
+			if (group != nullptr && !group->enter(task.get())) return Handle();
+
+			int self = currentWorker();
+			Worker &worker = *workers[self >= 0 ? (uint32_t)self : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+			{
+				std::lock_guard<std::mutex> lock(worker.Mutex);
+				worker.Queues[priority].push_back(task);
+			}
+
+			// counted under sleepMutex, so a worker about to sleep can't miss it
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				queuedCount++;
+			}
+			sleepCond.notify_one();
+			return Handle(task);
+		}
+
+		// let workers finish every queued task, then join them
+		void Stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				if (stopping.exchange(true)) return;
+			}
+			sleepCond.notify_all();
+
+			for (auto& thread : threads) thread.join();
+			threads.clear();
+		}
+
+		uint32_t GetThreadCount() const { return (uint32_t)workers.size(); }
+
+		// true on the workers of this scheduler, whatever task they are running
+		bool IsWorkerThread() const { return currentWorker() >= 0; }
+
+	private:
+		// index of the calling thread among the workers of this scheduler, -1 for other threads
+		int currentWorker() const { return currentScheduler() == this ? currentIndex() : -1; }
+
+		static const TaskScheduler*& currentScheduler()
+		{
+			static thread_local const TaskScheduler *scheduler = nullptr;
+			return scheduler;
+		}
+
+		static int& currentIndex()
+		{
+			static thread_local int index = -1;
+			return index;
+		}
+
+		std::shared_ptr<ScheduledTask> take(uint32_t self)
+		{
+			for (int priority = 0; priority < TaskPriority::Count; priority++)
+			{
+				for (size_t i = 0; i < workers.size(); i++)
+				{
+					Worker &worker = *workers[(self + i) % workers.size()];
+					std::lock_guard<std::mutex> lock(worker.Mutex);
+
+					std::deque<std::shared_ptr<ScheduledTask>> &queue = worker.Queues[priority];
+					if (queue.empty()) continue;
+
+					std::shared_ptr<ScheduledTask> task;
+					if (i == 0) task = std::move(queue.back()), queue.pop_back(); // own queue, newest first
+					else task = std::move(queue.front()), queue.pop_front();      // stolen, oldest first
+					return task;
+				}
+			}
+			return nullptr;
+		}
+
+		void run(uint32_t self)
+		{
+			currentScheduler() = this;
+			currentIndex() = (int)self;
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(sleepMutex);
+					sleepCond.wait(lock, [this] { return queuedCount > 0 || stopping; });
+					if (queuedCount == 0) return; // stopping and drained
+				}
+
+				std::shared_ptr<ScheduledTask> task = take(self);
+				if (task == nullptr) continue; // another worker got there first
+
+				{
+					std::lock_guard<std::mutex> lock(sleepMutex);
+					queuedCount--;
+				}
+
+				if (!task->Claim(ScheduledTask::Running)) continue; // cancelled while queued
+
+				task->Func();
+				task->Func = nullptr; // what it holds goes before the owner hears it's done
+				task->CurrentState.store(ScheduledTask::Done, std::memory_order_release);
+				if (task->Group != nullptr) task->Group->leave(task.get());
+			}
+		}
+
+	private:
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+
+		std::mutex sleepMutex;
+		std::condition_variable sleepCond;
+		uint64_t queuedCount; // tasks on all queues, guarded by sleepMutex
+
+		std::atomic<uint32_t> nextWorker;
+		std::atomic<bool> stopping;
+	};
+} // namespace FreshCask
+
+#endif // __UTIL_TASKSCHEDULER_HPP__